@@ -0,0 +1,117 @@
+#if !defined(__NORI_AOV_H)
+#define __NORI_AOV_H
+
+#include <nori/color.h>
+#include <nori/vector.h>
+
+NORI_NAMESPACE_BEGIN
+
+struct Intersection;
+
+/**
+ * \brief Values of the arbitrary output variables (AOVs) of one camera ray
+ *
+ * The surface values describe the first intersection of the camera ray.
+ * The radiance estimate is additionally split by the lobe of the first
+ * scattering event: \c emission holds emitters seen directly, \c specular
+ * everything reaching the camera through a perfectly specular first bounce,
+ * and \c diffuse the rest (so that the three add up to the full estimate).
+ */
+struct AOVRecord {
+    Color3f albedo;    ///< Albedo of the first surface
+    Normal3f normal;   ///< Shading normal of the first surface (world space)
+    float depth;       ///< Distance to the first surface (0 if the ray escapes)
+    int primId;        ///< Primitive index of the first surface (-1 if the ray escapes)
+    Color3f emission;  ///< Directly visible emission
+    Color3f diffuse;   ///< Radiance through a non-specular first bounce
+    Color3f specular;  ///< Radiance through a specular first bounce
+
+    AOVRecord()
+        : albedo(0.f), normal(0.f), depth(0.f), primId(-1),
+          emission(0.f), diffuse(0.f), specular(0.f) { }
+
+    /// Fill the surface values from the first intersection of a camera ray
+    void setSurface(const Intersection &its);
+};
+
+/**
+ * \brief Set of AOVs to render and their channel layout in an \ref ImageBlock
+ *
+ * AOVs are requested on the scene with a comma-separated list, e.g.
+ * <tt>&lt;string name="aovs" value="albedo, normal, depth"/&gt;</tt>.
+ * Each AOV is stored as one or three consecutive float channels.
+ */
+class AOVLayout {
+public:
+    enum EType {
+        EAlbedo = 0,
+        ENormal,
+        EDepth,
+        EPrimId,
+        EEmission,
+        EDiffuse,
+        ESpecular,
+        ETypeCount
+    };
+
+    /// How the samples of an AOV are combined into pixels
+    enum EReconstruction {
+        /// Weighted by the reconstruction filter, like the image itself
+        EFiltered = 0,
+        /// Average of the samples inside the pixel
+        EBox,
+        /// Value of the first sample inside the pixel (for identifiers)
+        EFirst
+    };
+
+    /// Create an empty layout
+    AOVLayout() : m_channelCount(0) { }
+
+    /// Create a layout from a comma-separated list of AOV names
+    explicit AOVLayout(const std::string &names);
+
+    /// Return whether no AOVs were requested
+    bool empty() const { return m_types.empty(); }
+
+    /// Return the number of AOVs
+    int size() const { return (int) m_types.size(); }
+
+    /// Return the type of the \c i-th AOV
+    EType getType(int i) const { return m_types[i]; }
+
+    /// Return the first channel of the \c i-th AOV
+    int getOffset(int i) const { return m_offsets[i]; }
+
+    /// Return the total number of channels
+    int getChannelCount() const { return m_channelCount; }
+
+    /// Return whether an AOV of the given type was requested
+    bool has(EType type) const;
+
+    /// Request an additional AOV (does nothing if it is already present)
+    void add(EType type);
+
+    /// Write the values of a record into \c getChannelCount() channels
+    void pack(const AOVRecord &record, float *channels) const;
+
+    /// Return the name of an AOV type (as used in the scene and the EXR layer)
+    static const char *getName(EType type);
+
+    /// Return the number of channels of an AOV type
+    static int getChannelCount(EType type);
+
+    /// Return how the samples of an AOV type are reconstructed
+    static EReconstruction getReconstruction(EType type);
+
+    /// Return a human-readable list of the requested AOVs
+    std::string toString() const;
+
+private:
+    std::vector<EType> m_types;
+    std::vector<int> m_offsets;
+    int m_channelCount;
+};
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_AOV_H */
@@ -24,6 +24,40 @@
 
 NORI_NAMESPACE_BEGIN
 
+/**
+ * \brief Convert a linear value into an 8-bit sRGB-encoded value
+ *
+ * Uses a lookup table indexed by the exponent and the leading mantissa bits
+ * of the value instead of evaluating the sRGB curve. Values outside of
+ * [0, 1] (including NaNs) are clamped.
+ */
+extern uint8_t linearToSRGB8(float value);
+
+/// Options for writing OpenEXR files (see \ref Bitmap::save())
+struct EXROptions {
+    enum ECompression {
+        ENone = 0,
+        EZip,
+        EPiz,
+        EDwaa
+    };
+
+    /// Store 16-bit half channels instead of 32-bit floats
+    bool halfPrecision;
+    /// Use a tiled instead of a scanline layout
+    bool tiled;
+    /// Compression codec
+    ECompression compression;
+
+    EXROptions() : halfPrecision(false), tiled(false), compression(EZip) { }
+
+    /// Parse a compression name ("none", "zip", "piz" or "dwaa")
+    static ECompression parseCompression(const std::string &name);
+
+    /// Return a human-readable summary
+    std::string toString() const;
+};
+
 /**
  * \brief Stores a RGB high dynamic-range bitmap
  *
@@ -33,6 +67,14 @@ class Bitmap : public Eigen::Array<Color3f, Eigen::Dynamic, Eigen::Dynamic, Eige
 public:
     typedef Eigen::Array<Color3f, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> Base;
 
+    /// Additional named image layer, written to OpenEXR files as "<name>.<channel>"
+    struct Layer {
+        std::string name;                  ///< Layer name
+        std::vector<std::string> channels; ///< Channel names within the layer
+        std::vector<float> data;           ///< Interleaved channel values in row-major order
+        bool fullPrecision;                ///< Never store as half (e.g. for identifiers)
+    };
+
     /**
      * \brief Allocate a new bitmap of the specified size
      *
@@ -42,14 +84,54 @@ public:
     Bitmap(const Vector2i &size = Vector2i(0, 0))
         : Base(size.y(), size.x()) { }
 
-    /// Load an OpenEXR file with the specified filename
+    /**
+     * \brief Load an image file with the specified filename
+     *
+     * OpenEXR files are read with full precision. Other formats (PNG, JPG,
+     * TGA, BMP, HDR, ...) are read through stb_image, and 8-bit images are
+     * converted from sRGB to linear values.
+     */
     Bitmap(const std::string &filename);
 
-    /// Save the bitmap as an EXR file with the specified filename
-    void save(const std::string &filename);
+    /**
+     * \brief Save the bitmap as an EXR file with the specified filename
+     *
+     * The file is written in strips of rows, and compression runs on
+     * OpenEXR's global thread pool, which is sized to match the number of
+     * render threads.
+     */
+    void save(const std::string &filename, const EXROptions &options = EXROptions());
 
     /// Save the bitmap as a PNG file with the specified filename
     void saveToLDR(const std::string &filename);
+
+    /**
+     * \brief Add a layer with the given channels and return its
+     * zero-initialized values
+     *
+     * Layers are written as additional channels by \ref save() and are
+     * ignored by \ref saveToLDR().
+     */
+    float *addLayer(const std::string &name, const std::vector<std::string> &channels,
+                    bool fullPrecision = false);
+
+    /// Return the additional layers
+    const std::vector<Layer> &getLayers() const { return m_layers; }
+
+    /// Return the layer with the given name, or \c nullptr if there is none
+    const Layer *getLayer(const std::string &name) const {
+        for (const Layer &layer : m_layers) {
+            if (layer.name == name)
+                return &layer;
+        }
+        return nullptr;
+    }
+
+private:
+    /// Load a non-OpenEXR image through stb_image
+    void loadLDR(const std::string &filename);
+
+    std::vector<Layer> m_layers;
 };
 
 NORI_NAMESPACE_END
@@ -25,7 +25,10 @@
 
 #include <nori/color.h>
 #include <nori/vector.h>
+#include <nori/aov.h>
+#include <nori/bbox.h>
 #include <tbb/mutex.h>
+#include <algorithm>
 
 #define NORI_BLOCK_SIZE 32 /* Block size used for parallelization */
 
@@ -44,9 +47,20 @@ NORI_NAMESPACE_BEGIN
  * this region. For that reason, this class also stores information about
  * a small border region around the rectangle, whose size depends on the
  * properties of the reconstruction filter.
+ *
+ * Optionally, the block also accumulates the arbitrary output variables
+ * (AOVs) of an \ref AOVLayout. They are kept in a separate buffer with one
+ * extra channel per pixel counting the samples that landed inside it.
+ *
+ * Blocks that receive other blocks through \ref put(ImageBlock &) keep a
+ * list of the changed regions, so that a preview only has to update those
+ * (see \ref takeDirtyRegions()).
  */
 class ImageBlock : public Eigen::Array<Color4f, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> {
 public:
+    /// Maximum number of pixels a sample may cover along each axis
+    static const int MaxFilterTaps = 32;
+
     /**
      * Create a new image block of the specified maximum size
      * \param size
@@ -91,17 +105,63 @@ public:
     /// Convert a bitmap into an image block
     void fromBitmap(const Bitmap &bitmap);
 
+    /// Configure the AOVs accumulated by this block (clears them)
+    void setAOVLayout(const AOVLayout &layout);
+
+    /// Return the AOVs accumulated by this block
+    const AOVLayout &getAOVLayout() const { return m_aovLayout; }
+
     /// Clear all contents
-    void clear() { setConstant(Color4f()); }
+    void clear() {
+        setConstant(Color4f());
+        std::fill(m_aovs.begin(), m_aovs.end(), 0.f);
+        markDirty();
+    }
+
+    /// Mark the entire block as changed
+    void markDirty() {
+        m_allDirty = true;
+        m_dirtyRegions.clear();
+        m_dirtyArea = 0;
+    }
+
+    /**
+     * \brief Move the regions changed since the last call into \c regions
+     *
+     * Regions are pixel rectangles <tt>[min, max)</tt> relative to the offset
+     * of the block, without the border. They may overlap. The block must be
+     * locked while calling this function.
+     *
+     * \return \c true if the entire block has changed (e.g. it was
+     *     cleared), in which case \c regions is left empty
+     */
+    bool takeDirtyRegions(std::vector<BoundingBox2i> &regions) {
+        bool allDirty = m_allDirty;
+        regions.clear();
+        regions.swap(m_dirtyRegions);
+        m_allDirty = false;
+        m_dirtyArea = 0;
+        return allDirty;
+    }
 
-    /// Record a sample with the given position and radiance value
-    void put(const Point2f &pos, const Color3f &value);
+    /**
+     * \brief Record a sample with the given position and radiance value
+     *
+     * This function is reentrant, i.e. different blocks can receive
+     * samples concurrently.
+     *
+     * \param aovs
+     *     Values of the AOVs packed by \ref AOVLayout::pack(), or \c nullptr
+     *     if the block has no AOVs
+     */
+    void put(const Point2f &pos, const Color3f &value, const float *aovs = nullptr);
 
     /**
      * \brief Merge another image block into this one
      *
      * During the merge operation, this function locks 
-     * the destination block using a mutex.
+     * the destination block using a mutex. The merged region
+     * (including the border of \c b) is marked as changed.
      */
     void put(ImageBlock &b);
 
@@ -119,11 +179,18 @@ protected:
     int m_borderSize = 0;
     float *m_filter = nullptr;
     float m_filterRadius = 0;
-    float *m_weightsX = nullptr;
-    float *m_weightsY = nullptr;
     float m_lookupFactor = 0;
+    bool m_boxFilter = false;  ///< Whether every sample only touches a single pixel
     uint32_t m_blockId; // id given by the block generator
     mutable tbb::mutex m_mutex;
+
+    AOVLayout m_aovLayout;
+    int m_aovStride = 0;       ///< AOV channels per pixel, including the sample count
+    std::vector<float> m_aovs; ///< AOV channels of all pixels (including the border)
+
+    std::vector<BoundingBox2i> m_dirtyRegions; ///< Regions changed by \ref put(ImageBlock &)
+    int64_t m_dirtyArea = 0;   ///< Total area of the dirty regions
+    bool m_allDirty = true;    ///< Whether the entire block has changed
 };
 
 /**
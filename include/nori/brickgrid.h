@@ -0,0 +1,152 @@
+#if !defined(__NORI_BRICKGRID_H)
+#define __NORI_BRICKGRID_H
+
+#include <nori/vector.h>
+#include <half.h>
+#include <functional>
+#include <memory>
+
+NORI_NAMESPACE_BEGIN
+
+class MemoryMappedFile;
+
+/**
+ * \brief Dense voxel grid stored as a flat array of small cubic bricks
+ *
+ * The grid is split into bricks of 8x8x8 voxels. Each brick occupies one
+ * contiguous block of memory, and the bricks themselves are laid out in
+ * Morton (Z-curve) order so that spatially close bricks are also close
+ * in memory. Bricks that only contain zeros are not stored at all and map
+ * to an empty entry of the brick table.
+ *
+ * Voxel values are stored with either full (32 bit) or half (16 bit)
+ * precision. Lookups outside of the grid return zero.
+ *
+ * A grid can be written to disk and later memory-mapped back in, which
+ * avoids rebuilding it (and loading its source data) on every run.
+ */
+class BrickGrid {
+public:
+    enum EPrecision {
+        EFloat32 = 0,
+        EFloat16
+    };
+
+    /// Number of voxels along each side of a brick
+    static const int BRICK_RES = 8;
+    /// Number of voxels per brick
+    static const int BRICK_VOXELS = BRICK_RES * BRICK_RES * BRICK_RES;
+    /// Brick table entry of bricks that only contain zeros
+    static const uint32_t EMPTY_BRICK = 0xFFFFFFFFu;
+
+    /**
+     * \brief Callback which fills one brick with voxel values
+     *
+     * The first argument is the voxel coordinate of the brick's first voxel.
+     * The second argument points to \ref BRICK_VOXELS values in x-major order
+     * (x varies fastest) that must be written. The callback is invoked
+     * concurrently from several threads.
+     */
+    typedef std::function<void(const Point3i &, float *)> BrickFunctor;
+
+    BrickGrid();
+    ~BrickGrid();
+
+    /**
+     * \brief Build the grid by querying the voxel values brick by brick
+     *
+     * \param min
+     *     Voxel coordinate of the first voxel of the grid
+     * \param size
+     *     Number of voxels along each axis
+     * \param precision
+     *     Storage precision of the voxel values
+     * \param fill
+     *     Callback providing the voxel values (see \ref BrickFunctor)
+     */
+    void build(const Point3i &min, const Vector3i &size, EPrecision precision, const BrickFunctor &fill);
+
+    /**
+     * \brief Write the grid to a cache file
+     *
+     * \c sourceStamp identifies the data the grid was built from, so that
+     * \ref load() can detect stale cache files.
+     */
+    void save(const std::string &filename, uint64_t sourceStamp) const;
+
+    /**
+     * \brief Memory-map a grid previously written by \ref save()
+     *
+     * \return \c false if the file does not exist, has an incompatible
+     *     version, or was created from different source data
+     */
+    bool load(const std::string &filename, uint64_t sourceStamp);
+
+    /// Return the value of the voxel at the given integer coordinate
+    float lookup(int x, int y, int z) const {
+        uint32_t lx = (uint32_t) (x - m_min.x()),
+                 ly = (uint32_t) (y - m_min.y()),
+                 lz = (uint32_t) (z - m_min.z());
+        if (lx >= (uint32_t) m_size.x() || ly >= (uint32_t) m_size.y() || lz >= (uint32_t) m_size.z())
+            return 0.f;
+
+        uint32_t brick = m_brickTable[(lx / BRICK_RES) + m_brickCount.x() *
+            ((ly / BRICK_RES) + m_brickCount.y() * (lz / BRICK_RES))];
+        if (brick == EMPTY_BRICK)
+            return 0.f;
+
+        size_t index = (size_t) brick * BRICK_VOXELS + (lx % BRICK_RES) +
+            BRICK_RES * ((ly % BRICK_RES) + BRICK_RES * (lz % BRICK_RES));
+
+        if (m_precision == EFloat16)
+            return (float) reinterpret_cast<const half *>(m_data)[index];
+        else
+            return reinterpret_cast<const float *>(m_data)[index];
+    }
+
+    /// Return the largest voxel value
+    float getMaxValue() const { return m_maxValue; }
+
+    /// Return the smallest voxel value
+    float getMinValue() const { return m_minValue; }
+
+    /// Return the voxel coordinate of the first voxel
+    const Point3i &getMin() const { return m_min; }
+
+    /// Return the number of voxels along each axis
+    const Vector3i &getSize() const { return m_size; }
+
+    /// Return the number of stored (non-empty) bricks
+    uint32_t getStoredBrickCount() const { return m_storedBricks; }
+
+    /// Return the amount of memory used by the brick table and voxel data
+    size_t getMemoryUsage() const;
+
+    /// Return a human-readable summary
+    std::string toString() const;
+
+private:
+    BrickGrid(const BrickGrid &) = delete;
+    BrickGrid &operator=(const BrickGrid &) = delete;
+
+    size_t valueSize() const { return m_precision == EFloat16 ? sizeof(half) : sizeof(float); }
+
+    Point3i m_min = Point3i(0);
+    Vector3i m_size = Vector3i(0);
+    Vector3i m_brickCount = Vector3i(0);
+    EPrecision m_precision = EFloat32;
+    uint32_t m_storedBricks = 0;
+    float m_minValue = 0, m_maxValue = 0;
+
+    /* Pointers into either the owned buffers or the memory-mapped cache file */
+    const uint32_t *m_brickTable = nullptr;
+    const uint8_t *m_data = nullptr;
+
+    std::vector<uint32_t> m_ownedTable;
+    std::vector<uint8_t> m_ownedData;
+    std::unique_ptr<MemoryMappedFile> m_file;
+};
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_BRICKGRID_H */
@@ -42,12 +42,12 @@ struct BSDFQueryRecord {
 
     /// Create a new record for sampling the BSDF
     BSDFQueryRecord(const Vector3f &wi)
-        : wi(wi), measure(EUnknownMeasure) { }
+        : wi(wi), measure(EUnknownMeasure), dUVdx(0.f), dUVdy(0.f) { }
 
     /// Create a new record for querying the BSDF
     BSDFQueryRecord(const Vector3f &wi,
             const Vector3f &wo, EMeasure measure)
-        : wi(wi), wo(wo), measure(measure) { }
+        : wi(wi), wo(wo), measure(measure), dUVdx(0.f), dUVdy(0.f) { }
 
 
     /// Additional information possibly needed by the BSDF
@@ -55,6 +55,8 @@ struct BSDFQueryRecord {
     Point2f uv;
     /// Point associated with the point
     Point3f p;
+    /// Change of the UV coordinates between neighboring pixels (for texture filtering)
+    Vector2f dUVdx, dUVdy;
 };
 
 /**
@@ -118,6 +120,23 @@ public:
      * or not to store photons on a surface
      */
     virtual bool isDiffuse() const { return false; }
+
+    /**
+     * \brief Return whether the BSDF only scatters into discrete directions
+     * (e.g. a mirror), i.e. \ref eval() and \ref pdf() are always zero.
+     * Path guiding skips such surfaces.
+     */
+    virtual bool isDelta() const { return false; }
+
+    /**
+     * \brief Return the albedo at the queried surface point, i.e. the
+     * fraction of light that is reflected or transmitted overall
+     *
+     * Only \c bRec.uv and the UV derivatives are used. This is what the
+     * albedo AOV records, so it should be a cheap approximation rather than
+     * an integral over the BSDF. The default reports a white surface.
+     */
+    virtual Color3f albedo(const BSDFQueryRecord &bRec) const { return Color3f(1.f); }
 };
 
 NORI_NAMESPACE_END
@@ -20,6 +20,7 @@
 #define __NORI_BVH_H
 
 #include <nori/shape.h>
+#include <nori/raypacket.h>
 
 NORI_NAMESPACE_BEGIN
 
@@ -80,6 +81,27 @@ public:
     bool rayIntersect(const Ray3f &ray, Intersection &its, 
         bool shadowRay = false) const;
 
+    /**
+     * \brief Intersect a packet of rays against all shapes registered
+     * with the BVH
+     *
+     * The packet is traversed as a whole: a node is visited when at least
+     * one active lane hits its bounding box, and the children of inner
+     * nodes are visited front to back with respect to the packet direction.
+     * Inactive lanes are ignored.
+     *
+     * \param its
+     *     Receives the intersection record of every lane that hit something.
+     *     Not accessed (and may be \c nullptr) when <tt>shadowRay</tt> is set.
+     * \param hit
+     *     Receives whether each lane found an intersection (or, for
+     *     shadow rays, whether it is occluded)
+     *
+     * Instantiated for packets of 4, 8 and 16 rays.
+     */
+    template <int N> void rayIntersect(const TRayPacket<N> &rays, Intersection *its,
+        bool *hit, bool shadowRay = false) const;
+
     /// Return the total number of shapes registered with the BVH
     uint32_t getShapeCount() const { return (uint32_t) m_shapes.size(); }
 
@@ -97,6 +119,19 @@ public:
         return m_bbox;
     }
 
+    /// Return the SAH cost of the tree (zero before \ref build())
+    float getSAHCost() const {
+        return m_nodes.empty() ? 0.f : statistics().first;
+    }
+
+    /// Return the number of tree nodes
+    uint32_t getNodeCount() const { return (uint32_t) m_nodes.size(); }
+
+    /// Return the memory used by the nodes and the primitive index list in bytes
+    size_t getMemoryUsage() const {
+        return sizeof(BVHNode) * m_nodes.size() + sizeof(uint32_t) * m_indices.size();
+    }
+
 protected:
     /**
      * \brief Compute the shape and primitive indices corresponding to
@@ -121,6 +121,7 @@ typedef TRay<Point3f, Vector3f> Ray3f;
 class BSDF;
 class Bitmap;
 class BlockGenerator;
+class Denoiser;
 class Camera;
 class ImageBlock;
 class Integrator;
@@ -134,6 +135,7 @@ class NoriScreen;
 class PhaseFunction;
 class ReconstructionFilter;
 class Sampler;
+class SampleBuffer;
 class Scene;
 
 /// Import cout, cerr, endl for debugging purposes
@@ -193,6 +195,12 @@ extern std::string timeString(double time, bool precise = false);
 /// Convert a memory amount in bytes into a human-readable string
 extern std::string memString(size_t size, bool precise = false);
 
+/// Identify the contents of a file by its size and modification time (0 if it does not exist)
+extern uint64_t fileStamp(const std::string &filename);
+
+/// Quote a string as a JSON string literal (escaping quotes, backslashes and control characters)
+extern std::string jsonString(const std::string &value);
+
 /// Measures associated with probability distributions
 enum EMeasure {
     EUnknownMeasure = 0,
@@ -0,0 +1,56 @@
+#if !defined(__NORI_DENOISER_H)
+#define __NORI_DENOISER_H
+
+#include <nori/common.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Edge-avoiding à-trous wavelet denoiser
+ *
+ * Repeatedly applies a 5x5 B3-spline kernel with holes (the tap distance
+ * doubles with every iteration), where each tap is additionally weighted by
+ * the similarity of the color and of the albedo, normal and depth features
+ * of the two pixels ("Edge-Avoiding À-Trous Wavelet Transform for fast
+ * Global Illumination Filtering", Dammertz et al. 2010). As in SVGF, color
+ * differences are measured relative to the standard deviation of the
+ * luminance around the pixel, which is re-estimated before every pass.
+ *
+ * The features are read from the "albedo", "normal" and "depth" layers of
+ * the bitmap (see \ref AOVLayout); missing ones are simply not used. With
+ * an albedo layer, the color is divided by the albedo before filtering and
+ * multiplied back afterwards, so that texture detail is not blurred.
+ */
+class Denoiser {
+public:
+    /**
+     * \param iterations
+     *     Number of filter passes (the footprint is 4 * 2^iterations pixels wide)
+     * \param sigmaColor
+     *     Tolerated color difference in multiples of the local standard deviation
+     * \param sigmaNormal
+     *     Tolerated distance between unit normals
+     * \param sigmaDepth
+     *     Tolerated relative depth difference per pixel of tap distance
+     * \param sigmaAlbedo
+     *     Tolerated albedo difference
+     */
+    Denoiser(int iterations, float sigmaColor, float sigmaNormal, float sigmaDepth, float sigmaAlbedo);
+
+    /// Return a denoised copy of the RGB values of a bitmap (without layers)
+    Bitmap *denoise(const Bitmap &bitmap) const;
+
+    /// Return a human-readable summary
+    std::string toString() const;
+
+private:
+    int m_iterations;
+    float m_sigmaColor;
+    float m_sigmaNormal;
+    float m_sigmaDepth;
+    float m_sigmaAlbedo;
+};
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_DENOISER_H */
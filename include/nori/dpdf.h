@@ -108,6 +108,25 @@ public:
         return m_sum;
     }
 
+    /// Return the cumulative distribution (starting with a zero entry)
+    const std::vector<float> &getCDF() const {
+        return m_cdf;
+    }
+
+    /**
+     * \brief Replace the contents by a normalized cumulative distribution,
+     * e.g. one previously returned by \ref getCDF()
+     *
+     * \param sum
+     *     Original sum of the entries (see \ref getSum())
+     */
+    void setNormalizedCDF(const std::vector<float> &cdf, float sum) {
+        m_cdf = cdf;
+        m_sum = sum;
+        m_normalization = sum > 0 ? 1.0f / sum : 0.0f;
+        m_normalized = sum > 0;
+    }
+
     /**
      * \brief %Transform a uniformly distributed sample to the stored distribution
      * 
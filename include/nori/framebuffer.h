@@ -0,0 +1,94 @@
+#if !defined(__NORI_FRAMEBUFFER_H)
+#define __NORI_FRAMEBUFFER_H
+
+#include <nori/vector.h>
+#include <atomic>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Memory-mapped file through which a render publishes its progress
+ *
+ * After every pass, the accumulated image is copied into the file, so that
+ * external tools can watch a render without the GUI and without any locking
+ * in the renderer. The file consists of a \ref Header followed by two frame
+ * slots, each a \ref FrameHeader followed by the normalized RGB pixels as
+ * row-major 32-bit floats.
+ *
+ * Frames are double-buffered: frame \c n is written to slot <tt>n % 2</tt>,
+ * so the latest complete frame is never overwritten while the next one is
+ * being written. The header sequence number is odd while a frame is being
+ * written and even otherwise; <tt>sequence / 2</tt> is the number of the
+ * latest complete frame. A reader loads the sequence number, copies that
+ * frame and then checks that the sequence number has not reached
+ * <tt>2 * frame + 3</tt> (i.e. the slot has not been reused meanwhile), see
+ * \ref read(). <tt>nori --watch &lt;file&gt;</tt> uses it to write every
+ * new frame to an image.
+ */
+class LiveFramebuffer {
+public:
+    /// Start of the file
+    struct Header {
+        char magic[8];                  ///< "NORI_FB" (null-terminated)
+        uint32_t version;               ///< File format version (1)
+        uint32_t width, height;         ///< Image size in pixels
+        uint32_t totalPasses;           ///< Number of passes of the render
+        std::atomic<uint64_t> sequence; ///< Seqlock counter, see above
+    };
+
+    /// Start of a frame slot
+    struct FrameHeader {
+        uint64_t frame;  ///< Number of the frame stored in the slot
+        uint32_t passes; ///< Number of passes accumulated in the frame
+        uint32_t reserved;
+    };
+
+    /// Create (or truncate) the file and map it into memory (throws a \ref NoriException on failure)
+    LiveFramebuffer(const std::string &filename, const Vector2i &size, uint32_t totalPasses);
+
+    /// Unmap the file (which is kept on disk and contains the last frame)
+    ~LiveFramebuffer();
+
+    /**
+     * \brief Publish the contents of an image block as the next frame
+     *
+     * Must not be called concurrently with \ref ImageBlock::put() on the
+     * same block (e.g. between two passes of the render).
+     */
+    void publish(const ImageBlock &block, uint32_t passes);
+
+    /**
+     * \brief Read the latest complete frame of a file written by another process
+     *
+     * \return \c false if no frame has been published yet, or if the frame
+     *     kept being overwritten while it was copied
+     */
+    static bool read(const std::string &filename, Bitmap &bitmap, uint32_t &passes, uint32_t &totalPasses);
+
+    /// Return the name of the file
+    const std::string &getFilename() const { return m_filename; }
+
+private:
+    LiveFramebuffer(const LiveFramebuffer &) = delete;
+    LiveFramebuffer &operator=(const LiveFramebuffer &) = delete;
+
+    /// Write the file header
+    void init(uint32_t totalPasses);
+
+    /// Return the offset of a frame slot in a file of the given image size
+    static size_t slotOffset(const Vector2i &size, int slot);
+
+    std::string m_filename;
+    Vector2i m_size;
+    uint8_t *m_data = nullptr;
+    size_t m_fileSize = 0;
+    uint64_t m_frame = 0;
+#if defined(PLATFORM_WINDOWS)
+    void *m_file = nullptr;
+    void *m_mapping = nullptr;
+#endif
+};
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_FRAMEBUFFER_H */
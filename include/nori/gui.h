@@ -44,6 +44,9 @@ private:
     nanogui::Slider *m_slider = nullptr;
     nanogui::ProgressBar *m_progressBar = nullptr;
     uint32_t m_texture = 0;
+    Vector2i m_textureSize = Vector2i(0, 0);
+    std::vector<BoundingBox2i> m_dirtyRegions; ///< Regions of the image to upload
+    std::vector<float> m_uploadBuffer;        ///< Pixels of the regions, copied out of the block
     float m_scale = 1.f;
     Widget *panel = nullptr;
 
@@ -20,6 +20,7 @@
 #define __NORI_INTEGRATOR_H
 
 #include <nori/object.h>
+#include <nori/aov.h>
 
 NORI_NAMESPACE_BEGIN
 
@@ -40,6 +41,18 @@ public:
     /// Perform an (optional) preprocess step
     virtual void preprocess(const Scene *scene) { }
 
+    /**
+     * \brief Called after every pass of the render (one sample per pixel),
+     * while no thread renders
+     *
+     * Lets integrators that learn from their own samples (e.g. path guiding)
+     * update their data structures between passes.
+     *
+     * \param pass
+     *    Index of the pass that has just finished, starting at 0
+     */
+    virtual void endPass(const Scene *scene, uint32_t pass) { }
+
     /**
      * \brief Sample the incident radiance along a ray
      *
@@ -54,6 +67,54 @@ public:
      */
     virtual Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray) const = 0;
 
+    /**
+     * \brief Sample the incident radiance along a camera ray and record
+     * its arbitrary output variables
+     *
+     * Only called when the scene requests AOVs. The default implementation
+     * calls \ref Li() and fills the AOVs through \ref estimateAOVs().
+     * Integrators that can tell which lobe their paths leave the first
+     * surface through should override this.
+     */
+    virtual Color3f LiAOV(const Scene *scene, Sampler *sampler, const Ray3f &ray, AOVRecord &aovs) const;
+
+    /**
+     * \brief Fill the AOVs of a camera ray after the fact
+     *
+     * Traces the ray once more to record the first surface. The emission
+     * of a directly visible emitter is split off from the radiance estimate
+     * \c Li, and the remainder is counted as diffuse.
+     */
+    static void estimateAOVs(const Scene *scene, const Ray3f &ray, const Color3f &Li, AOVRecord &aovs);
+
+    /**
+     * \brief Whether the integrator prefers to receive all camera rays of
+     * an image block at once through \ref LiBatch()
+     */
+    virtual bool isBatched() const { return false; }
+
+    /**
+     * \brief Sample the incident radiance along a batch of rays
+     *
+     * Only called for integrators that return \c true from
+     * \ref isBatched(). The default implementation evaluates \ref Li()
+     * for one ray after the other.
+     *
+     * \param scene
+     *    A pointer to the underlying scene
+     * \param sampler
+     *    A pointer to a sample generator
+     * \param rays
+     *    Array of \c count rays
+     * \param Li
+     *    Receives the radiance estimate of each ray
+     */
+    virtual void LiBatch(const Scene *scene, Sampler *sampler, const Ray3f *rays,
+                         Color3f *Li, size_t count) const {
+        for (size_t i = 0; i < count; ++i)
+            Li[i] = this->Li(scene, sampler, rays[i]);
+    }
+
     /**
      * \brief Return the type of object (i.e. Mesh/BSDF/etc.) 
      * provided by this instance
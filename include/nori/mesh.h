@@ -115,6 +115,18 @@ protected:
     /// Create an empty mesh
     Mesh();
 
+    /**
+     * \brief Assign the mesh a key in the active scene snapshot (if any) and
+     * load its geometry from there
+     *
+     * \return \c true if the geometry was loaded, in which case the
+     *     subclass can skip creating it
+     */
+    bool loadFromSnapshot(const std::string &kind);
+
+    /// Record the geometry in the active scene snapshot, if it is being written
+    void saveToSnapshot() const;
+
 protected:
     std::string m_name;                  ///< Identifying name
     MatrixXf      m_V;                   ///< Vertex positions
@@ -123,6 +135,7 @@ protected:
     MatrixXu      m_F;                   ///< Faces
 
     DiscretePDF m_pdf;
+    std::string m_snapshotKey;           ///< Key in the active scene snapshot
 };
 
 NORI_NAMESPACE_END
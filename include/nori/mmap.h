@@ -0,0 +1,47 @@
+#if !defined(__NORI_MMAP_H)
+#define __NORI_MMAP_H
+
+#include <nori/common.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Read-only memory mapping of a file
+ *
+ * The file contents are paged in lazily by the operating system, which
+ * makes this a cheap way of accessing large precomputed data (e.g. cached
+ * volume grids) without first copying them into heap memory.
+ */
+class MemoryMappedFile {
+public:
+    /// Map the specified file into memory (throws a \ref NoriException on failure)
+    explicit MemoryMappedFile(const std::string &filename);
+
+    /// Unmap the file
+    ~MemoryMappedFile();
+
+    /// Return a pointer to the start of the mapped region
+    const uint8_t *data() const { return m_data; }
+
+    /// Return the size of the mapped region in bytes
+    size_t size() const { return m_size; }
+
+    /// Return the name of the mapped file
+    const std::string &getFilename() const { return m_filename; }
+
+private:
+    MemoryMappedFile(const MemoryMappedFile &) = delete;
+    MemoryMappedFile &operator=(const MemoryMappedFile &) = delete;
+
+    std::string m_filename;
+    const uint8_t *m_data = nullptr;
+    size_t m_size = 0;
+#if defined(PLATFORM_WINDOWS)
+    void *m_file = nullptr;
+    void *m_mapping = nullptr;
+#endif
+};
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_MMAP_H */
@@ -162,6 +162,15 @@ public:
         return (*m_constructors)[name](propList);
     }
 
+    /// Return the names of all registered classes in alphabetical order
+    static std::vector<std::string> getRegisteredClasses() {
+        std::vector<std::string> names;
+        if (m_constructors)
+            for (const auto &v : *m_constructors)
+                names.push_back(v.first);
+        return names;
+    }
+
     static void printRegisteredClasses() {
         if(m_constructors)
             for(auto v : *m_constructors)
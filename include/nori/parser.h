@@ -29,6 +29,12 @@ NORI_NAMESPACE_BEGIN
  */
 extern NoriObject *loadFromXML(const std::string &filename);
 
+/**
+ * \brief Load a scene from an XML document in memory and return its
+ * root object (\c filename is only used in error messages)
+ */
+extern NoriObject *loadFromXMLString(const std::string &xml, const std::string &filename);
+
 NORI_NAMESPACE_END
 
 #endif /* __NORI_PARSER_H */
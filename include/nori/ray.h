@@ -46,30 +46,61 @@ template <typename _PointType, typename _VectorType> struct TRay {
     Scalar mint;     ///< Minimum position on the ray segment
     Scalar maxt;     ///< Maximum position on the ray segment
 
+    /**
+     * \brief Ray differentials: auxiliary rays offset by one pixel
+     * in x and y (only valid when \c hasDifferentials is set)
+     */
+    bool hasDifferentials;
+    PointType rxOrigin, ryOrigin;
+    VectorType rxDirection, ryDirection;
+
     /// Construct a new ray
     TRay() : mint(Epsilon), 
-        maxt(std::numeric_limits<Scalar>::infinity()) { }
+        maxt(std::numeric_limits<Scalar>::infinity()), hasDifferentials(false) { }
     
     /// Construct a new ray
     TRay(const PointType &o, const VectorType &d) : o(o), d(d), 
-            mint(Epsilon), maxt(std::numeric_limits<Scalar>::infinity()) {
+            mint(Epsilon), maxt(std::numeric_limits<Scalar>::infinity()), hasDifferentials(false) {
         update();
     }
 
     /// Construct a new ray
     TRay(const PointType &o, const VectorType &d, 
-        Scalar mint, Scalar maxt) : o(o), d(d), mint(mint), maxt(maxt) {
+        Scalar mint, Scalar maxt) : o(o), d(d), mint(mint), maxt(maxt), hasDifferentials(false) {
         update();
     }
 
     /// Copy constructor
     TRay(const TRay &ray) 
      : o(ray.o), d(ray.d), dRcp(ray.dRcp),
-       mint(ray.mint), maxt(ray.maxt) { }
+       mint(ray.mint), maxt(ray.maxt), hasDifferentials(ray.hasDifferentials),
+       rxOrigin(ray.rxOrigin), ryOrigin(ray.ryOrigin),
+       rxDirection(ray.rxDirection), ryDirection(ray.ryDirection) { }
 
     /// Copy a ray, but change the covered segment of the copy
     TRay(const TRay &ray, Scalar mint, Scalar maxt) 
-     : o(ray.o), d(ray.d), dRcp(ray.dRcp), mint(mint), maxt(maxt) { }
+     : o(ray.o), d(ray.d), dRcp(ray.dRcp), mint(mint), maxt(maxt),
+       hasDifferentials(ray.hasDifferentials),
+       rxOrigin(ray.rxOrigin), ryOrigin(ray.ryOrigin),
+       rxDirection(ray.rxDirection), ryDirection(ray.ryDirection) { }
+
+    /// Assignment operator
+    TRay &operator=(const TRay &ray) = default;
+
+    /**
+     * \brief Scale the offsets of the differentials
+     *
+     * Used when several samples are taken per pixel: the footprint of one
+     * sample then only covers a fraction of the pixel.
+     */
+    void scaleDifferentials(Scalar amount) {
+        if (!hasDifferentials)
+            return;
+        rxOrigin = o + (rxOrigin - o) * amount;
+        ryOrigin = o + (ryOrigin - o) * amount;
+        rxDirection = d + (rxDirection - d) * amount;
+        ryDirection = d + (ryDirection - d) * amount;
+    }
 
     /// Update the reciprocal ray directions after changing 'd'
     void update() {
@@ -84,6 +115,7 @@ template <typename _PointType, typename _VectorType> struct TRay {
         TRay result;
         result.o = o; result.d = -d; result.dRcp = -dRcp;
         result.mint = mint; result.maxt = maxt;
+        result.hasDifferentials = false;
         return result;
     }
 
@@ -0,0 +1,151 @@
+#if !defined(__NORI_RAYPACKET_H)
+#define __NORI_RAYPACKET_H
+
+#include <nori/ray.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Fixed-size packet of rays stored in structure-of-arrays layout
+ *
+ * Every component is stored in its own array so that a test of the whole
+ * packet against a bounding box touches contiguous memory and can be
+ * vectorized by the compiler. Lanes that are not \ref active are ignored
+ * by the traversal routines.
+ */
+template <int N> struct TRayPacket {
+    static const int Size = N;
+
+    float ox[N], oy[N], oz[N];       ///< Ray origins
+    float dx[N], dy[N], dz[N];       ///< Ray directions
+    float rdx[N], rdy[N], rdz[N];    ///< Componentwise reciprocals of the directions
+    float mint[N], maxt[N];          ///< Covered ray segments
+    bool active[N];                  ///< Whether the lane holds a valid ray
+
+    /// Create a packet where all lanes are inactive
+    TRayPacket() {
+        for (int i = 0; i < N; ++i)
+            active[i] = false;
+    }
+
+    /// Store a ray in the given lane and mark the lane as active
+    void set(int lane, const Ray3f &ray) {
+        ox[lane] = ray.o.x(); oy[lane] = ray.o.y(); oz[lane] = ray.o.z();
+        dx[lane] = ray.d.x(); dy[lane] = ray.d.y(); dz[lane] = ray.d.z();
+        rdx[lane] = ray.dRcp.x(); rdy[lane] = ray.dRcp.y(); rdz[lane] = ray.dRcp.z();
+        mint[lane] = ray.mint;
+        maxt[lane] = ray.maxt;
+        active[lane] = true;
+    }
+
+    /// Reconstruct the ray stored in the given lane
+    Ray3f get(int lane) const {
+        Ray3f ray;
+        ray.o = Point3f(ox[lane], oy[lane], oz[lane]);
+        ray.d = Vector3f(dx[lane], dy[lane], dz[lane]);
+        ray.dRcp = Vector3f(rdx[lane], rdy[lane], rdz[lane]);
+        ray.mint = mint[lane];
+        ray.maxt = maxt[lane];
+        return ray;
+    }
+
+    /// Return the number of active lanes
+    int activeCount() const {
+        int count = 0;
+        for (int i = 0; i < N; ++i)
+            count += active[i] ? 1 : 0;
+        return count;
+    }
+};
+
+typedef TRayPacket<4>  RayPacket4;
+typedef TRayPacket<8>  RayPacket8;
+typedef TRayPacket<16> RayPacket16;
+
+/**
+ * \brief Variable-size array of rays stored in structure-of-arrays layout
+ *
+ * Streams are traced in chunks of \ref RayStream::PacketSize rays, so rays
+ * that are adjacent in the stream should be spatially coherent (e.g. the
+ * camera rays of neighboring pixels) to get the most out of the traversal.
+ */
+class RayStream {
+public:
+    /// Number of rays traced together as one packet
+    static const int PacketSize = 16;
+    typedef TRayPacket<PacketSize> Packet;
+
+    /// Create an empty stream
+    RayStream() { }
+
+    /// Create a stream holding \c size rays
+    explicit RayStream(size_t size) { resize(size); }
+
+    /// Change the number of rays
+    void resize(size_t size) {
+        for (int i = 0; i < 3; ++i) {
+            m_o[i].resize(size);
+            m_d[i].resize(size);
+            m_dRcp[i].resize(size);
+        }
+        m_mint.resize(size);
+        m_maxt.resize(size);
+    }
+
+    /// Return the number of rays
+    size_t size() const { return m_mint.size(); }
+
+    /// Store a ray at the given index
+    void set(size_t index, const Ray3f &ray) {
+        for (int i = 0; i < 3; ++i) {
+            m_o[i][index] = ray.o[i];
+            m_d[i][index] = ray.d[i];
+            m_dRcp[i][index] = ray.dRcp[i];
+        }
+        m_mint[index] = ray.mint;
+        m_maxt[index] = ray.maxt;
+    }
+
+    /// Reconstruct the ray at the given index
+    Ray3f get(size_t index) const {
+        Ray3f ray;
+        for (int i = 0; i < 3; ++i) {
+            ray.o[i] = m_o[i][index];
+            ray.d[i] = m_d[i][index];
+            ray.dRcp[i] = m_dRcp[i][index];
+        }
+        ray.mint = m_mint[index];
+        ray.maxt = m_maxt[index];
+        return ray;
+    }
+
+    /**
+     * \brief Copy the rays <tt>[offset, offset + PacketSize)</tt> into a packet
+     *
+     * Lanes past the end of the stream are marked as inactive.
+     * \return The number of rays that were copied
+     */
+    int gather(size_t offset, Packet &packet) const {
+        int count = (int) std::min((size_t) PacketSize, size() - offset);
+        for (int lane = 0; lane < count; ++lane) {
+            size_t index = offset + lane;
+            packet.ox[lane] = m_o[0][index]; packet.oy[lane] = m_o[1][index]; packet.oz[lane] = m_o[2][index];
+            packet.dx[lane] = m_d[0][index]; packet.dy[lane] = m_d[1][index]; packet.dz[lane] = m_d[2][index];
+            packet.rdx[lane] = m_dRcp[0][index]; packet.rdy[lane] = m_dRcp[1][index]; packet.rdz[lane] = m_dRcp[2][index];
+            packet.mint[lane] = m_mint[index];
+            packet.maxt[lane] = m_maxt[index];
+            packet.active[lane] = true;
+        }
+        for (int lane = count; lane < PacketSize; ++lane)
+            packet.active[lane] = false;
+        return count;
+    }
+
+private:
+    std::vector<float> m_o[3], m_d[3], m_dRcp[3];
+    std::vector<float> m_mint, m_maxt;
+};
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_RAYPACKET_H */
@@ -0,0 +1,67 @@
+#if !defined(__NORI_SAMPLEBUFFER_H)
+#define __NORI_SAMPLEBUFFER_H
+
+#include <nori/color.h>
+#include <nori/vector.h>
+#include <iosfwd>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Raw image samples of one block, stored for deferred reconstruction
+ *
+ * Instead of splatting every sample through the reconstruction filter as
+ * soon as it is computed, the render loop can record the sample positions
+ * and values here and reconstruct the whole block at once afterwards. The
+ * integrator then never waits for the filter, whatever its radius, and the
+ * splatting runs as one tight loop over a block that stays in cache.
+ *
+ * The samples can also be appended to a sample file, from which the image
+ * can be reconstructed again with a different filter (see \ref refilter()).
+ */
+class SampleBuffer {
+public:
+    /// Create an empty buffer for samples carrying \c aovChannels AOV values
+    explicit SampleBuffer(int aovChannels = 0) : m_aovChannels(aovChannels) { }
+
+    /// Remove all samples
+    void clear();
+
+    /// Return the number of samples
+    size_t size() const { return m_x.size(); }
+
+    /// Record a sample with the given position (in image coordinates) and value
+    void put(const Point2f &pos, const Color3f &value, const float *aovs = nullptr) {
+        m_x.push_back(pos.x()); m_y.push_back(pos.y());
+        m_r.push_back(value.r()); m_g.push_back(value.g()); m_b.push_back(value.b());
+        if (m_aovChannels > 0)
+            m_aovs.insert(m_aovs.end(), aovs, aovs + m_aovChannels);
+    }
+
+    /// Splat all samples into an image block (through its reconstruction filter)
+    void reconstruct(ImageBlock &block) const;
+
+    /// Write the header of a sample file for an image of the given size
+    static void writeHeader(std::ostream &os, const Vector2i &size);
+
+    /// Append the positions and values (without AOVs) of the samples to a sample file
+    void write(std::ostream &os) const;
+
+    /**
+     * \brief Reconstruct the image stored in a sample file
+     *
+     * The file is read in chunks, so that its size is not limited by the
+     * available memory.
+     */
+    static Bitmap *refilter(const std::string &filename, const ReconstructionFilter *filter);
+
+private:
+    int m_aovChannels;
+    std::vector<float> m_x, m_y;      ///< Sample positions
+    std::vector<float> m_r, m_g, m_b; ///< Sample values
+    std::vector<float> m_aovs;        ///< Interleaved AOV values of all samples
+};
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_SAMPLEBUFFER_H */
@@ -78,6 +78,13 @@ public:
      */
     virtual void prepare(const ImageBlock &block) = 0;
 
+    /**
+     * \brief Deterministically initialize the sampler for one of many
+     * independent streams of samples that are not tied to an image block
+     * (used e.g. by the statistical tests)
+     */
+    virtual void seed(uint64_t seed, uint64_t stream) = 0;
+
     /**
      * \brief Prepare to generate new samples
      * 
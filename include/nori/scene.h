@@ -24,6 +24,8 @@
 #include <nori/bvh.h>
 #include <nori/emitter.h>
 #include <nori/medium.h>
+#include <nori/bitmap.h>
+#include <nori/aov.h>
 #include <limits>
 
 NORI_NAMESPACE_BEGIN
@@ -67,6 +69,39 @@ public:
     /// Return a reference to an array containing all lights
     const std::vector<Emitter *> &getLights() const { return m_emitters; }
 
+    /// Return a reference to an array containing all participating media
+    const std::vector<Medium *> &getMedia() const { return m_media; }
+
+    /// Return the options for writing the rendered OpenEXR image
+    const EXROptions &getEXROptions() const { return m_exrOptions; }
+
+    /// Return the denoiser applied to the rendered image (\c nullptr if disabled)
+    const Denoiser *getDenoiser() const { return m_denoiser; }
+
+    /**
+     * \brief Return whether samples are first stored per block and
+     * reconstructed into the image in a separate pass (see \ref SampleBuffer)
+     */
+    bool getDeferredReconstruction() const { return m_deferredReconstruction; }
+
+    /// Return whether all samples are written to a "<scene>.samples" file for re-filtering
+    bool getSaveSamples() const { return m_saveSamples; }
+
+    /**
+     * \brief Return whether the time and the number of rays spent on every
+     * pixel are written as a "cost" layer of the OpenEXR image
+     */
+    bool getCostHeatmap() const { return m_costHeatmap; }
+
+    /**
+     * \brief Return whether the image is published after every pass to a
+     * "<scene>.framebuffer" file for external viewers (see \ref LiveFramebuffer)
+     */
+    bool getLiveFramebuffer() const { return m_liveFramebuffer; }
+
+    /// Return the arbitrary output variables to render alongside the image
+    const AOVLayout &getAOVLayout() const { return m_aovLayout; }
+
     /// Return a random emitter
     const Emitter * getRandomEmitter(float rnd) const {
         auto const & n = m_emitters.size();
@@ -130,6 +165,57 @@ public:
         return m_bvh->rayIntersect(ray, its, true);
     }
 
+    /**
+     * \brief Intersect a packet of 4 rays against all triangles stored in
+     * the scene and return detailed intersection information
+     *
+     * \c hit[i] receives whether lane \c i found an intersection, in which
+     * case \c its[i] holds the details. Inactive lanes report no hit.
+     * Coherent packets (e.g. camera rays of neighboring pixels) traverse
+     * the BVH considerably faster than the same rays traced one by one.
+     */
+    void rayIntersect4(const RayPacket4 &rays, Intersection *its, bool *hit) const {
+        m_bvh->rayIntersect(rays, its, hit, false);
+    }
+
+    /// Occlusion-only variant of \ref rayIntersect4()
+    void rayIntersect4(const RayPacket4 &rays, bool *occluded) const {
+        m_bvh->rayIntersect(rays, nullptr, occluded, true);
+    }
+
+    /// Intersect a packet of 8 rays (see \ref rayIntersect4())
+    void rayIntersect8(const RayPacket8 &rays, Intersection *its, bool *hit) const {
+        m_bvh->rayIntersect(rays, its, hit, false);
+    }
+
+    /// Occlusion-only variant of \ref rayIntersect8()
+    void rayIntersect8(const RayPacket8 &rays, bool *occluded) const {
+        m_bvh->rayIntersect(rays, nullptr, occluded, true);
+    }
+
+    /// Intersect a packet of 16 rays (see \ref rayIntersect4())
+    void rayIntersect16(const RayPacket16 &rays, Intersection *its, bool *hit) const {
+        m_bvh->rayIntersect(rays, its, hit, false);
+    }
+
+    /// Occlusion-only variant of \ref rayIntersect16()
+    void rayIntersect16(const RayPacket16 &rays, bool *occluded) const {
+        m_bvh->rayIntersect(rays, nullptr, occluded, true);
+    }
+
+    /**
+     * \brief Intersect a stream of rays against all triangles stored in
+     * the scene
+     *
+     * The stream is traced in packets of \ref RayStream::PacketSize
+     * consecutive rays. \c its and \c hit must provide space for
+     * <tt>rays.size()</tt> entries.
+     */
+    void rayIntersect(const RayStream &rays, Intersection *its, bool *hit) const;
+
+    /// Occlusion-only variant of the stream query
+    void rayIntersect(const RayStream &rays, bool *occluded) const;
+
     /**
      * \brief Return an axis-aligned box that bounds the scene
      */
@@ -161,6 +247,13 @@ private:
 
     std::vector<Emitter *> m_emitters;
     std::vector<Medium *> m_media;
+    EXROptions m_exrOptions;
+    AOVLayout m_aovLayout;
+    Denoiser *m_denoiser = nullptr;
+    bool m_deferredReconstruction = false;
+    bool m_saveSamples = false;
+    bool m_costHeatmap = false;
+    bool m_liveFramebuffer = false;
 };
 
 NORI_NAMESPACE_END
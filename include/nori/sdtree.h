@@ -0,0 +1,166 @@
+#if !defined(__NORI_SDTREE_H)
+#define __NORI_SDTREE_H
+
+#include <nori/bbox.h>
+#include <atomic>
+#include <memory>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Directional quadtree of the incident radiance at a region of space
+ *
+ * Directions are mapped to the unit square with the equal-area cylindrical
+ * mapping <tt>((cos(theta) + 1) / 2, phi / (2 pi))</tt>. Every node splits
+ * its square into four quadrants and stores the radiance recorded in each
+ * of them. \ref record() may be called concurrently from several threads
+ * (the sums are updated atomically), while the structure of the tree only
+ * changes in \ref rebuild().
+ */
+class DTree {
+public:
+    /// Create a tree with a single node
+    DTree();
+
+    DTree(const DTree &tree);
+    DTree &operator=(const DTree &tree);
+
+    /**
+     * \brief Record a radiance sample arriving from a (world space) direction
+     *
+     * \param radiance
+     *     Radiance divided by the density of the direction, i.e. an
+     *     estimate of the radiance integrated over all directions
+     */
+    void record(const Vector3f &dir, float radiance);
+
+    /// Sample a direction proportional to the recorded radiance
+    Vector3f sample(const Point2f &sample) const;
+
+    /// Return the solid angle density of \ref sample()
+    float pdf(const Vector3f &dir) const;
+
+    /// Return whether radiance has been recorded, i.e. whether the tree can be sampled
+    bool isValid() const { return getTotal() > 0; }
+
+    /// Return the sum of the recorded radiance
+    float getTotal() const;
+
+    /// Return the number of recorded samples
+    uint32_t getSampleCount() const { return m_samples.load(std::memory_order_relaxed); }
+
+    /// Overwrite the number of recorded samples (e.g. after splitting a spatial region)
+    void setSampleCount(uint32_t samples) { m_samples.store(samples, std::memory_order_relaxed); }
+
+    /// Return the number of nodes
+    size_t getNodeCount() const { return m_nodes.size(); }
+
+    /**
+     * \brief Build an empty tree whose leaves adapt to the radiance recorded
+     * in \c tree
+     *
+     * Quadrants holding more than \c threshold of the total radiance are
+     * subdivided, up to \c maxDepth levels and at most \c maxNodes nodes.
+     */
+    static DTree rebuild(const DTree &tree, float threshold, int maxDepth, size_t maxNodes);
+
+    /// Map a direction to the unit square
+    static Point2f dirToCanonical(const Vector3f &dir);
+
+    /// Map a point of the unit square to a direction
+    static Vector3f canonicalToDir(const Point2f &p);
+
+    /// Size of a node in bytes
+    static size_t getNodeSize() { return sizeof(Node); }
+
+private:
+    struct Node {
+        std::atomic<float> sum[4]; ///< Radiance recorded in each quadrant
+        uint32_t child[4];         ///< Index of the node subdividing each quadrant (0: none)
+
+        Node();
+        Node(const Node &node);
+        Node &operator=(const Node &node);
+
+        float getTotal() const;
+    };
+
+    /// Add the subtree \c node of \c tree (or a uniform one if \c node < 0) to this tree
+    uint32_t rebuild(const DTree &tree, int node, float energy, float threshold, int depth,
+                     int maxDepth, size_t maxNodes);
+
+    std::vector<Node> m_nodes;
+    std::atomic<uint32_t> m_samples;
+};
+
+/**
+ * \brief Spatial-directional tree ("SD-tree") of the incident radiance, as
+ * used for practical path guiding (Müller et al. 2017)
+ *
+ * A binary tree subdivides the (cubic) scene bounds, alternating between the
+ * x, y and z axis. Each of its leaves holds two directional quadtrees: one
+ * that is sampled during a training iteration and one that records the
+ * radiance of the same iteration. \ref refine() ends an iteration: leaves
+ * that received many samples are split, the recorded trees become the new
+ * sampling trees and the recording trees are rebuilt with a resolution
+ * that follows the recorded radiance.
+ *
+ * \ref lookup() and \ref DTree::record() may be called concurrently, while
+ * \ref refine() must only be called while no other thread uses the tree.
+ */
+class SDTree {
+public:
+    struct Region {
+        DTree sampling;  ///< Distribution learned in the previous iterations
+        DTree recording; ///< Radiance recorded in the current iteration
+    };
+
+    /**
+     * \param memoryBudget
+     *     Maximum size of the spatial and directional nodes in bytes
+     *     (refinement stops when it is reached)
+     */
+    SDTree(const BoundingBox3f &bbox, size_t memoryBudget);
+
+    /// Return the region containing a point (points outside of the bounds are clamped)
+    Region *lookup(const Point3f &p) const;
+
+    /**
+     * \brief End a training iteration
+     *
+     * \param iteration
+     *     Index of the iteration that has just finished, starting at 0.
+     *     Iteration \c i is expected to contain <tt>2^i</tt> samples per
+     *     pixel, which scales the number of samples that splits a region.
+     */
+    void refine(int iteration);
+
+    /// Return the number of spatial regions
+    size_t getRegionCount() const { return m_regions.size(); }
+
+    /// Return the memory used by the spatial and directional nodes in bytes
+    size_t getMemoryUsage() const;
+
+    /// Return a human-readable summary
+    std::string toString() const;
+
+private:
+    struct Node {
+        uint32_t child[2]; ///< Index of the two halves (0: leaf)
+        uint32_t region;   ///< Index of the region of a leaf
+        int axis;          ///< Axis that the node splits
+    };
+
+    /// Split a leaf until its halves have fewer than \c threshold samples (within the budget)
+    void split(uint32_t node, uint32_t threshold, size_t &memory);
+
+    BoundingBox3f m_bbox;
+    Vector3f m_invExtents;
+    size_t m_memoryBudget;
+    std::vector<Node> m_nodes;
+    std::vector<std::unique_ptr<Region>> m_regions;
+};
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_SDTREE_H */
@@ -25,6 +25,7 @@
 
 NORI_NAMESPACE_BEGIN
 
+struct BSDFQueryRecord;
 
 /**
  * \brief Intersection data structure
@@ -47,9 +48,44 @@ struct Intersection {
     Frame geoFrame;
     /// Pointer to the associated shape
     const Shape *mesh;
+    /// Index of the primitive that was hit, unique across all shapes of the scene
+    uint32_t primIndex;
+
+    /// Partial derivatives of the position with respect to the UV parameterization
+    Vector3f dpdu, dpdv;
+    /// Partial derivatives of the shading normal with respect to the UV parameterization
+    Vector3f dndu, dndv;
+    /// Change of the position between neighboring pixels (zero without ray differentials)
+    Vector3f dpdx, dpdy;
+    /// Change of the UV coordinates between neighboring pixels (zero without ray differentials)
+    Vector2f dUVdx, dUVdy;
 
     /// Create an uninitialized intersection record
-    Intersection() : mesh(nullptr) { }
+    Intersection() : mesh(nullptr), primIndex(0), dpdx(0.f), dpdy(0.f), dUVdx(0.f), dUVdy(0.f) { }
+
+    /**
+     * \brief Compute \ref dpdx, \ref dpdy, \ref dUVdx and \ref dUVdy
+     * from the differentials of the ray that found this intersection
+     *
+     * Requires \ref dpdu and \ref dpdv; sets all derivatives to zero if the
+     * ray has no differentials.
+     */
+    void computeDifferentials(const Ray3f &ray);
+
+    /**
+     * \brief Create the ray leaving the intersection in the direction
+     * sampled by a BSDF
+     *
+     * For perfectly specular reflection and refraction, the differentials of
+     * the incident ray are carried over to the new ray. Other scattering
+     * events spread the footprint so much that the differentials are dropped.
+     *
+     * \param ray
+     *    The ray that found this intersection
+     * \param bRec
+     *    The BSDF sample (with directions in the local shading frame)
+     */
+    Ray3f spawnRay(const Ray3f &ray, const BSDFQueryRecord &bRec) const;
 
     /// Transform a direction vector into the local shading frame
     Vector3f toLocal(const Vector3f &d) const {
@@ -0,0 +1,134 @@
+#if !defined(__NORI_SNAPSHOT_H)
+#define __NORI_SNAPSHOT_H
+
+#include <nori/object.h>
+#include <cstring>
+#include <map>
+#include <memory>
+
+NORI_NAMESPACE_BEGIN
+
+class MemoryMappedFile;
+
+/**
+ * \brief Binary snapshot of a fully loaded scene
+ *
+ * A snapshot stores the XML description of a scene together with the data
+ * that is expensive to derive from it: mesh geometry, area CDFs, the BVH and
+ * the sampling tables of environment emitters. Loading a snapshot parses the
+ * (small) XML document again, but the objects that normally read OBJ files or
+ * precompute tables copy their data from the memory-mapped snapshot instead.
+ *
+ * The data is stored as named blobs. While a snapshot is active (see \ref
+ * Scope), objects request a key with \ref nextKey() in creation order, which
+ * is the same when the embedded XML is parsed again. When a blob is missing
+ * (e.g. for objects added in a newer version), the object falls back to
+ * computing its data from scratch.
+ */
+class Snapshot {
+public:
+    /// Create an empty snapshot that records the data of a scene while it is loaded
+    Snapshot(const std::string &xml, const std::string &basePath);
+
+    /// Open a snapshot file (throws a \ref NoriException if it is not valid)
+    explicit Snapshot(const std::string &filename);
+
+    ~Snapshot();
+
+    /// Is this a snapshot opened from a file?
+    bool isReading() const { return (bool) m_file; }
+
+    /// Return the XML description of the scene
+    const std::string &getXML() const { return m_xml; }
+
+    /// Return the directory of the original scene file (used to resolve other resources)
+    const std::string &getBasePath() const { return m_basePath; }
+
+    /// Return the next key for an object of the given kind, e.g. "obj0", "obj1", ...
+    std::string nextKey(const std::string &kind);
+
+    /// Store a matrix (or vector) in the snapshot
+    template <typename Matrix> void putMatrix(const std::string &key, const Matrix &matrix) {
+        put(key, (uint64_t) matrix.rows(), (uint64_t) matrix.cols(),
+            matrix.data(), sizeof(typename Matrix::Scalar) * (size_t) matrix.size());
+    }
+
+    /// Store a vector in the snapshot
+    template <typename T> void putVector(const std::string &key, const std::vector<T> &vector) {
+        put(key, (uint64_t) vector.size(), 1, vector.data(), sizeof(T) * vector.size());
+    }
+
+    /// Look up a matrix (or vector), returns \c false if the snapshot does not contain it
+    template <typename Matrix> bool getMatrix(const std::string &key, Matrix &matrix) const {
+        const Entry *entry = find(key, sizeof(typename Matrix::Scalar));
+        if (!entry)
+            return false;
+        matrix.resize((typename Matrix::Index) entry->rows, (typename Matrix::Index) entry->cols);
+        if (entry->size > 0)
+            memcpy((void *) matrix.data(), blob(*entry), (size_t) entry->size);
+        return true;
+    }
+
+    /// Look up a vector, returns \c false if the snapshot does not contain it
+    template <typename T> bool getVector(const std::string &key, std::vector<T> &vector) const {
+        const Entry *entry = find(key, sizeof(T));
+        if (!entry)
+            return false;
+        vector.resize((size_t) entry->rows);
+        if (entry->size > 0)
+            memcpy((void *) vector.data(), blob(*entry), (size_t) entry->size);
+        return true;
+    }
+
+    /// Write the snapshot to a file
+    void save(const std::string &filename) const;
+
+    /// Return the snapshot used by objects that are currently being created (or \c nullptr)
+    static Snapshot *active() { return m_active; }
+
+    /// Makes a snapshot active for its lifetime
+    class Scope {
+    public:
+        explicit Scope(Snapshot *snapshot) : m_previous(m_active) { m_active = snapshot; }
+        ~Scope() { m_active = m_previous; }
+    private:
+        Snapshot *m_previous;
+    };
+
+private:
+    struct Entry {
+        uint64_t rows, cols;
+        uint64_t offset, size;
+        std::vector<uint8_t> data; ///< Only used while writing
+    };
+
+    void put(const std::string &key, uint64_t rows, uint64_t cols, const void *data, size_t size);
+    const Entry *find(const std::string &key, size_t scalarSize) const;
+    const uint8_t *blob(const Entry &entry) const;
+
+    Snapshot(const Snapshot &) = delete;
+    Snapshot &operator=(const Snapshot &) = delete;
+
+    std::string m_xml;
+    std::string m_basePath;
+    std::map<std::string, Entry> m_entries;
+    std::map<std::string, int> m_keyCounters;
+    std::unique_ptr<MemoryMappedFile> m_file;
+
+    static Snapshot *m_active;
+};
+
+/**
+ * \brief Load a scene and store it, fully activated, as a snapshot
+ *
+ * The scene is loaded from the XML file as usual while all expensive data
+ * is recorded, and then written to \c snapshotFilename.
+ */
+extern void createSnapshot(const std::string &xmlFilename, const std::string &snapshotFilename);
+
+/// Load a scene from a snapshot file and return its root object
+extern NoriObject *loadFromSnapshot(const std::string &filename);
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_SNAPSHOT_H */
@@ -0,0 +1,145 @@
+#if !defined(__NORI_STATS_H)
+#define __NORI_STATS_H
+
+#include <nori/common.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Render statistics: counters, ratios and histograms
+ *
+ * Statistics are static objects that are declared with the NORI_STAT_*
+ * macros below and registered by category and name; declarations with the
+ * same category and name (e.g. in several integrators) share one statistic.
+ * Every thread counts into its own buffer, so an update is a plain increment
+ * without synchronization. The buffers are merged when the statistics are
+ * printed, which must happen while no thread is counting (e.g. at the end
+ * of a render).
+ *
+ * Statistics are only collected when Nori is configured with NORI_STATS=ON;
+ * otherwise (the default) the macros expand to nothing and no statistic is
+ * registered.
+ */
+class Statistics {
+public:
+    enum EType {
+        /// A total (one slot)
+        ECounter = 0,
+        /// A total and the number of events it is averaged over (two slots)
+        ERatio,
+        /// Counts of integer values, the last bucket collects all larger values (one slot per bucket)
+        EHistogram
+    };
+
+    /// Maximum total number of slots of all statistics
+    static const int MaxSlots = 256;
+
+    /**
+     * \brief Register a statistic and return the index of its first slot
+     *
+     * Registering an existing category and name returns the slots of the
+     * existing statistic.
+     */
+    static int registerStat(const char *category, const char *name, EType type, int slotCount);
+
+    /**
+     * \brief Return the index of the first slot of a registered statistic,
+     * or -1 if there is none (e.g. with NORI_STATS=OFF)
+     */
+    static int findStat(const char *category, const char *name);
+
+    /// Return the counting buffer of the calling thread
+    static uint64_t *threadSlots() {
+        static thread_local ThreadBuffer buffer;
+        return buffer.slots;
+    }
+
+    /// Were any statistics compiled in?
+    static bool isEmpty();
+
+    /// Reset all statistics
+    static void reset();
+
+    /// Merge the buffers of all threads and return a human-readable summary
+    static std::string toString();
+
+    /// Merge the buffers of all threads and return the statistics as a JSON object
+    static std::string toJSON();
+
+private:
+    struct ThreadBuffer {
+        uint64_t slots[MaxSlots];
+
+        ThreadBuffer();
+        ~ThreadBuffer();
+    };
+};
+
+/// Counter statistic, see \ref NORI_STAT_COUNTER
+class StatCounter {
+public:
+    StatCounter(const char *category, const char *name)
+        : m_slot(Statistics::registerStat(category, name, Statistics::ECounter, 1)) { }
+
+    void add(uint64_t value) const { Statistics::threadSlots()[m_slot] += value; }
+
+private:
+    int m_slot;
+};
+
+/// Ratio statistic (e.g. nodes visited per ray), see \ref NORI_STAT_RATIO
+class StatRatio {
+public:
+    StatRatio(const char *category, const char *name)
+        : m_slot(Statistics::registerStat(category, name, Statistics::ERatio, 2)) { }
+
+    void add(uint64_t numerator, uint64_t denominator) const {
+        uint64_t *slots = Statistics::threadSlots();
+        slots[m_slot] += numerator;
+        slots[m_slot + 1] += denominator;
+    }
+
+private:
+    int m_slot;
+};
+
+/// Histogram of integer values, see \ref NORI_STAT_HISTOGRAM
+class StatHistogram {
+public:
+    StatHistogram(const char *category, const char *name, int bucketCount)
+        : m_slot(Statistics::registerStat(category, name, Statistics::EHistogram, bucketCount)),
+          m_bucketCount(bucketCount) { }
+
+    void add(uint32_t value) const {
+        Statistics::threadSlots()[m_slot + std::min(value, (uint32_t) m_bucketCount - 1)] += 1;
+    }
+
+private:
+    int m_slot, m_bucketCount;
+};
+
+#if defined(NORI_STATS)
+/// Declare a counter \c var, e.g. NORI_STAT_COUNTER(shadowRays, "BVH", "Shadow rays");
+#define NORI_STAT_COUNTER(var, category, name) static const StatCounter var(category, name)
+/// Declare a ratio \c var, shown as the average of the numerators over the denominators
+#define NORI_STAT_RATIO(var, category, name) static const StatRatio var(category, name)
+/// Declare a histogram \c var of integer values in [0, buckets - 1], larger values go to the last bucket
+#define NORI_STAT_HISTOGRAM(var, category, name, buckets) static const StatHistogram var(category, name, buckets)
+/// Add to a counter or a histogram
+#define NORI_STAT_ADD(var, value) (var).add(value)
+/// Add to a ratio
+#define NORI_STAT_RATIO_ADD(var, numerator, denominator) (var).add(numerator, denominator)
+/// Code that is only compiled with statistics (e.g. local counting in a hot loop)
+#define NORI_STAT_ONLY(...) __VA_ARGS__
+#else
+#define NORI_STAT_COUNTER(var, category, name) static_assert(true, "")
+#define NORI_STAT_RATIO(var, category, name) static_assert(true, "")
+#define NORI_STAT_HISTOGRAM(var, category, name, buckets) static_assert(true, "")
+#define NORI_STAT_ADD(var, value) ((void) 0)
+#define NORI_STAT_RATIO_ADD(var, numerator, denominator) ((void) 0)
+#define NORI_STAT_ONLY(...)
+#endif
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_STATS_H */
@@ -0,0 +1,109 @@
+#if !defined(__NORI_STATTEST_H)
+#define __NORI_STATTEST_H
+
+#include <nori/object.h>
+#include <pcg32.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Base class of the statistical tests ("chi2test" and "ttest")
+ *
+ * A test runs when the XML parser activates it. Sampling is split into
+ * chunks of \ref ChunkSize samples that are processed in parallel. Chunk
+ * \c i of test \c t draws from its own pcg32 stream (see \ref chunkRandom()),
+ * and the per-chunk results are combined in a fixed order, so the outcome
+ * depends only on the "seed" property and not on the number of threads.
+ */
+class StatisticalTest : public NoriObject {
+public:
+    /// Number of samples drawn from one random number stream
+    static const int ChunkSize = 1 << 16;
+
+    /// Return the number of executed tests
+    int getTestCount() const { return m_executedTests; }
+
+    /// Return the number of passed tests
+    int getPassedCount() const { return m_passedTests; }
+
+    virtual EClassType getClassType() const override { return ETest; }
+
+protected:
+    explicit StatisticalTest(const PropertyList &propList)
+        : m_seed((uint64_t) propList.getInteger("seed", 0)) { }
+
+    /// Return the number of chunks that \c sampleCount samples are split into
+    static int chunkCount(int sampleCount) { return (sampleCount + ChunkSize - 1) / ChunkSize; }
+
+    /// Return the number of samples in chunk \c chunk
+    static int chunkSamples(int sampleCount, int chunk) {
+        return std::min(ChunkSize, sampleCount - chunk * ChunkSize);
+    }
+
+    /// Return the pcg32 stream index of a chunk of the given test
+    static uint64_t chunkStream(int test, int chunk) {
+        return ((uint64_t) test << 32) | (uint32_t) chunk;
+    }
+
+    /// Return the random number generator of a chunk of the given test
+    pcg32 chunkRandom(int test, int chunk) const {
+        return pcg32(m_seed, chunkStream(test, chunk));
+    }
+
+    /// Return the random number generator for per-test parameters (e.g. incident directions)
+    pcg32 parameterRandom() const {
+        return pcg32(m_seed, ~(uint64_t) 0 >> 1);
+    }
+
+    /// Record the outcome of one test
+    void record(bool passed) {
+        ++m_executedTests;
+        if (passed)
+            ++m_passedTests;
+    }
+
+    uint64_t m_seed;
+    int m_executedTests = 0;
+    int m_passedTests = 0;
+};
+
+/**
+ * \brief Running mean and variance (Welford's algorithm) that can be merged
+ * with the statistics of another set of samples (Chan et al.)
+ */
+struct MeanVariance {
+    double mean = 0, m2 = 0;
+    int64_t count = 0;
+
+    void add(double value) {
+        ++count;
+        double delta = value - mean;
+        mean += delta / (double) count;
+        m2 += delta * (value - mean);
+    }
+
+    void merge(const MeanVariance &other) {
+        if (other.count == 0)
+            return;
+        int64_t total = count + other.count;
+        double delta = other.mean - mean;
+        mean += delta * (double) other.count / (double) total;
+        m2 += other.m2 + delta * delta * (double) count * (double) other.count / (double) total;
+        count = total;
+    }
+
+    /// Unbiased sample variance
+    double variance() const { return count > 1 ? m2 / (double) (count - 1) : 0.0; }
+};
+
+/**
+ * \brief Run every test (XML file with a \c test root element) in a directory
+ *
+ * \return The number of files that failed, i.e. that could not be loaded or
+ *     contained a test that did not pass
+ */
+extern int runTestDirectory(const std::string &directory);
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_STATTEST_H */
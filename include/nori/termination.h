@@ -0,0 +1,87 @@
+#if !defined(__NORI_TERMINATION_H)
+#define __NORI_TERMINATION_H
+
+#include <nori/color.h>
+
+NORI_NAMESPACE_BEGIN
+
+class PropertyList;
+class Sampler;
+
+/**
+ * \brief Russian roulette and path length limits shared by the path integrators
+ *
+ * The policy is configured on the integrator:
+ * <ul>
+ *   <li>\c minDepth: number of bounces that are never terminated (default 0,
+ *       i.e. roulette from the first bounce as in the original integrators)</li>
+ *   <li>\c maxDepth: maximum number of bounces, -1 for unlimited (default -1).
+ *       Limiting the depth truncates the estimate, i.e. it is biased.</li>
+ *   <li>\c rrMode: \c "none", \c "throughput" (survival probability equal to
+ *       the largest throughput component, capped at \c maxRRProb) or
+ *       \c "efficiency" (see below)</li>
+ *   <li>\c maxRRProb: survival cap of both modes, which bounds the length
+ *       of paths that do not lose energy (e.g. between mirrors)</li>
+ *   <li>\c rrThreshold: throughput luminance below which the efficiency mode
+ *       starts to terminate paths (default 1)</li>
+ * </ul>
+ *
+ * The efficiency mode chooses the survival probability proportional to the
+ * throughput luminance, which balances the variance added by the roulette
+ * (proportional to 1/q) against the work it saves (proportional to q). Paths
+ * above \c rrThreshold are only subject to the \c maxRRProb cap, and the
+ * survival probability never drops below 5% to limit fireflies.
+ *
+ * Bounces are counted from the first surface or medium interaction of a
+ * camera path, starting at 1. A path that is terminated at bounce \c depth
+ * still contains the light that scattered fewer than \c depth times, so
+ * <tt>maxDepth = 1</tt> renders direct illumination and <tt>maxDepth = 0</tt>
+ * only directly visible emitters.
+ */
+class PathTermination {
+public:
+    enum EMode {
+        ENone = 0,
+        EThroughput,
+        EEfficiency
+    };
+
+    /**
+     * \brief Read the policy from the properties of an integrator
+     *
+     * \param defaultMaxProb
+     *     Default of \c maxRRProb (integrators historically used different caps)
+     */
+    PathTermination(const PropertyList &props, float defaultMaxProb = .95f);
+
+    /**
+     * \brief Decide whether a path continues at bounce \c depth, before it
+     * samples the emitters or its next direction there
+     *
+     * On survival, the throughput is divided by the survival probability.
+     */
+    bool survive(uint32_t depth, Color3f &throughput, Sampler *sampler) const;
+
+    /// Return the survival probability of a path at bounce \c depth
+    float survivalProbability(uint32_t depth, const Color3f &throughput) const;
+
+    /// Return the minimum number of bounces before Russian roulette
+    int getMinDepth() const { return m_minDepth; }
+
+    /// Return the maximum number of bounces (-1: unlimited)
+    int getMaxDepth() const { return m_maxDepth; }
+
+    /// Return a human-readable summary
+    std::string toString() const;
+
+private:
+    EMode m_mode;
+    int m_minDepth;
+    int m_maxDepth;
+    float m_maxProb;
+    float m_threshold;
+};
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_TERMINATION_H */
@@ -0,0 +1,160 @@
+#if !defined(__NORI_TEXCACHE_H)
+#define __NORI_TEXCACHE_H
+
+#include <nori/color.h>
+#include <nori/vector.h>
+#include <tbb/mutex.h>
+#include <atomic>
+#include <fstream>
+#include <memory>
+
+NORI_NAMESPACE_BEGIN
+
+class Bitmap;
+
+/**
+ * \brief MIP-mapped RGB image stored as square tiles in a file on disk
+ *
+ * Every MIP level is cut into tiles of \ref TILE_RES x \ref TILE_RES
+ * texels. The texels of one tile are contiguous, so a lookup only touches
+ * a single small block of memory. Tiles are not kept in memory by the
+ * image itself; they are read on demand through the global
+ * \ref TextureCache.
+ *
+ * Texels can be stored as 32-bit floats, 16-bit halfs or 8-bit sRGB-encoded
+ * values. 8-bit storage is only suitable for low dynamic range content.
+ */
+class TiledImage {
+public:
+    enum EPrecision {
+        EFloat32 = 0,
+        EFloat16,
+        EUInt8
+    };
+
+    /// Number of texels along each side of a tile
+    static const int TILE_RES = 32;
+
+    /**
+     * \brief Open the tiled version of a bitmap, converting it if necessary
+     *
+     * \param sourceFile
+     *     Image file (EXR, PNG, JPG, ...) the tiles are created from
+     * \param tiledFile
+     *     Location of the tiled file. An existing file is reused when it was
+     *     created from the same source file with the same precision.
+     */
+    TiledImage(const std::string &sourceFile, const std::string &tiledFile, EPrecision precision);
+
+    /// Return the number of MIP levels
+    int getLevelCount() const { return (int) m_levels.size(); }
+
+    /// Return the resolution of a MIP level
+    const Vector2i &getSize(int level) const { return m_levels[level].size; }
+
+    /// Return the storage precision
+    EPrecision getPrecision() const { return m_precision; }
+
+    /// Return the identifier assigned by the texture cache
+    uint32_t getId() const { return m_id; }
+
+    /// Return the size of one tile in bytes
+    size_t getTileBytes() const { return m_tileBytes; }
+
+    /// Read one tile from disk (called by the texture cache on a miss)
+    void readTile(int level, int tileX, int tileY, uint8_t *target) const;
+
+    /// Decode texel \c index of a tile with the given contents
+    Color3f decode(const uint8_t *tile, int index) const;
+
+    /// Return the name of the tiled file
+    const std::string &getFilename() const { return m_filename; }
+
+private:
+    struct Level {
+        Vector2i size;
+        Vector2i tiles;
+        uint64_t offset;
+    };
+
+    void convert(const std::string &sourceFile, uint64_t sourceStamp);
+    bool open(uint64_t sourceStamp);
+
+    std::string m_filename;
+    EPrecision m_precision;
+    std::vector<Level> m_levels;
+    size_t m_tileBytes;
+    uint32_t m_id;
+
+    mutable std::ifstream m_file;
+    mutable tbb::mutex m_fileMutex;
+};
+
+/**
+ * \brief Process-wide cache of texture tiles with a fixed memory budget
+ *
+ * The cache is split into shards, each guarded by its own reader-writer
+ * lock. A hit only takes the lock for reading and marks the tile as
+ * referenced, so concurrent lookups of resident tiles do not wait for each
+ * other; the lock is only taken exclusively to insert a tile after a miss.
+ * A hit still updates the lock word and the reference count of the tile,
+ * so callers should keep using a tile while their lookups stay inside it
+ * (as \c ImageTexture does). Once the
+ * resident size of a shard exceeds its share of the budget, tiles are
+ * evicted in clock order, skipping (and unmarking) tiles that were
+ * referenced since the clock hand last passed them. Hits and misses are
+ * counted per thread. Tiles handed out to callers stay valid until the last
+ * reference is gone.
+ */
+class TextureCache {
+public:
+    typedef std::shared_ptr<const std::vector<uint8_t>> Tile;
+
+    /// Return the global texture cache
+    static TextureCache &instance();
+
+    /// Set the memory budget (in bytes) for resident tiles
+    void setCapacity(size_t bytes);
+
+    /// Return the memory budget in bytes
+    size_t getCapacity() const { return m_capacity; }
+
+    /// Assign a unique identifier to a newly created tiled image
+    uint32_t registerImage() { return m_nextId++; }
+
+    /// Return a tile of an image, loading it from disk if necessary
+    Tile lookup(const TiledImage &image, int level, int tileX, int tileY);
+
+    /// Return the number of lookups that found the tile resident (summed over all threads)
+    uint64_t getHitCount() const;
+
+    /// Return the number of lookups that had to read the tile from disk (summed over all threads)
+    uint64_t getMissCount() const;
+
+    /// Return the memory occupied by resident tiles
+    size_t getResidentBytes() const { return m_residentBytes; }
+
+    /// Reset the hit and miss counters (while no thread performs lookups)
+    void resetStatistics();
+
+    /// Return a human-readable summary of the cache statistics
+    std::string getStatistics() const;
+
+private:
+    TextureCache();
+    ~TextureCache();
+
+    struct Shard;
+    struct ThreadCounters;
+    static const int SHARD_COUNT = 16;
+
+    std::unique_ptr<Shard[]> m_shards;
+    size_t m_capacity;
+    std::atomic<uint32_t> m_nextId;
+    std::unique_ptr<ThreadCounters> m_counters;
+    std::atomic<size_t> m_residentBytes, m_peakBytes;
+};
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_TEXCACHE_H */
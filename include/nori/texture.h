@@ -38,7 +38,38 @@ public:
      * */
     virtual EClassType getClassType() const override { return ETexture; }
 
-    virtual T eval(const Point2f & uv) = 0;
+    /**
+     * \brief Evaluate the texture at the given UV coordinates
+     *
+     * Textures are shared by all render threads, so implementations must
+     * be safe to call concurrently (any internal caching has to be
+     * synchronized or thread-local).
+     */
+    virtual T eval(const Point2f & uv) const = 0;
+
+    /**
+     * \brief Evaluate the texture over the footprint of a pixel
+     *
+     * \c dUVdx and \c dUVdy are the changes of the UV coordinates between
+     * neighboring pixels (see \ref Intersection::dUVdx). Textures that can
+     * prefilter (e.g. MIP-mapped images) use them to pick a resolution,
+     * all others just evaluate at \c uv.
+     */
+    virtual T eval(const Point2f & uv, const Vector2f & dUVdx, const Vector2f & dUVdy) const {
+        return eval(uv);
+    }
+
+    /**
+     * \brief Evaluate the texture at \c count UV coordinates at once
+     *
+     * Lets batched shading amortize per-call overhead (e.g. virtual calls
+     * and texture cache lookups for neighboring texels). The default
+     * implementation calls \ref eval() for every entry.
+     */
+    virtual void evalBatch(const Point2f * uv, T * result, size_t count) const {
+        for (size_t i = 0; i < count; ++i)
+            result[i] = eval(uv[i]);
+    }
 };
 
 NORI_NAMESPACE_END
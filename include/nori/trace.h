@@ -0,0 +1,100 @@
+#if !defined(__NORI_TRACE_H)
+#define __NORI_TRACE_H
+
+#include <nori/common.h>
+#include <atomic>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Timeline of the render pipeline in the Chrome trace-event format
+ *
+ * Scoped events record their start time and duration together with the
+ * calling thread, so the timeline shows loading, preprocessing, every tile
+ * and the output of a render, and where worker threads sit idle. The file
+ * written by \ref write() can be opened in chrome://tracing or
+ * https://ui.perfetto.dev.
+ *
+ * Recording is off by default (see <tt>nori --trace</tt>); a disabled scope
+ * costs a single atomic load.
+ */
+class Trace {
+public:
+    /// Turn recording on or off
+    static void setEnabled(bool enabled) { m_enabled = enabled; }
+
+    /// Is recording turned on?
+    static bool isEnabled() { return m_enabled.load(std::memory_order_relaxed); }
+
+    /// Discard all events and restart the clock (call while no event is recorded)
+    static void reset();
+
+    /// Write all events recorded since \ref reset() as a trace-event JSON file
+    static void write(const std::string &filename);
+
+    /// Microseconds since the last \ref reset()
+    static double now();
+
+    /**
+     * \brief Record a complete event of the calling thread
+     *
+     * \param args
+     *     Contents of the JSON "args" object, e.g. <tt>"tile": 3</tt>
+     */
+    static void addEvent(const std::string &name, const char *category,
+                         double start, double end, const std::string &args);
+
+    /// Records an event for its lifetime
+    class Scope {
+    public:
+        Scope(const char *category, const std::string &name)
+            : m_active(isEnabled()), m_category(category) {
+            if (m_active) {
+                m_name = name;
+                m_start = now();
+            }
+        }
+
+        /// Start an event whose name is only built if it is recorded, see \ref setName()
+        explicit Scope(const char *category, const char *name = "")
+            : m_active(isEnabled()), m_category(category) {
+            if (m_active) {
+                m_name = name;
+                m_start = now();
+            }
+        }
+
+        ~Scope() {
+            if (m_active)
+                addEvent(m_name, m_category, m_start, now(), m_args);
+        }
+
+        /// Is the event recorded? (Check before formatting arguments)
+        bool isActive() const { return m_active; }
+
+        /// Set the name of the event (check \ref isActive() before building it)
+        void setName(const std::string &name) { m_name = name; }
+
+        /// Set the arguments that are shown with the event (values must be valid JSON, see \ref jsonString())
+        void setArgs(const std::string &args) { m_args = args; }
+
+    private:
+        bool m_active;
+        const char *m_category;
+        std::string m_name, m_args;
+        double m_start = 0;
+    };
+
+private:
+    static std::atomic<bool> m_enabled;
+};
+
+#define NORI_TRACE_CONCAT_(a, b) a ## b
+#define NORI_TRACE_CONCAT(a, b) NORI_TRACE_CONCAT_(a, b)
+
+/// Record the rest of the enclosing scope in the trace, e.g. NORI_TRACE_SCOPE("load", "BVH build");
+#define NORI_TRACE_SCOPE(category, name) Trace::Scope NORI_TRACE_CONCAT(__noriTraceScope, __LINE__)(category, name)
+
+NORI_NAMESPACE_END
+
+#endif /* __NORI_TRACE_H */
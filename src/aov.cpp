@@ -0,0 +1,112 @@
+#include <nori/aov.h>
+#include <nori/shape.h>
+#include <nori/bsdf.h>
+#include <algorithm>
+
+NORI_NAMESPACE_BEGIN
+
+namespace {
+    template <typename T> void store3(float *target, const T &value) {
+        target[0] = value[0];
+        target[1] = value[1];
+        target[2] = value[2];
+    }
+};
+
+void AOVRecord::setSurface(const Intersection &its) {
+    normal = its.shFrame.n;
+    depth = its.t;
+    primId = (int) its.primIndex;
+
+    const BSDF *bsdf = its.mesh->getBSDF();
+    if (bsdf) {
+        BSDFQueryRecord bRec(Vector3f(0.f, 0.f, 1.f));
+        bRec.uv = its.uv;
+        bRec.p = its.p;
+        bRec.dUVdx = its.dUVdx;
+        bRec.dUVdy = its.dUVdy;
+        albedo = bsdf->albedo(bRec);
+    }
+}
+
+AOVLayout::AOVLayout(const std::string &names) : m_channelCount(0) {
+    for (const std::string &token : tokenize(names, ", ")) {
+        /* tokenize() returns one empty token for an empty list */
+        if (token.empty())
+            continue;
+        std::string name = toLower(token);
+        int type = 0;
+        while (type < ETypeCount && name != getName((EType) type))
+            ++type;
+        if (type == ETypeCount)
+            throw NoriException("AOVLayout: unknown AOV \"%s\" (expected albedo, normal, depth, "
+                                "primId, emission, diffuse or specular)", token);
+        if (has((EType) type))
+            throw NoriException("AOVLayout: AOV \"%s\" was requested twice", token);
+        add((EType) type);
+    }
+}
+
+bool AOVLayout::has(EType type) const {
+    return std::find(m_types.begin(), m_types.end(), type) != m_types.end();
+}
+
+void AOVLayout::add(EType type) {
+    if (has(type))
+        return;
+    m_types.push_back(type);
+    m_offsets.push_back(m_channelCount);
+    m_channelCount += getChannelCount(type);
+}
+
+void AOVLayout::pack(const AOVRecord &record, float *channels) const {
+    for (size_t i = 0; i < m_types.size(); ++i) {
+        float *target = channels + m_offsets[i];
+        switch (m_types[i]) {
+            case EAlbedo:   store3(target, record.albedo); break;
+            case ENormal:   store3(target, record.normal); break;
+            case EDepth:    target[0] = record.depth; break;
+            case EPrimId:   target[0] = (float) record.primId; break;
+            case EEmission: store3(target, record.emission); break;
+            case EDiffuse:  store3(target, record.diffuse); break;
+            case ESpecular: store3(target, record.specular); break;
+            default: break;
+        }
+    }
+}
+
+const char *AOVLayout::getName(EType type) {
+    switch (type) {
+        case EAlbedo:   return "albedo";
+        case ENormal:   return "normal";
+        case EDepth:    return "depth";
+        case EPrimId:   return "primid";
+        case EEmission: return "emission";
+        case EDiffuse:  return "diffuse";
+        case ESpecular: return "specular";
+        default:        return "unknown";
+    }
+}
+
+int AOVLayout::getChannelCount(EType type) {
+    return (type == EDepth || type == EPrimId) ? 1 : 3;
+}
+
+AOVLayout::EReconstruction AOVLayout::getReconstruction(EType type) {
+    switch (type) {
+        case EEmission:
+        case EDiffuse:
+        case ESpecular: return EFiltered;
+        case EPrimId:   return EFirst;
+        default:        return EBox;
+    }
+}
+
+std::string AOVLayout::toString() const {
+    std::string result;
+    for (size_t i = 0; i < m_types.size(); ++i)
+        result += (i > 0 ? ", " : "") + std::string(getName(m_types[i]));
+    return "{" + result + "}";
+}
+
+NORI_NAMESPACE_END
@@ -0,0 +1,612 @@
+#include <nori/bvh.h>
+#include <nori/mesh.h>
+#include <nori/bsdf.h>
+#include <nori/emitter.h>
+#include <nori/bitmap.h>
+#include <nori/warp.h>
+#include <nori/proplist.h>
+#include <filesystem/path.h>
+#include <Eigen/Geometry>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/task_scheduler_init.h>
+#include <pcg32.h>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <cstdio>
+#include <atomic>
+
+/*
+ * Microbenchmarks for regression tracking. The "rays" suite measures BVH
+ * construction and traversal, the "shading" suite the per-call cost of the
+ * warping functions, BSDFs and emitters. Results are written as JSON; run
+ * from the repository root so that the bundled scenes are found, or pass
+ * their directory with --scenes.
+ */
+
+using namespace nori;
+
+namespace {
+    /// Wall-clock time in seconds with sub-millisecond resolution
+    double now() {
+        return std::chrono::duration<double>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    struct Options {
+        std::string scenes = "scenes";
+        std::string output = "nori_bench.json";
+        std::string suite = "all";
+        std::string envMap;
+        size_t rayCount = 1 << 20;
+        size_t callCount = 1 << 18;
+        int threads = 1;
+        std::vector<std::string> meshes;
+    };
+
+    /// A set of meshes that is placed into one BVH
+    struct MeshCase {
+        std::string name;
+        std::vector<std::string> files;
+    };
+
+    /// Throughput of one ray query over a fixed set of rays
+    struct RayResult {
+        double mrays;
+        double hitRate;
+    };
+
+    /// Trace all rays, possibly in parallel, and return the throughput
+    RayResult traceRays(const BVH &bvh, const std::vector<Ray3f> &rays, bool shadowRays) {
+        std::atomic<size_t> hits(0);
+        double start = now();
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, rays.size(), 4096),
+            [&](const tbb::blocked_range<size_t> &range) {
+                size_t localHits = 0;
+                Intersection its;
+                for (size_t i = range.begin(); i < range.end(); ++i)
+                    localHits += bvh.rayIntersect(rays[i], its, shadowRays) ? 1 : 0;
+                hits += localHits;
+            });
+        double elapsed = now() - start;
+
+        RayResult result;
+        result.mrays = rays.size() / elapsed * 1e-6;
+        result.hitRate = (double) hits / rays.size();
+        return result;
+    }
+
+    /**
+     * Primary rays of a pinhole camera that looks at the center of the
+     * scene, generated in 8x8 pixel tiles so that consecutive rays are
+     * coherent
+     */
+    std::vector<Ray3f> primaryRays(const BoundingBox3f &bbox, size_t count) {
+        int resolution = std::max(8, (int) std::sqrt((double) count) / 8 * 8);
+        Point3f center = bbox.getCenter();
+        float radius = (bbox.max - bbox.min).norm() * 0.5f;
+        Vector3f dir = Vector3f(-1.f, -0.6f, -1.3f).normalized();
+        Point3f origin = center - dir * (2.5f * radius);
+        Vector3f left = Vector3f(0.f, 1.f, 0.f).cross(dir).normalized();
+        Vector3f up = dir.cross(left);
+        float scale = std::tan(degToRad(20.f));
+
+        std::vector<Ray3f> rays;
+        rays.reserve((size_t) resolution * resolution);
+        for (int ty = 0; ty < resolution; ty += 8) {
+            for (int tx = 0; tx < resolution; tx += 8) {
+                for (int y = ty; y < ty + 8; ++y) {
+                    for (int x = tx; x < tx + 8; ++x) {
+                        float u = (2.f * (x + 0.5f) / resolution - 1.f) * scale;
+                        float v = (2.f * (y + 0.5f) / resolution - 1.f) * scale;
+                        rays.push_back(Ray3f(origin, (dir + u * left + v * up).normalized()));
+                    }
+                }
+            }
+        }
+        return rays;
+    }
+
+    /// Rays with uniformly distributed origins inside the scene and random directions
+    std::vector<Ray3f> incoherentRays(const BoundingBox3f &bbox, size_t count) {
+        pcg32 random;
+        std::vector<Ray3f> rays;
+        rays.reserve(count);
+        Vector3f extents = bbox.max - bbox.min;
+        for (size_t i = 0; i < count; ++i) {
+            Point3f o = bbox.min + extents.cwiseProduct(
+                Vector3f(random.nextFloat(), random.nextFloat(), random.nextFloat()));
+            Point2f sample(random.nextFloat(), random.nextFloat());
+            rays.push_back(Ray3f(o, Warp::squareToUniformSphere(sample)));
+        }
+        return rays;
+    }
+
+    std::string rayJSON(const RayResult &result) {
+        return tfm::format("{ \"mrays\": %.4f, \"hitRate\": %.4f }", result.mrays, result.hitRate);
+    }
+
+    /// Build a BVH over the meshes of a case and measure ray queries against it
+    std::string benchmarkRays(const MeshCase &meshCase, const Options &options) {
+        BVH bvh;
+        size_t meshBytes = 0;
+        for (const std::string &file : meshCase.files) {
+            PropertyList props;
+            props.setString("filename", file);
+            Mesh *mesh = static_cast<Mesh *>(NoriObjectFactory::createInstance("obj", props));
+            mesh->activate();
+            meshBytes += sizeof(float) * (mesh->getVertexPositions().size() + mesh->getVertexNormals().size() +
+                                          mesh->getVertexTexCoords().size()) +
+                         sizeof(uint32_t) * mesh->getIndices().size();
+            bvh.addShape(mesh);
+        }
+
+        double start = now();
+        bvh.build();
+        double buildTime = now() - start;
+
+        std::vector<Ray3f> primary = primaryRays(bvh.getBoundingBox(), options.rayCount);
+        std::vector<Ray3f> incoherent = incoherentRays(bvh.getBoundingBox(), options.rayCount);
+
+        RayResult primaryClosest = traceRays(bvh, primary, false);
+        RayResult primaryShadow = traceRays(bvh, primary, true);
+        RayResult incoherentClosest = traceRays(bvh, incoherent, false);
+        RayResult incoherentShadow = traceRays(bvh, incoherent, true);
+
+        cout << tfm::format("%-12s build %7.3fs  SAH %7.3f  primary %7.2f / %7.2f Mrays/s  "
+                            "incoherent %7.2f / %7.2f Mrays/s (closest / shadow)",
+                            meshCase.name, buildTime, bvh.getSAHCost(), primaryClosest.mrays,
+                            primaryShadow.mrays, incoherentClosest.mrays, incoherentShadow.mrays) << endl;
+
+        std::string files;
+        for (size_t i = 0; i < meshCase.files.size(); ++i)
+            files += (i > 0 ? ", " : "") + jsonString(meshCase.files[i]);
+
+        return tfm::format(
+            "    {\n"
+            "      \"name\": %s,\n"
+            "      \"files\": [ %s ],\n"
+            "      \"primitives\": %i,\n"
+            "      \"meshBytes\": %i,\n"
+            "      \"bvh\": { \"buildSeconds\": %.4f, \"sahCost\": %.4f, \"nodes\": %i, \"bytes\": %i },\n"
+            "      \"primaryClosest\": %s,\n"
+            "      \"primaryShadow\": %s,\n"
+            "      \"incoherentClosest\": %s,\n"
+            "      \"incoherentShadow\": %s\n"
+            "    }",
+            jsonString(meshCase.name), files, bvh.getPrimitiveCount(), meshBytes,
+            buildTime, bvh.getSAHCost(), bvh.getNodeCount(), bvh.getMemoryUsage(),
+            rayJSON(primaryClosest), rayJSON(primaryShadow),
+            rayJSON(incoherentClosest), rayJSON(incoherentShadow));
+    }
+
+    /// Per-call timings of one routine family in nanoseconds (negative if not applicable)
+    struct Timing {
+        std::string name;
+        double sample = -1, eval = -1, pdf = -1;
+    };
+
+    /// Number of repetitions of every measurement, the fastest one is reported
+    const int Repetitions = 5;
+
+    /// Receives the results of the timed calls so that they are not optimized away
+    volatile float g_sink = 0.f;
+
+    /**
+     * Time \c functor(i) for all inputs \c i < \c count and return the time
+     * of one call in nanoseconds. The best of several repetitions is the
+     * least affected by interruptions and hence the most stable run to run.
+     */
+    template <typename Functor> double timeCalls(size_t count, const Functor &functor) {
+        double best = std::numeric_limits<double>::infinity();
+        for (int rep = 0; rep < Repetitions; ++rep) {
+            float sum = 0.f;
+            double start = now();
+            for (size_t i = 0; i < count; ++i)
+                sum += functor(i);
+            best = std::min(best, now() - start);
+            g_sink = g_sink + sum;
+        }
+        return best / count * 1e9;
+    }
+
+    /// Fixed uniform samples (the same on every run)
+    std::vector<Point2f> randomSamples(size_t count, uint64_t stream) {
+        pcg32 random(PCG32_DEFAULT_STATE, stream);
+        std::vector<Point2f> samples(count);
+        for (Point2f &sample : samples)
+            sample = Point2f(random.nextFloat(), random.nextFloat());
+        return samples;
+    }
+
+    /// Time a warping function and, if given, the density of its outputs
+    template <typename Function, typename Pdf>
+    Timing benchmarkWarp(const std::string &name, const std::vector<Point2f> &samples,
+                         const Function &function, const Pdf *pdf) {
+        typedef typename std::decay<decltype(function(samples[0]))>::type Value;
+        std::vector<Value> values(samples.size());
+        for (size_t i = 0; i < samples.size(); ++i)
+            values[i] = function(samples[i]);
+
+        Timing timing;
+        timing.name = name;
+        timing.sample = timeCalls(samples.size(), [&](size_t i) { return function(samples[i]).x(); });
+        if (pdf)
+            timing.pdf = timeCalls(samples.size(), [&](size_t i) { return (*pdf)(values[i]); });
+        return timing;
+    }
+
+    struct NoPdf {
+        template <typename Value> float operator()(const Value &) const { return 0.f; }
+    };
+
+    template <typename Function>
+    Timing benchmarkWarp(const std::string &name, const std::vector<Point2f> &samples, const Function &function) {
+        return benchmarkWarp(name, samples, function, (const NoPdf *) nullptr);
+    }
+
+    std::vector<Timing> benchmarkWarps(size_t count) {
+        std::vector<Point2f> samples = randomSamples(count, 1);
+        const float alpha = 0.3f, cosThetaMax = 0.8f;
+
+        auto uniformSquarePdf = [](const Point2f &p) { return Warp::squareToUniformSquarePdf(p); };
+        auto uniformDiskPdf = [](const Point2f &p) { return Warp::squareToUniformDiskPdf(p); };
+        auto uniformSpherePdf = [](const Vector3f &v) { return Warp::squareToUniformSpherePdf(v); };
+        auto sphereCapPdf = [&](const Vector3f &v) { return Warp::squareToUniformSphereCapPdf(v, cosThetaMax); };
+        auto uniformHemispherePdf = [](const Vector3f &v) { return Warp::squareToUniformHemispherePdf(v); };
+        auto cosineHemispherePdf = [](const Vector3f &v) { return Warp::squareToCosineHemispherePdf(v); };
+        auto beckmannPdf = [&](const Vector3f &m) { return Warp::squareToBeckmannPdf(m, alpha); };
+        auto gtr1Pdf = [&](const Vector3f &m) { return Warp::squareToGTR1Pdf(m, alpha); };
+        auto gtr2Pdf = [&](const Vector3f &m) { return Warp::squareToGTR2Pdf(m, alpha); };
+
+        std::vector<Timing> timings;
+        timings.push_back(benchmarkWarp("uniformSquare", samples,
+            [](const Point2f &s) { return Warp::squareToUniformSquare(s); }, &uniformSquarePdf));
+        timings.push_back(benchmarkWarp("uniformDisk", samples,
+            [](const Point2f &s) { return Warp::squareToUniformDisk(s); }, &uniformDiskPdf));
+        timings.push_back(benchmarkWarp("uniformCylinder", samples,
+            [](const Point2f &s) { return Warp::squareToUniformCylinder(s); }));
+        timings.push_back(benchmarkWarp("uniformSphere", samples,
+            [](const Point2f &s) { return Warp::squareToUniformSphere(s); }, &uniformSpherePdf));
+        timings.push_back(benchmarkWarp("uniformSphereCap", samples,
+            [&](const Point2f &s) { return Warp::squareToUniformSphereCap(s, cosThetaMax); }, &sphereCapPdf));
+        timings.push_back(benchmarkWarp("uniformHemisphere", samples,
+            [](const Point2f &s) { return Warp::squareToUniformHemisphere(s); }, &uniformHemispherePdf));
+        timings.push_back(benchmarkWarp("cosineHemisphere", samples,
+            [](const Point2f &s) { return Warp::squareToCosineHemisphere(s); }, &cosineHemispherePdf));
+        timings.push_back(benchmarkWarp("beckmann", samples,
+            [&](const Point2f &s) { return Warp::squareToBeckmann(s, alpha); }, &beckmannPdf));
+        timings.push_back(benchmarkWarp("gtr1", samples,
+            [&](const Point2f &s) { return Warp::squareToGTR1(s, alpha); }, &gtr1Pdf));
+        timings.push_back(benchmarkWarp("gtr2", samples,
+            [&](const Point2f &s) { return Warp::squareToGTR2(s, alpha); }, &gtr2Pdf));
+        timings.push_back(benchmarkWarp("uniformTriangle", samples,
+            [](const Point2f &s) { return Warp::squareToUniformTriangle(s); }));
+        return timings;
+    }
+
+    /// Time the BSDF plugins, each with a typical set of parameters
+    std::vector<Timing> benchmarkBSDFs(size_t count) {
+        std::vector<Point2f> samples = randomSamples(count, 2);
+        std::vector<Point2f> wiSamples = randomSamples(count, 3), woSamples = randomSamples(count, 4);
+        std::vector<Vector3f> wi(count), wo(count);
+        for (size_t i = 0; i < count; ++i) {
+            wi[i] = Warp::squareToCosineHemisphere(wiSamples[i]);
+            wo[i] = Warp::squareToCosineHemisphere(woSamples[i]);
+        }
+
+        std::vector<std::pair<std::string, PropertyList>> cases;
+        PropertyList diffuseProps, dielectricProps, microfacetProps, disneyProps;
+        diffuseProps.setColor("albedo", Color3f(0.5f));
+        cases.emplace_back("diffuse", diffuseProps);
+
+        cases.emplace_back("mirror", PropertyList());
+
+        dielectricProps.setFloat("intIOR", 1.5f);
+        cases.emplace_back("dielectric", dielectricProps);
+
+        microfacetProps.setFloat("alpha", 0.2f);
+        microfacetProps.setColor("kd", Color3f(0.5f));
+        cases.emplace_back("microfacet", microfacetProps);
+
+        disneyProps.setColor("albedo", Color3f(0.5f));
+        disneyProps.setFloat("roughness", 0.3f);
+        disneyProps.setFloat("metallic", 0.5f);
+        disneyProps.setFloat("specular", 0.5f);
+        cases.emplace_back("disney", disneyProps);
+
+        std::vector<Timing> timings;
+        for (const auto &bsdfCase : cases) {
+            std::unique_ptr<NoriObject> object(NoriObjectFactory::createInstance(bsdfCase.first, bsdfCase.second));
+            if (object->getClassType() != NoriObject::EBSDF)
+                throw NoriException("\"%s\" is not a BSDF", bsdfCase.first);
+            object->activate();
+            const BSDF *bsdf = static_cast<const BSDF *>(object.get());
+
+            Timing timing;
+            timing.name = bsdfCase.first;
+            timing.sample = timeCalls(count, [&](size_t i) {
+                BSDFQueryRecord bRec(wi[i]);
+                bRec.uv = samples[i];
+                return bsdf->sample(bRec, samples[i]).x();
+            });
+            timing.eval = timeCalls(count, [&](size_t i) {
+                BSDFQueryRecord bRec(wi[i], wo[i], ESolidAngle);
+                bRec.uv = samples[i];
+                return bsdf->eval(bRec).x();
+            });
+            timing.pdf = timeCalls(count, [&](size_t i) {
+                BSDFQueryRecord bRec(wi[i], wo[i], ESolidAngle);
+                bRec.uv = samples[i];
+                return bsdf->pdf(bRec);
+            });
+            timings.push_back(timing);
+        }
+        return timings;
+    }
+
+    /// Write a procedural sky with a bright sun, used when no environment map is given
+    void writeEnvironmentMap(const std::string &filename) {
+        Bitmap map(Vector2i(512, 256));
+        Vector3f sun = Vector3f(0.3f, 0.8f, 0.5f).normalized();
+        for (int y = 0; y < map.rows(); ++y) {
+            for (int x = 0; x < map.cols(); ++x) {
+                float theta = M_PI * (y + 0.5f) / map.rows(), phi = 2 * M_PI * (x + 0.5f) / map.cols();
+                Vector3f d = sphericalDirection(theta, phi);
+                float sky = std::max(0.f, d.z()) + 0.05f;
+                map(y, x) = Color3f(0.3f, 0.5f, 1.f) * sky + Color3f(std::pow(std::max(0.f, d.dot(sun)), 500.f) * 1000.f);
+            }
+        }
+        map.save(filename);
+    }
+
+    /// Time the emitters: a point light, area lights on an analytic sphere and a mesh, and an environment map
+    std::vector<Timing> benchmarkEmitters(size_t count, const std::string &scenes, const std::string &envMap) {
+        struct EmitterCase {
+            std::string name;
+            std::unique_ptr<Shape> shape;
+            std::unique_ptr<Emitter> emitter;
+            float minDistance, maxDistance;
+        };
+        std::vector<EmitterCase> cases;
+
+        auto addCase = [&](const std::string &name, const std::string &shapeType, const PropertyList &shapeProps,
+                           const std::string &emitterType, const PropertyList &emitterProps,
+                           float minDistance, float maxDistance) {
+            EmitterCase emitterCase;
+            emitterCase.name = name;
+            emitterCase.emitter.reset(static_cast<Emitter *>(NoriObjectFactory::createInstance(emitterType, emitterProps)));
+            if (!shapeType.empty()) {
+                emitterCase.shape.reset(static_cast<Shape *>(NoriObjectFactory::createInstance(shapeType, shapeProps)));
+                emitterCase.shape->addChild(emitterCase.emitter.get());
+                emitterCase.shape->activate();
+            }
+            emitterCase.emitter->activate();
+            emitterCase.minDistance = minDistance;
+            emitterCase.maxDistance = maxDistance;
+            cases.push_back(std::move(emitterCase));
+        };
+
+        PropertyList pointProps, areaProps, sphereProps, meshProps, envProps, envSphereProps;
+        pointProps.setPoint3("position", Point3f(0.f, 0.f, 0.f));
+        pointProps.setColor("power", Color3f(1.f));
+        addCase("point", "", PropertyList(), "point", pointProps, 2.f, 4.f);
+
+        areaProps.setColor("radiance", Color3f(1.f));
+        addCase("area-sphere", "sphere", sphereProps, "area", areaProps, 2.f, 4.f);
+
+        std::string meshFile = scenes + "/pa1/sphere.obj";
+        if (filesystem::path(meshFile).is_file()) {
+            meshProps.setString("filename", meshFile);
+            addCase("area-mesh", "obj", meshProps, "area", areaProps, 2.f, 4.f);
+        } else {
+            cerr << "Skipping \"area-mesh\" (mesh file not found)" << endl;
+        }
+
+        envProps.setString("envMapPath", envMap);
+        envSphereProps.setFloat("radius", 100.f);
+        addCase("environment", "sphere", envSphereProps, "environment", envProps, 0.f, 1.f);
+
+        std::vector<Point2f> samples = randomSamples(count, 5), refSamples = randomSamples(count, 6);
+        pcg32 random(PCG32_DEFAULT_STATE, 7);
+        std::vector<Timing> timings;
+        for (const EmitterCase &emitterCase : cases) {
+            /* Reference points in a spherical shell around the emitter */
+            std::vector<EmitterQueryRecord> records(count);
+            for (size_t i = 0; i < count; ++i) {
+                float distance = emitterCase.minDistance +
+                    (emitterCase.maxDistance - emitterCase.minDistance) * random.nextFloat();
+                Point3f ref(Warp::squareToUniformSphere(refSamples[i]) * distance);
+                records[i] = EmitterQueryRecord(ref);
+                records[i].shadowRay = Ray3f(ref, Vector3f(0.f, 0.f, 1.f));
+            }
+            const Emitter *emitter = emitterCase.emitter.get();
+
+            Timing timing;
+            timing.name = emitterCase.name;
+            timing.sample = timeCalls(count, [&](size_t i) {
+                EmitterQueryRecord lRec(records[i]);
+                return emitter->sample(lRec, samples[i]).x();
+            });
+
+            /* Evaluate the densities of the sampled points */
+            std::vector<EmitterQueryRecord> sampled(records);
+            for (size_t i = 0; i < count; ++i)
+                emitter->sample(sampled[i], samples[i]);
+            timing.eval = timeCalls(count, [&](size_t i) { return emitter->eval(sampled[i]).x(); });
+            timing.pdf = timeCalls(count, [&](size_t i) { return emitter->pdf(sampled[i]); });
+            timings.push_back(timing);
+        }
+        return timings;
+    }
+
+    std::string timingJSON(const std::vector<Timing> &timings) {
+        std::string result;
+        for (size_t i = 0; i < timings.size(); ++i) {
+            const Timing &timing = timings[i];
+            result += tfm::format("%s      { \"name\": %s", i > 0 ? ",\n" : "", jsonString(timing.name));
+            if (timing.sample >= 0)
+                result += tfm::format(", \"sampleNs\": %.3f", timing.sample);
+            if (timing.eval >= 0)
+                result += tfm::format(", \"evalNs\": %.3f", timing.eval);
+            if (timing.pdf >= 0)
+                result += tfm::format(", \"pdfNs\": %.3f", timing.pdf);
+            result += " }";
+        }
+        return result;
+    }
+
+    void printTimings(const std::string &title, const std::vector<Timing> &timings) {
+        cout << title << " (ns/call: sample / eval / pdf)" << endl;
+        auto format = [](double value) { return value >= 0 ? tfm::format("%8.2f", value) : std::string("       -"); };
+        for (const Timing &timing : timings)
+            cout << tfm::format("  %-20s %s %s %s", timing.name, format(timing.sample),
+                                format(timing.eval), format(timing.pdf)) << endl;
+    }
+
+    /// Time the shading routines, single-threaded over fixed random inputs
+    std::string benchmarkShading(const Options &options) {
+        std::string envMap = options.envMap;
+        bool temporaryEnvMap = envMap.empty();
+        if (temporaryEnvMap) {
+            envMap = "nori_bench_envmap.exr";
+            writeEnvironmentMap(envMap);
+        }
+
+        std::vector<Timing> warps = benchmarkWarps(options.callCount);
+        std::vector<Timing> bsdfs = benchmarkBSDFs(options.callCount);
+        std::vector<Timing> emitters;
+        try {
+            emitters = benchmarkEmitters(options.callCount, options.scenes, envMap);
+        } catch (...) {
+            if (temporaryEnvMap)
+                std::remove(envMap.c_str());
+            throw;
+        }
+        if (temporaryEnvMap)
+            std::remove(envMap.c_str());
+
+        printTimings("Warps", warps);
+        printTimings("BSDFs", bsdfs);
+        printTimings("Emitters", emitters);
+
+        return tfm::format(
+            "  \"shading\": {\n"
+            "    \"calls\": %i,\n"
+            "    \"warps\": [\n%s\n    ],\n"
+            "    \"bsdfs\": [\n%s\n    ],\n"
+            "    \"emitters\": [\n%s\n    ]\n"
+            "  }",
+            options.callCount, timingJSON(warps), timingJSON(bsdfs), timingJSON(emitters));
+    }
+
+    /// The bundled meshes (missing ones are skipped)
+    std::vector<MeshCase> defaultCases(const std::string &scenes) {
+        std::vector<MeshCase> cases = {
+            { "camelhead", { scenes + "/pa1/camelhead.obj" } },
+            { "sphere",    { scenes + "/pa1/sphere.obj" } },
+            { "cbox",      { scenes + "/pa4/cbox/meshes/walls.obj", scenes + "/pa4/cbox/meshes/leftwall.obj",
+                             scenes + "/pa4/cbox/meshes/rightwall.obj", scenes + "/pa4/cbox/meshes/light.obj" } },
+            { "sponza",    { scenes + "/pa1/sponza.obj" } }
+        };
+        std::vector<MeshCase> available;
+        for (const MeshCase &meshCase : cases) {
+            bool exists = true;
+            for (const std::string &file : meshCase.files)
+                exists &= filesystem::path(file).is_file();
+            if (exists)
+                available.push_back(meshCase);
+            else
+                cerr << "Skipping \"" << meshCase.name << "\" (mesh files not found)" << endl;
+        }
+        return available;
+    }
+
+    void printUsage(const char *name) {
+        cout << "Syntax: " << name << " [options] [mesh.obj ...]" << endl
+             << "Options:" << endl
+             << "  --suite <name>         Run \"rays\", \"shading\" or \"all\" (default: all)" << endl
+             << "  -n, --rays <count>     Rays per measurement (default: 1048576)" << endl
+             << "  -c, --calls <count>    Calls per shading measurement (default: 262144)" << endl
+             << "  --envmap <file.exr>    Environment map (default: a procedural sky)" << endl
+             << "  -t, --threads <count>  Number of threads (default: 1)" << endl
+             << "  -s, --scenes <dir>     Directory of the bundled scenes (default: scenes)" << endl
+             << "  -o, --output <file>    JSON output file (default: nori_bench.json)" << endl
+             << "Without mesh arguments, the bundled meshes are measured. The shading" << endl
+             << "suite always runs on one thread." << endl;
+    }
+};
+
+int main(int argc, char **argv) {
+    Options options;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "--suite" && hasValue)
+                options.suite = argv[++i];
+            else if ((arg == "-n" || arg == "--rays") && hasValue)
+                options.rayCount = (size_t) toUInt(argv[++i]);
+            else if ((arg == "-c" || arg == "--calls") && hasValue)
+                options.callCount = (size_t) toUInt(argv[++i]);
+            else if (arg == "--envmap" && hasValue)
+                options.envMap = argv[++i];
+            else if ((arg == "-t" || arg == "--threads") && hasValue)
+                options.threads = toInt(argv[++i]);
+            else if ((arg == "-s" || arg == "--scenes") && hasValue)
+                options.scenes = argv[++i];
+            else if ((arg == "-o" || arg == "--output") && hasValue)
+                options.output = argv[++i];
+            else if (arg == "-h" || arg == "--help") {
+                printUsage(argv[0]);
+                return 0;
+            } else if (!arg.empty() && arg[0] == '-') {
+                printUsage(argv[0]);
+                return -1;
+            } else {
+                options.meshes.push_back(arg);
+            }
+        }
+        if (options.threads < 1 || options.rayCount < 64 || options.callCount < 1)
+            throw NoriException("Invalid thread, ray or call count");
+        bool runRays = options.suite == "all" || options.suite == "rays";
+        bool runShading = options.suite == "all" || options.suite == "shading";
+        if (!runRays && !runShading)
+            throw NoriException("Unknown benchmark suite \"%s\"", options.suite);
+
+        tbb::task_scheduler_init init(options.threads);
+
+        std::string sections;
+        if (runRays) {
+            std::vector<MeshCase> cases;
+            if (options.meshes.empty()) {
+                cases = defaultCases(options.scenes);
+            } else {
+                for (const std::string &mesh : options.meshes)
+                    cases.push_back(MeshCase { mesh.substr(mesh.find_last_of("/\\") + 1), { mesh } });
+            }
+
+            std::string rays;
+            for (size_t i = 0; i < cases.size(); ++i)
+                rays += (i > 0 ? ",\n" : "") + benchmarkRays(cases[i], options);
+            sections += ",\n  \"rays\": [\n" + rays + "\n  ]";
+        }
+        if (runShading)
+            sections += ",\n" + benchmarkShading(options);
+
+        std::ofstream os(options.output);
+        if (os.fail())
+            throw NoriException("Unable to write \"%s\"", options.output);
+        os << "{\n"
+           << "  \"threads\": " << options.threads << ",\n"
+           << "  \"rayCount\": " << options.rayCount
+           << sections << "\n"
+           << "}\n";
+        cout << "Wrote \"" << options.output << "\"" << endl;
+    } catch (const std::exception &e) {
+        cerr << "Error: " << e.what() << endl;
+        return -1;
+    }
+    return 0;
+}
@@ -19,18 +19,115 @@
 #include <nori/bitmap.h>
 #include <ImfInputFile.h>
 #include <ImfOutputFile.h>
+#include <ImfTiledOutputFile.h>
 #include <ImfChannelList.h>
 #include <ImfStringAttribute.h>
 #include <ImfVersion.h>
 #include <ImfIO.h>
+#include <ImfThreading.h>
+#include <half.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_scheduler_init.h>
 
+#include <cstring>
 #include <memory>
+#include <mutex>
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image_write.h>
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_STATIC
+#include <nanogui/ext/nanovg/src/stb_image.h>
 
 NORI_NAMESPACE_BEGIN
 
+static float InverseGammaCorrect(float value) {
+    if (value <= 0.04045f) return value * (1.f / 12.92f);
+    return std::pow((value + 0.055f) * (1.f / 1.055f), 2.4f);
+}
+
+static float GammaCorrect(float value) {
+    if (value <= 0.0031308f) return 12.92f * value;
+    return 1.055f * std::pow(value, 1.f/2.4f) - 0.055f;
+}
+
+namespace {
+    /**
+     * sRGB encoding table for the range [2^-13, 1). Each of the 13 octaves
+     * is split into 4096 buckets by the leading mantissa bits, which keeps
+     * the error within one unit of the exact rounded result. Smaller values
+     * encode to zero anyway.
+     */
+    struct SRGB8Table {
+        static const uint32_t MinBits = 0x39000000; /* 2^-13 */
+        static const int Shift = 23 - 12;
+        uint8_t values[13 << 12];
+
+        SRGB8Table() {
+            for (uint32_t i = 0; i < sizeof(values); ++i) {
+                /* Evaluate the curve at the center of the bucket */
+                uint32_t bits = MinBits + (i << Shift) + (1u << (Shift - 1));
+                float value;
+                memcpy(&value, &bits, sizeof(float));
+                values[i] = (uint8_t) std::min(255.f * GammaCorrect(value) + 0.5f, 255.f);
+            }
+        }
+    };
+
+    const SRGB8Table &srgb8Table() {
+        static SRGB8Table table;
+        return table;
+    }
+
+    /// Number of rows handed to OpenEXR per write call
+    const int EXR_STRIP_ROWS = 256;
+
+    /// Tile resolution of tiled OpenEXR output
+    const int EXR_TILE_RES = 64;
+
+    /// Let OpenEXR compress blocks on as many threads as we render with
+    void initEXRThreads() {
+        static std::once_flag flag;
+        std::call_once(flag, [] {
+            Imf::setGlobalThreadCount(tbb::task_scheduler_init::default_num_threads());
+        });
+    }
+};
+
+uint8_t linearToSRGB8(float value) {
+    if (!(value >= 1.220703125e-4f)) /* 2^-13, also catches NaNs */
+        return 0;
+    if (value >= 1.f)
+        return 255;
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(float));
+    return srgb8Table().values[(bits - SRGB8Table::MinBits) >> SRGB8Table::Shift];
+}
+
+EXROptions::ECompression EXROptions::parseCompression(const std::string &name) {
+    std::string value = toLower(name);
+    if (value == "none")
+        return ENone;
+    else if (value == "zip")
+        return EZip;
+    else if (value == "piz")
+        return EPiz;
+    else if (value == "dwaa")
+        return EDwaa;
+    throw NoriException("Unknown OpenEXR compression \"%s\" (expected none, zip, piz or dwaa)", name);
+}
+
+std::string EXROptions::toString() const {
+    const char *compressionNames[] = { "none", "zip", "piz", "dwaa" };
+    return tfm::format("%s, %s, %s", halfPrecision ? "half" : "float",
+                       tiled ? "tiled" : "scanline", compressionNames[compression]);
+}
+
 Bitmap::Bitmap(const std::string &filename) {
+    if (!endsWith(toLower(filename), ".exr")) {
+        loadLDR(filename);
+        return;
+    }
+
     Imf::InputFile file(filename.c_str());
     const Imf::Header &header = file.header();
     const Imf::ChannelList &channels = header.channels();
@@ -79,62 +176,166 @@ Bitmap::Bitmap(const std::string &filename) {
     file.readPixels(dw.min.y, dw.max.y);
 }
 
-void Bitmap::save(const std::string &filename) {
-    cout << "Writing a " << cols() << "x" << rows() 
-         << " OpenEXR file to \"" << filename << "\"" << endl;
+void Bitmap::loadLDR(const std::string &filename) {
+    int width, height, comp;
+    bool hdr = stbi_is_hdr(filename.c_str()) != 0;
 
-    Imf::Header header((int) cols(), (int) rows());
+    /* Radiance HDR files are linear, all other formats are sRGB-encoded */
+    std::unique_ptr<float[], void(*)(void *)> hdrData(nullptr, stbi_image_free);
+    std::unique_ptr<uint8_t[], void(*)(void *)> ldrData(nullptr, stbi_image_free);
+    if (hdr)
+        hdrData.reset(stbi_loadf(filename.c_str(), &width, &height, &comp, 3));
+    else
+        ldrData.reset(stbi_load(filename.c_str(), &width, &height, &comp, 3));
+
+    if (!hdrData && !ldrData)
+        throw NoriException("Unable to load image \"%s\": %s", filename, stbi_failure_reason());
+
+    resize(height, width);
+    cout << "Reading a " << cols() << "x" << rows() << " image from \""
+         << filename << "\"" << endl;
+
+    float table[256];
+    for (int i = 0; i < 256; ++i)
+        table[i] = InverseGammaCorrect(i / 255.f);
+
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            size_t i = 3 * ((size_t) y * width + x);
+            if (hdr)
+                coeffRef(y, x) = Color3f(hdrData[i], hdrData[i + 1], hdrData[i + 2]);
+            else
+                coeffRef(y, x) = Color3f(table[ldrData[i]], table[ldrData[i + 1]], table[ldrData[i + 2]]);
+        }
+    }
+}
+
+void Bitmap::save(const std::string &filename, const EXROptions &options) {
+    cout << "Writing a " << cols() << "x" << rows()
+         << " OpenEXR file to \"" << filename << "\" (" << options.toString();
+    for (const Layer &layer : m_layers)
+        cout << ", +" << layer.name;
+    cout << ")" << endl;
+
+    initEXRThreads();
+
+    int width = (int) cols(), height = (int) rows();
+    Imf::Header header(width, height);
     header.insert("comments", Imf::StringAttribute("Generated by Nori"));
 
+    switch (options.compression) {
+        case EXROptions::ENone: header.compression() = Imf::NO_COMPRESSION; break;
+        case EXROptions::EZip:  header.compression() = Imf::ZIP_COMPRESSION; break;
+        case EXROptions::EPiz:  header.compression() = Imf::PIZ_COMPRESSION; break;
+        case EXROptions::EDwaa: header.compression() = Imf::DWAA_COMPRESSION; break;
+    }
+
+    /* All channels of the file: the RGB values followed by the layers */
+    struct Plane {
+        std::string name;
+        const float *data;
+        int stride;
+        Imf::PixelType type;
+    };
+    std::vector<Plane> planes;
+    Imf::PixelType type = options.halfPrecision ? Imf::HALF : Imf::FLOAT;
+    const float *rgb = reinterpret_cast<const float *>(data());
+    planes.push_back(Plane { "R", rgb, 3, type });
+    planes.push_back(Plane { "G", rgb + 1, 3, type });
+    planes.push_back(Plane { "B", rgb + 2, 3, type });
+    for (const Layer &layer : m_layers) {
+        int stride = (int) layer.channels.size();
+        for (int ch = 0; ch < stride; ++ch)
+            planes.push_back(Plane { layer.name + "." + layer.channels[ch], layer.data.data() + ch,
+                                     stride, layer.fullPrecision ? Imf::FLOAT : type });
+    }
+
+    int halfPlanes = 0;
     Imf::ChannelList &channels = header.channels();
-    channels.insert("R", Imf::Channel(Imf::FLOAT));
-    channels.insert("G", Imf::Channel(Imf::FLOAT));
-    channels.insert("B", Imf::Channel(Imf::FLOAT));
+    for (const Plane &plane : planes) {
+        channels.insert(plane.name.c_str(), Imf::Channel(plane.type));
+        halfPlanes += plane.type == Imf::HALF ? 1 : 0;
+    }
 
-    Imf::FrameBuffer frameBuffer;
-    size_t compStride = sizeof(float),
-           pixelStride = 3 * compStride,
-           rowStride = pixelStride * cols();
+    if (options.tiled)
+        header.setTileDescription(Imf::TileDescription(EXR_TILE_RES, EXR_TILE_RES, Imf::ONE_LEVEL));
 
-    char *ptr = reinterpret_cast<char *>(data());
-    frameBuffer.insert("R", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
-    frameBuffer.insert("G", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
-    frameBuffer.insert("B", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); 
+    /* Half channels are converted one strip at a time, so that the
+       temporary buffer stays small even for very large images */
+    size_t stripPlaneSize = (size_t) width * std::min(EXR_STRIP_ROWS, height);
+    std::unique_ptr<half[]> strip(new half[stripPlaneSize * halfPlanes]);
 
-    Imf::OutputFile file(filename.c_str(), header);
-    file.setFrameBuffer(frameBuffer);
-    file.writePixels((int) rows());
-}
+    /* Frame buffer exposing rows [y0, y1) */
+    auto stripFrameBuffer = [&](int y0, int y1) {
+        tbb::parallel_for(y0, y1, [&](int y) {
+            half *target = strip.get() + (size_t) width * (y - y0);
+            for (const Plane &plane : planes) {
+                if (plane.type != Imf::HALF)
+                    continue;
+                const float *source = plane.data + (size_t) plane.stride * width * y;
+                for (int x = 0; x < width; ++x)
+                    target[x] = source[plane.stride * x];
+                target += stripPlaneSize;
+            }
+        });
 
-static float GammaCorrect(float value) {
-    if (value <= 0.0031308f) return 12.92f * value;
-    return 1.055f * std::pow(value, 1.f/2.4f) - 0.055f;
+        Imf::FrameBuffer frameBuffer;
+        half *halfPlane = strip.get();
+        for (const Plane &plane : planes) {
+            if (plane.type == Imf::HALF) {
+                /* OpenEXR addresses slices with absolute row indices */
+                char *base = reinterpret_cast<char *>(halfPlane) - (ptrdiff_t) y0 * width * sizeof(half);
+                frameBuffer.insert(plane.name.c_str(), Imf::Slice(Imf::HALF, base, sizeof(half), width * sizeof(half)));
+                halfPlane += stripPlaneSize;
+            } else {
+                char *base = reinterpret_cast<char *>(const_cast<float *>(plane.data));
+                size_t pixelStride = plane.stride * sizeof(float);
+                frameBuffer.insert(plane.name.c_str(), Imf::Slice(Imf::FLOAT, base, pixelStride, pixelStride * width));
+            }
+        }
+        return frameBuffer;
+    };
+
+    if (options.tiled) {
+        Imf::TiledOutputFile file(filename.c_str(), header);
+        int tileRowsPerStrip = std::max(1, EXR_STRIP_ROWS / EXR_TILE_RES);
+        for (int ty = 0; ty < file.numYTiles(); ty += tileRowsPerStrip) {
+            int ty1 = std::min(ty + tileRowsPerStrip, file.numYTiles());
+            file.setFrameBuffer(stripFrameBuffer(ty * EXR_TILE_RES, std::min(ty1 * EXR_TILE_RES, height)));
+            file.writeTiles(0, file.numXTiles() - 1, ty, ty1 - 1);
+        }
+    } else {
+        Imf::OutputFile file(filename.c_str(), header);
+        for (int y = 0; y < height; y += EXR_STRIP_ROWS) {
+            int y1 = std::min(y + EXR_STRIP_ROWS, height);
+            file.setFrameBuffer(stripFrameBuffer(y, y1));
+            file.writePixels(y1 - y);
+        }
+    }
 }
-static float Clamp(float val, float low, float high) {
-    if (val < low)
-        return low;
-    else if (val > high)
-        return high;
-    else
-        return val;
+
+float *Bitmap::addLayer(const std::string &name, const std::vector<std::string> &channels, bool fullPrecision) {
+    Layer layer;
+    layer.name = name;
+    layer.channels = channels;
+    layer.data.resize((size_t) channels.size() * cols() * rows(), 0.f);
+    layer.fullPrecision = fullPrecision;
+    m_layers.push_back(std::move(layer));
+    return m_layers.back().data.data();
 }
 
 void Bitmap::saveToLDR(const std::string &filename) {
     cout << "Writing a " << cols() << "x" << rows()
     << " PNG file to \"" << filename << "\"" << endl;
 
+    int width = (int) cols();
     std::unique_ptr<uint8_t[]> rgb8(new uint8_t[3 * cols() * rows()]);
-    uint8_t *dst = rgb8.get();
-    for (int y = 0; y < rows(); ++y) {
-        for (int x = 0; x < cols(); ++x) {
-#define TO_BYTE(v) (uint8_t) Clamp(255.f * GammaCorrect(v) + 0.5f, 0.f, 255.f)
-            dst[0] = TO_BYTE(coeff(y,x).r());
-            dst[1] = TO_BYTE(coeff(y,x).g());
-            dst[2] = TO_BYTE(coeff(y,x).b());
-#undef TO_BYTE
-            dst += 3;
-        }
-    }
+    tbb::parallel_for(0, (int) rows(), [&](int y) {
+        const float *source = reinterpret_cast<const float *>(data()) + (size_t) 3 * width * y;
+        uint8_t *target = rgb8.get() + (size_t) 3 * width * y;
+        for (int i = 0; i < 3 * width; ++i)
+            target[i] = linearToSRGB8(source[i]);
+    });
     stbi_write_png(filename.c_str(),cols(),rows(),3,rgb8.get(),3*cols());
 }
 
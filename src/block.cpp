@@ -30,8 +30,6 @@ ImageBlock::ImageBlock(const Vector2i &size, const ReconstructionFilter *filter)
 
 ImageBlock::~ImageBlock() {
     delete[] m_filter;
-    delete[] m_weightsX;
-    delete[] m_weightsY;
 }
 
 
@@ -43,13 +41,11 @@ void ImageBlock::init(const Vector2i &size, const ReconstructionFilter *filter)
     m_lookupFactor = 0;
     m_blockId = 0;
 
+    m_boxFilter = false;
+
     if(m_filter) {
         delete[] m_filter;
-        delete[] m_weightsX;
-        delete[] m_weightsY;
         m_filter = nullptr;
-        m_weightsX = nullptr;
-        m_weightsY = nullptr;
     }
     if (filter) {
         /* Tabulate the image reconstruction filter for performance reasons */
@@ -62,15 +58,24 @@ void ImageBlock::init(const Vector2i &size, const ReconstructionFilter *filter)
         }
         m_filter[NORI_FILTER_RESOLUTION] = 0.0f;
         m_lookupFactor = NORI_FILTER_RESOLUTION / m_filterRadius;
-        int weightSize = (int) std::ceil(2*m_filterRadius) + 1;
-        m_weightsX = new float[weightSize];
-        m_weightsY = new float[weightSize];
-        memset(m_weightsX, 0, sizeof(float) * weightSize);
-        memset(m_weightsY, 0, sizeof(float) * weightSize);
+        if ((int) std::ceil(2*m_filterRadius) + 1 > MaxFilterTaps)
+            throw NoriException("ImageBlock: the reconstruction filter radius %f is too large", m_filterRadius);
+
+        /* A constant filter that fits within one pixel only ever touches the pixel containing the sample */
+        m_boxFilter = m_filterRadius <= 0.5f &&
+            std::all_of(m_filter, m_filter + NORI_FILTER_RESOLUTION, [&](float v) { return v == m_filter[0]; });
     }
 
     /* Allocate space for pixels and border regions */
     resize(size.y() + 2*m_borderSize, size.x() + 2*m_borderSize);
+    m_aovs.assign((size_t) rows() * cols() * m_aovStride, 0.f);
+    markDirty();
+}
+
+void ImageBlock::setAOVLayout(const AOVLayout &layout) {
+    m_aovLayout = layout;
+    m_aovStride = layout.empty() ? 0 : layout.getChannelCount() + 1;
+    m_aovs.assign((size_t) rows() * cols() * m_aovStride, 0.f);
 }
 
 Bitmap *ImageBlock::toBitmap() const {
@@ -78,6 +83,37 @@ Bitmap *ImageBlock::toBitmap() const {
     for (int y=0; y<m_size.y(); ++y)
         for (int x=0; x<m_size.x(); ++x)
             result->coeffRef(y, x) = coeff(y + m_borderSize, x + m_borderSize).divideByFilterWeight();
+
+    for (int i = 0; i < m_aovLayout.size(); ++i) {
+        AOVLayout::EType type = m_aovLayout.getType(i);
+        AOVLayout::EReconstruction reconstruction = AOVLayout::getReconstruction(type);
+        int channelCount = AOVLayout::getChannelCount(type), offset = m_aovLayout.getOffset(i);
+
+        std::vector<std::string> channels;
+        if (channelCount == 3)
+            channels = { "R", "G", "B" };
+        else
+            channels.push_back(type == AOVLayout::EDepth ? "Z" : "id");
+
+        float *target = result->addLayer(AOVLayout::getName(type), channels,
+                                         reconstruction == AOVLayout::EFirst);
+        for (int y=0; y<m_size.y(); ++y) {
+            for (int x=0; x<m_size.x(); ++x) {
+                const Color4f &pixel = coeff(y + m_borderSize, x + m_borderSize);
+                const float *source = &m_aovs[((size_t) (y + m_borderSize) * cols() + x + m_borderSize) * m_aovStride];
+                float sampleCount = source[m_aovStride - 1];
+                for (int ch = 0; ch < channelCount; ++ch, ++target) {
+                    float value = source[offset + ch];
+                    if (reconstruction == AOVLayout::EFiltered)
+                        *target = pixel.w() != 0 ? value / pixel.w() : 0.f;
+                    else if (reconstruction == AOVLayout::EBox)
+                        *target = sampleCount > 0 ? value / sampleCount : 0.f;
+                    else
+                        *target = value - 1; /* Stored with an offset of one, so that zero means unset */
+                }
+            }
+        }
+    }
     return result;
 }
 
@@ -88,9 +124,10 @@ void ImageBlock::fromBitmap(const Bitmap &bitmap) {
     for (int y=0; y<m_size.y(); ++y)
         for (int x=0; x<m_size.x(); ++x)
             coeffRef(y, x) << bitmap.coeff(y, x), 1;
+    markDirty();
 }
 
-void ImageBlock::put(const Point2f &_pos, const Color3f &value) {
+void ImageBlock::put(const Point2f &_pos, const Color3f &value, const float *aovs) {
     if (!value.isValid()) {
         /* If this happens, go fix your code instead of removing this warning ;) */
         cerr << "Integrator: computed an invalid radiance value: " << value.toString() << endl;
@@ -103,22 +140,85 @@ void ImageBlock::put(const Point2f &_pos, const Color3f &value) {
         _pos.y() - 0.5f - (m_offset.y() - m_borderSize)
     );
 
-    /* Compute the rectangle of pixels that will need to be updated */
-    BoundingBox2i bbox(
-        Point2i((int)  std::ceil(pos.x() - m_filterRadius), (int)  std::ceil(pos.y() - m_filterRadius)),
-        Point2i((int) std::floor(pos.x() + m_filterRadius), (int) std::floor(pos.y() + m_filterRadius))
-    );
-    bbox.clip(BoundingBox2i(Point2i(0, 0), Point2i((int) cols() - 1, (int) rows() - 1)));
+    /* Filter weights live on the stack, so that put() can be called concurrently on different blocks */
+    float weightsX[MaxFilterTaps], weightsY[MaxFilterTaps];
+    BoundingBox2i bbox;
+    const Color4f sample(value);
+
+    if (m_boxFilter) {
+        /* Fast path: the sample only covers the pixel it lies in */
+        Point2i p((int) std::floor(pos.x() + 0.5f), (int) std::floor(pos.y() + 0.5f));
+        if (p.x() < 0 || p.y() < 0 || p.x() >= cols() || p.y() >= rows())
+            return;
+        coeffRef(p.y(), p.x()) += sample;
+        bbox = BoundingBox2i(p, p);
+        weightsX[0] = weightsY[0] = 1.f;
+    } else {
+        /* Compute the rectangle of pixels that will need to be updated */
+        bbox = BoundingBox2i(
+            Point2i((int)  std::ceil(pos.x() - m_filterRadius), (int)  std::ceil(pos.y() - m_filterRadius)),
+            Point2i((int) std::floor(pos.x() + m_filterRadius), (int) std::floor(pos.y() + m_filterRadius))
+        );
+        bbox.clip(BoundingBox2i(Point2i(0, 0), Point2i((int) cols() - 1, (int) rows() - 1)));
+
+        /* Lookup values from the pre-rasterized filter */
+        for (int x=bbox.min.x(), idx = 0; x<=bbox.max.x(); ++x)
+            weightsX[idx++] = m_filter[(int) (std::abs(x-pos.x()) * m_lookupFactor)];
+        for (int y=bbox.min.y(), idx = 0; y<=bbox.max.y(); ++y)
+            weightsY[idx++] = m_filter[(int) (std::abs(y-pos.y()) * m_lookupFactor)];
+
+        /* The filter is separable: scale the sample once per row, leaving a
+           single 4-wide multiply-add (one SSE operation) per pixel */
+        for (int y=bbox.min.y(), yr=0; y<=bbox.max.y(); ++y, ++yr) {
+            const Color4f rowSample = sample * weightsY[yr];
+            Color4f *row = &coeffRef(y, 0);
+            for (int x=bbox.min.x(), xr=0; x<=bbox.max.x(); ++x, ++xr)
+                row[x] += rowSample * weightsX[xr];
+        }
+    }
 
-    /* Lookup values from the pre-rasterized filter */
-    for (int x=bbox.min.x(), idx = 0; x<=bbox.max.x(); ++x)
-        m_weightsX[idx++] = m_filter[(int) (std::abs(x-pos.x()) * m_lookupFactor)];
-    for (int y=bbox.min.y(), idx = 0; y<=bbox.max.y(); ++y)
-        m_weightsY[idx++] = m_filter[(int) (std::abs(y-pos.y()) * m_lookupFactor)];
+    if (!aovs || m_aovStride == 0)
+        return;
 
-    for (int y=bbox.min.y(), yr=0; y<=bbox.max.y(); ++y, ++yr) 
-        for (int x=bbox.min.x(), xr=0; x<=bbox.max.x(); ++x, ++xr) 
-            coeffRef(y, x) += Color4f(value) * m_weightsX[xr] * m_weightsY[yr];
+    /* Filtered AOVs are splatted with the same weights as the radiance */
+    for (int i = 0; i < m_aovLayout.size(); ++i) {
+        AOVLayout::EType type = m_aovLayout.getType(i);
+        if (AOVLayout::getReconstruction(type) != AOVLayout::EFiltered)
+            continue;
+        int channelCount = AOVLayout::getChannelCount(type), offset = m_aovLayout.getOffset(i);
+        for (int y=bbox.min.y(), yr=0; y<=bbox.max.y(); ++y, ++yr) {
+            for (int x=bbox.min.x(), xr=0; x<=bbox.max.x(); ++x, ++xr) {
+                float weight = weightsX[xr] * weightsY[yr];
+                float *target = &m_aovs[((size_t) y * cols() + x) * m_aovStride + offset];
+                for (int ch = 0; ch < channelCount; ++ch)
+                    target[ch] += weight * aovs[offset + ch];
+            }
+        }
+    }
+
+    /* The remaining AOVs only go to the pixel containing the sample */
+    int px = (int) std::floor(_pos.x()) - m_offset.x() + m_borderSize,
+        py = (int) std::floor(_pos.y()) - m_offset.y() + m_borderSize;
+    if (px < 0 || py < 0 || px >= cols() || py >= rows())
+        return;
+    float *pixel = &m_aovs[((size_t) py * cols() + px) * m_aovStride];
+    for (int i = 0; i < m_aovLayout.size(); ++i) {
+        AOVLayout::EType type = m_aovLayout.getType(i);
+        int channelCount = AOVLayout::getChannelCount(type), offset = m_aovLayout.getOffset(i);
+        switch (AOVLayout::getReconstruction(type)) {
+            case AOVLayout::EBox:
+                for (int ch = 0; ch < channelCount; ++ch)
+                    pixel[offset + ch] += aovs[offset + ch];
+                break;
+            case AOVLayout::EFirst:
+                if (pixel[offset] == 0)
+                    pixel[offset] = aovs[offset] + 1;
+                break;
+            default:
+                break;
+        }
+    }
+    pixel[m_aovStride - 1] += 1;
 }
     
 void ImageBlock::put(ImageBlock &b) {
@@ -130,6 +230,42 @@ void ImageBlock::put(ImageBlock &b) {
 
     block(offset.y(), offset.x(), size.y(), size.x()) 
         += b.topLeftCorner(size.y(), size.x());
+
+    /* Remember the changed pixels for incremental preview updates. Once the
+       regions cover more than the block, it is cheaper to update everything */
+    if (!m_allDirty) {
+        Point2i min = (offset - Vector2i::Constant(m_borderSize)).cwiseMax(Point2i(0, 0));
+        Point2i max = (offset + size - Vector2i::Constant(m_borderSize)).cwiseMin(Point2i(m_size));
+        if ((max.array() > min.array()).all()) {
+            m_dirtyRegions.push_back(BoundingBox2i(min, max));
+            m_dirtyArea += (int64_t) (max.x() - min.x()) * (max.y() - min.y());
+            if (m_dirtyArea > (int64_t) m_size.x() * m_size.y())
+                markDirty();
+        }
+    }
+
+    if (m_aovStride == 0 || b.m_aovStride != m_aovStride)
+        return;
+
+    for (int y = 0; y < size.y(); ++y) {
+        for (int x = 0; x < size.x(); ++x) {
+            const float *source = &b.m_aovs[((size_t) y * b.cols() + x) * m_aovStride];
+            float *target = &m_aovs[((size_t) (y + offset.y()) * cols() + x + offset.x()) * m_aovStride];
+            for (int i = 0; i < m_aovLayout.size(); ++i) {
+                AOVLayout::EType type = m_aovLayout.getType(i);
+                int channelCount = AOVLayout::getChannelCount(type), o = m_aovLayout.getOffset(i);
+                if (AOVLayout::getReconstruction(type) == AOVLayout::EFirst) {
+                    /* Identifiers cannot be averaged: the first sample wins */
+                    if (target[o] == 0)
+                        target[o] = source[o];
+                } else {
+                    for (int ch = 0; ch < channelCount; ++ch)
+                        target[o + ch] += source[o + ch];
+                }
+            }
+            target[m_aovStride - 1] += source[m_aovStride - 1];
+        }
+    }
 }
 
 std::string ImageBlock::toString() const {
@@ -0,0 +1,264 @@
+#include <nori/brickgrid.h>
+#include <nori/mmap.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_sort.h>
+#include <tbb/blocked_range.h>
+#include <tbb/mutex.h>
+#include <fstream>
+#include <cstring>
+
+NORI_NAMESPACE_BEGIN
+
+namespace {
+    /// Header of a brick grid cache file
+    struct BrickGridHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t precision;
+        int32_t min[3];
+        int32_t size[3];
+        uint32_t storedBricks;
+        float minValue, maxValue;
+        uint32_t padding;
+        uint64_t sourceStamp;
+    };
+
+    const char BRICKGRID_MAGIC[8] = "NORIBRK";
+    const uint32_t BRICKGRID_VERSION = 1;
+
+    /// Interleave the lower 10 bits of \c v with two zero bits each
+    inline uint32_t spreadBits(uint32_t v) {
+        v &= 0x3FF;
+        v = (v | (v << 16)) & 0x030000FF;
+        v = (v | (v << 8)) & 0x0300F00F;
+        v = (v | (v << 4)) & 0x030C30C3;
+        v = (v | (v << 2)) & 0x09249249;
+        return v;
+    }
+
+    inline uint64_t mortonCode(uint32_t x, uint32_t y, uint32_t z) {
+        /* Split into two 10-bit halves so that grids with up to 2^20
+           bricks per axis still produce a meaningful ordering */
+        uint64_t lo = spreadBits(x) | (spreadBits(y) << 1) | (spreadBits(z) << 2);
+        uint64_t hi = spreadBits(x >> 10) | (spreadBits(y >> 10) << 1) | (spreadBits(z >> 10) << 2);
+        return (hi << 30) | lo;
+    }
+};
+
+BrickGrid::BrickGrid() { }
+
+BrickGrid::~BrickGrid() { }
+
+void BrickGrid::build(const Point3i &min, const Vector3i &size, EPrecision precision, const BrickFunctor &fill) {
+    if ((size.array() <= 0).any())
+        throw NoriException("BrickGrid::build(): invalid grid size %s", size.toString());
+
+    m_file.reset();
+    m_min = min;
+    m_size = size;
+    m_precision = precision;
+    m_brickCount = ((size.array() + BRICK_RES - 1) / BRICK_RES).matrix();
+
+    uint32_t brickCount = (uint32_t) (m_brickCount.x() * m_brickCount.y() * m_brickCount.z());
+
+    /* First pass: find the non-empty bricks and the value range */
+    std::vector<uint8_t> occupied(brickCount, 0);
+    float minValue = std::numeric_limits<float>::infinity(),
+          maxValue = -std::numeric_limits<float>::infinity();
+    tbb::mutex rangeMutex;
+
+    auto brickOrigin = [&](uint32_t index) {
+        int bx = (int) (index % m_brickCount.x()),
+            by = (int) ((index / m_brickCount.x()) % m_brickCount.y()),
+            bz = (int) (index / (m_brickCount.x() * m_brickCount.y()));
+        return Point3i(min.x() + bx * BRICK_RES, min.y() + by * BRICK_RES, min.z() + bz * BRICK_RES);
+    };
+
+    auto brickVoxelInside = [&](const Point3i &origin, int i) {
+        int x = origin.x() + i % BRICK_RES,
+            y = origin.y() + (i / BRICK_RES) % BRICK_RES,
+            z = origin.z() + i / (BRICK_RES * BRICK_RES);
+        return x < min.x() + size.x() && y < min.y() + size.y() && z < min.z() + size.z();
+    };
+
+    tbb::parallel_for(tbb::blocked_range<uint32_t>(0, brickCount),
+        [&](const tbb::blocked_range<uint32_t> &range) {
+            float values[BRICK_VOXELS];
+            float localMin = std::numeric_limits<float>::infinity(),
+                  localMax = -std::numeric_limits<float>::infinity();
+            for (uint32_t index = range.begin(); index != range.end(); ++index) {
+                Point3i origin = brickOrigin(index);
+                fill(origin, values);
+                bool empty = true;
+                for (int i = 0; i < BRICK_VOXELS; ++i) {
+                    if (!brickVoxelInside(origin, i))
+                        continue;
+                    localMin = std::min(localMin, values[i]);
+                    localMax = std::max(localMax, values[i]);
+                    if (values[i] != 0.f)
+                        empty = false;
+                }
+                occupied[index] = empty ? 0 : 1;
+            }
+            tbb::mutex::scoped_lock lock(rangeMutex);
+            minValue = std::min(minValue, localMin);
+            maxValue = std::max(maxValue, localMax);
+        }
+    );
+
+    /* Order the non-empty bricks along a Z-curve */
+    std::vector<std::pair<uint64_t, uint32_t>> order;
+    for (uint32_t index = 0; index < brickCount; ++index) {
+        if (!occupied[index])
+            continue;
+        uint32_t bx = index % m_brickCount.x(),
+                 by = (index / m_brickCount.x()) % m_brickCount.y(),
+                 bz = index / (m_brickCount.x() * m_brickCount.y());
+        order.push_back(std::make_pair(mortonCode(bx, by, bz), index));
+    }
+    tbb::parallel_sort(order.begin(), order.end());
+
+    m_storedBricks = (uint32_t) order.size();
+    m_minValue = minValue;
+    m_maxValue = maxValue;
+
+    m_ownedTable.assign(brickCount, EMPTY_BRICK);
+    for (uint32_t i = 0; i < m_storedBricks; ++i)
+        m_ownedTable[order[i].second] = i;
+
+    /* Second pass: copy the values of the non-empty bricks */
+    size_t brickBytes = valueSize() * BRICK_VOXELS;
+    m_ownedData.assign(brickBytes * m_storedBricks, 0);
+
+    tbb::parallel_for(tbb::blocked_range<uint32_t>(0, m_storedBricks),
+        [&](const tbb::blocked_range<uint32_t> &range) {
+            float values[BRICK_VOXELS];
+            for (uint32_t slot = range.begin(); slot != range.end(); ++slot) {
+                Point3i origin = brickOrigin(order[slot].second);
+                fill(origin, values);
+                for (int i = 0; i < BRICK_VOXELS; ++i) {
+                    if (!brickVoxelInside(origin, i))
+                        values[i] = 0.f;
+                }
+                uint8_t *target = m_ownedData.data() + brickBytes * slot;
+                if (m_precision == EFloat16) {
+                    half *dst = reinterpret_cast<half *>(target);
+                    for (int i = 0; i < BRICK_VOXELS; ++i)
+                        dst[i] = half(values[i]);
+                } else {
+                    memcpy(target, values, brickBytes);
+                }
+            }
+        }
+    );
+
+    m_brickTable = m_ownedTable.data();
+    m_data = m_ownedData.data();
+}
+
+void BrickGrid::save(const std::string &filename, uint64_t sourceStamp) const {
+    BrickGridHeader header;
+    memset(&header, 0, sizeof(BrickGridHeader));
+    memcpy(header.magic, BRICKGRID_MAGIC, sizeof(header.magic));
+    header.version = BRICKGRID_VERSION;
+    header.precision = (uint32_t) m_precision;
+    for (int i = 0; i < 3; ++i) {
+        header.min[i] = m_min[i];
+        header.size[i] = m_size[i];
+    }
+    header.storedBricks = m_storedBricks;
+    header.minValue = m_minValue;
+    header.maxValue = m_maxValue;
+    header.sourceStamp = sourceStamp;
+
+    std::ofstream os(filename, std::ios::binary);
+    if (os.fail())
+        throw NoriException("BrickGrid::save(): unable to open \"%s\" for writing", filename);
+
+    size_t brickCount = (size_t) m_brickCount.x() * m_brickCount.y() * m_brickCount.z();
+    os.write(reinterpret_cast<const char *>(&header), sizeof(BrickGridHeader));
+    os.write(reinterpret_cast<const char *>(m_brickTable), sizeof(uint32_t) * brickCount);
+    os.write(reinterpret_cast<const char *>(m_data), valueSize() * BRICK_VOXELS * m_storedBricks);
+
+    if (os.fail())
+        throw NoriException("BrickGrid::save(): error while writing \"%s\"", filename);
+}
+
+bool BrickGrid::load(const std::string &filename, uint64_t sourceStamp) {
+    std::unique_ptr<MemoryMappedFile> file;
+    try {
+        file.reset(new MemoryMappedFile(filename));
+    } catch (const NoriException &) {
+        return false;
+    }
+
+    if (file->size() < sizeof(BrickGridHeader))
+        return false;
+
+    BrickGridHeader header;
+    memcpy(&header, file->data(), sizeof(BrickGridHeader));
+    if (memcmp(header.magic, BRICKGRID_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != BRICKGRID_VERSION || header.sourceStamp != sourceStamp ||
+        header.precision > (uint32_t) EFloat16)
+        return false;
+
+    Point3i min(header.min[0], header.min[1], header.min[2]);
+    Vector3i size(header.size[0], header.size[1], header.size[2]);
+    if ((size.array() <= 0).any())
+        return false;
+
+    EPrecision precision = (EPrecision) header.precision;
+    Vector3i brickCount = ((size.array() + BRICK_RES - 1) / BRICK_RES).matrix();
+    size_t tableEntries = (size_t) brickCount.x() * brickCount.y() * brickCount.z();
+    size_t valueBytes = precision == EFloat16 ? sizeof(half) : sizeof(float);
+    size_t expected = sizeof(BrickGridHeader) + sizeof(uint32_t) * tableEntries +
+        valueBytes * BRICK_VOXELS * header.storedBricks;
+    if (file->size() != expected)
+        return false;
+
+    m_min = min;
+    m_size = size;
+    m_brickCount = brickCount;
+    m_precision = precision;
+    m_storedBricks = header.storedBricks;
+    m_minValue = header.minValue;
+    m_maxValue = header.maxValue;
+
+    /* The header size is a multiple of 8, so both arrays are suitably aligned */
+    m_brickTable = reinterpret_cast<const uint32_t *>(file->data() + sizeof(BrickGridHeader));
+    m_data = file->data() + sizeof(BrickGridHeader) + sizeof(uint32_t) * tableEntries;
+
+    m_ownedTable.clear();
+    m_ownedTable.shrink_to_fit();
+    m_ownedData.clear();
+    m_ownedData.shrink_to_fit();
+    m_file = std::move(file);
+    return true;
+}
+
+size_t BrickGrid::getMemoryUsage() const {
+    return sizeof(uint32_t) * (size_t) m_brickCount.x() * m_brickCount.y() * m_brickCount.z() +
+        valueSize() * BRICK_VOXELS * (size_t) m_storedBricks;
+}
+
+std::string BrickGrid::toString() const {
+    size_t brickCount = (size_t) m_brickCount.x() * m_brickCount.y() * m_brickCount.z();
+    return tfm::format(
+        "BrickGrid[\n"
+        "  min = %s,\n"
+        "  size = %s,\n"
+        "  precision = %s,\n"
+        "  bricks = %i/%i,\n"
+        "  memory = %s,\n"
+        "  mapped = %s\n"
+        "]",
+        m_min.toString(),
+        m_size.toString(),
+        m_precision == EFloat16 ? "half" : "float",
+        m_storedBricks, brickCount,
+        memString(getMemoryUsage()),
+        m_file ? m_file->getFilename() : "no"
+    );
+}
+
+NORI_NAMESPACE_END
@@ -18,6 +18,9 @@
 
 #include <nori/bvh.h>
 #include <nori/timer.h>
+#include <nori/snapshot.h>
+#include <nori/stats.h>
+#include <nori/trace.h>
 #include <tbb/tbb.h>
 #include <Eigen/Geometry>
 #include <atomic>
@@ -330,6 +333,18 @@ void BVH::build() {
     uint32_t size  = getPrimitiveCount();
     if (size == 0)
         return;
+
+    /* Reuse the tree stored in a scene snapshot */
+    Snapshot *snapshot = Snapshot::active();
+    std::string snapshotKey = snapshot ? snapshot->nextKey("bvh") : std::string();
+    if (snapshot && snapshot->getVector(snapshotKey + ".nodes", m_nodes) &&
+        snapshot->getVector(snapshotKey + ".indices", m_indices)) {
+        if (m_indices.size() != size || m_nodes.empty())
+            throw NoriException("BVH: the scene snapshot does not match the scene geometry");
+        return;
+    }
+
+    NORI_TRACE_SCOPE("load", "BVH build");
     cout << "Constructing a SAH BVH (" << m_shapes.size()
         << (m_shapes.size() == 1 ? " shape, " : " shapes, ")
         << size << " primitives) .. ";
@@ -379,6 +394,11 @@ void BVH::build() {
         << ")." << endl;
 
     m_nodes = std::move(compactified);
+
+    if (snapshot && !snapshot->isReading()) {
+        snapshot->putVector(snapshotKey + ".nodes", m_nodes);
+        snapshot->putVector(snapshotKey + ".indices", m_indices);
+    }
 }
 
 std::pair<float, uint32_t> BVH::statistics(uint32_t node_idx) const {
@@ -401,9 +421,19 @@ std::pair<float, uint32_t> BVH::statistics(uint32_t node_idx) const {
     }
 }
 
+NORI_STAT_COUNTER(statClosestRays, "BVH", "Closest-hit rays");
+NORI_STAT_COUNTER(statShadowRays, "BVH", "Shadow rays");
+NORI_STAT_RATIO(statNodesPerRay, "BVH", "Nodes visited per ray");
+NORI_STAT_RATIO(statTrianglesPerRay, "BVH", "Primitives tested per ray");
+NORI_STAT_COUNTER(statPacketRays, "BVH", "Rays in packets");
+NORI_STAT_RATIO(statNodesPerPacket, "BVH", "Nodes visited per packet");
+
 bool BVH::rayIntersect(const Ray3f &_ray, Intersection &its, bool shadowRay) const {
     uint32_t node_idx = 0, stack_idx = 0, stack[64];
 
+    NORI_STAT_ADD(shadowRay ? statShadowRays : statClosestRays, 1);
+    NORI_STAT_ONLY(uint32_t visitedNodes = 0, testedPrimitives = 0);
+
     its.t = std::numeric_limits<float>::infinity();
 
     /* Use an adaptive ray epsilon */
@@ -415,10 +445,11 @@ bool BVH::rayIntersect(const Ray3f &_ray, Intersection &its, bool shadowRay) con
         return false;
 
     bool foundIntersection = false;
-    uint32_t f = 0;
+    uint32_t f = 0, prim = 0;
 
     while (true) {
         const BVHNode &node = m_nodes[node_idx];
+        NORI_STAT_ONLY(++visitedNodes);
 
         if (!node.bbox.rayIntersect(ray)) {
             if (stack_idx == 0)
@@ -437,14 +468,19 @@ bool BVH::rayIntersect(const Ray3f &_ray, Intersection &its, bool shadowRay) con
                 const Shape *shape = m_shapes[findShape(idx)];
 
                 float u, v, t;
+                NORI_STAT_ONLY(++testedPrimitives);
                 if (shape->rayIntersect(idx, ray, u, v, t)) {
-                    if (shadowRay)
+                    if (shadowRay) {
+                        NORI_STAT_RATIO_ADD(statNodesPerRay, visitedNodes, 1);
+                        NORI_STAT_RATIO_ADD(statTrianglesPerRay, testedPrimitives, 1);
                         return true;
+                    }
                     foundIntersection = true;
                     ray.maxt = its.t = t;
                     its.uv = Point2f(u, v);
                     its.mesh = shape;
                     f = idx;
+                    prim = m_indices[i];
                 }
             }
             if (stack_idx == 0)
@@ -454,11 +490,153 @@ bool BVH::rayIntersect(const Ray3f &_ray, Intersection &its, bool shadowRay) con
         }
     }
 
+    NORI_STAT_RATIO_ADD(statNodesPerRay, visitedNodes, 1);
+    NORI_STAT_RATIO_ADD(statTrianglesPerRay, testedPrimitives, 1);
+
     if (foundIntersection) {
+        its.primIndex = prim;
         its.mesh->setHitInformation(f,ray,its);
+        its.computeDifferentials(ray);
     }
 
     return foundIntersection;
 }
 
+template <int N> void BVH::rayIntersect(const TRayPacket<N> &packet, Intersection *its,
+        bool *hit, bool shadowRay) const {
+    uint32_t node_idx = 0, stack_idx = 0, stack[64];
+
+    /* Per-lane state: the segment shrinks as closer hits are found */
+    float mint[N], maxt[N], u[N], v[N];
+    uint32_t f[N], prim[N];
+    const Shape *shape[N];
+    bool active[N], mask[N];
+    Ray3f rays[N];
+
+    int activeCount = 0;
+    for (int i = 0; i < N; ++i) {
+        hit[i] = false;
+        shape[i] = nullptr;
+        rays[i] = packet.get(i);
+
+        /* Use an adaptive ray epsilon */
+        mint[i] = packet.mint[i];
+        if (mint[i] == Epsilon)
+            mint[i] = std::max(mint[i], mint[i] * rays[i].o.array().abs().maxCoeff());
+        rays[i].mint = mint[i];
+        maxt[i] = packet.maxt[i];
+
+        active[i] = packet.active[i] && maxt[i] >= mint[i];
+        activeCount += active[i] ? 1 : 0;
+    }
+
+    if (m_nodes.empty() || activeCount == 0)
+        return;
+
+    NORI_STAT_ADD(statPacketRays, activeCount);
+    NORI_STAT_ONLY(uint32_t visitedNodes = 0);
+
+    /* Direction of the first active lane, used to order the children */
+    int firstLane = 0;
+    while (!active[firstLane])
+        ++firstLane;
+    bool negDir[3] = { packet.dx[firstLane] < 0, packet.dy[firstLane] < 0, packet.dz[firstLane] < 0 };
+
+    while (true) {
+        const BVHNode &node = m_nodes[node_idx];
+        const Point3f &bmin = node.bbox.min, &bmax = node.bbox.max;
+        NORI_STAT_ONLY(++visitedNodes);
+
+        /* Slab test of all lanes at once. A NaN (ray origin on a slab plane
+           with a zero direction component) never culls the box, since the
+           std::min/max forms below return their first argument then. */
+        bool any = false;
+        for (int i = 0; i < N; ++i) {
+            float tx1 = (bmin.x() - packet.ox[i]) * packet.rdx[i], tx2 = (bmax.x() - packet.ox[i]) * packet.rdx[i];
+            float ty1 = (bmin.y() - packet.oy[i]) * packet.rdy[i], ty2 = (bmax.y() - packet.oy[i]) * packet.rdy[i];
+            float tz1 = (bmin.z() - packet.oz[i]) * packet.rdz[i], tz2 = (bmax.z() - packet.oz[i]) * packet.rdz[i];
+
+            float nearT = std::max(std::max(std::max(mint[i], std::min(tx1, tx2)), std::min(ty1, ty2)), std::min(tz1, tz2));
+            float farT = std::min(std::min(std::min(maxt[i], std::max(tx1, tx2)), std::max(ty1, ty2)), std::max(tz1, tz2));
+
+            mask[i] = active[i] && nearT <= farT;
+            any |= mask[i];
+        }
+
+        if (!any) {
+            if (stack_idx == 0)
+                break;
+            node_idx = stack[--stack_idx];
+            continue;
+        }
+
+        if (node.isInner()) {
+            /* The left child holds the primitives with smaller centroids along the split axis */
+            if (negDir[node.inner.axis]) {
+                stack[stack_idx++] = node_idx + 1;
+                node_idx = node.inner.rightChild;
+            } else {
+                stack[stack_idx++] = node.inner.rightChild;
+                node_idx++;
+            }
+            assert(stack_idx<64);
+        } else {
+            for (uint32_t j = node.start(), end = node.end(); j < end; ++j) {
+                uint32_t idx = m_indices[j];
+                const Shape *primShape = m_shapes[findShape(idx)];
+
+                for (int i = 0; i < N; ++i) {
+                    if (!mask[i] || !active[i])
+                        continue;
+
+                    float pu, pv, t;
+                    rays[i].maxt = maxt[i];
+                    if (primShape->rayIntersect(idx, rays[i], pu, pv, t)) {
+                        hit[i] = true;
+                        if (shadowRay) {
+                            active[i] = false;
+                            if (--activeCount == 0) {
+                                NORI_STAT_RATIO_ADD(statNodesPerPacket, visitedNodes, 1);
+                                return;
+                            }
+                            continue;
+                        }
+                        maxt[i] = t;
+                        u[i] = pu;
+                        v[i] = pv;
+                        shape[i] = primShape;
+                        f[i] = idx;
+                        prim[i] = m_indices[j];
+                    }
+                }
+            }
+            if (stack_idx == 0)
+                break;
+            node_idx = stack[--stack_idx];
+            continue;
+        }
+    }
+
+    NORI_STAT_RATIO_ADD(statNodesPerPacket, visitedNodes, 1);
+
+    if (shadowRay)
+        return;
+
+    for (int i = 0; i < N; ++i) {
+        if (!hit[i])
+            continue;
+        rays[i].maxt = maxt[i];
+        its[i].t = maxt[i];
+        its[i].uv = Point2f(u[i], v[i]);
+        its[i].mesh = shape[i];
+        its[i].primIndex = prim[i];
+        shape[i]->setHitInformation(f[i], rays[i], its[i]);
+        its[i].computeDifferentials(rays[i]);
+    }
+}
+
+template void BVH::rayIntersect<4>(const TRayPacket<4> &, Intersection *, bool *, bool) const;
+template void BVH::rayIntersect<8>(const TRayPacket<8> &, Intersection *, bool *, bool) const;
+template void BVH::rayIntersect<16>(const TRayPacket<16> &, Intersection *, bool *, bool) const;
+
 NORI_NAMESPACE_END
@@ -28,7 +28,7 @@ public:
 
     virtual std::string toString() const override;
 
-    virtual T eval(const Point2f & uv) override {
+    virtual T eval(const Point2f & uv) const override {
 
         int col = int(floor(uv.x() / m_scale.x() - m_delta.x()));
         int row = int(floor(uv.y() / m_scale.y() - m_delta.y()));
@@ -18,8 +18,11 @@
 
 #include <nori/bsdf.h>
 #include <nori/warp.h>
-#include <pcg32.h>
+#include <nori/stattest.h>
 #include <hypothesis.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/enumerable_thread_specific.h>
 #include <fstream>
 #include <memory>
 
@@ -39,9 +42,9 @@ NORI_NAMESPACE_BEGIN
  * (e.g. from a BSDF) produces a distribution that agrees with what the
  * implementation claims via its associated density function.
  */
-class ChiSquareTest : public NoriObject {
+class ChiSquareTest : public StatisticalTest {
 public:
-    ChiSquareTest(const PropertyList &propList) {
+    ChiSquareTest(const PropertyList &propList) : StatisticalTest(propList) {
         /* The null hypothesis will be rejected when the associated
            p-value is below the significance level specified here. */
         m_significanceLevel = propList.getFloat("significanceLevel", 0.01f);
@@ -91,23 +94,19 @@ public:
 
     /// Execute the chi-square test
     virtual void activate() override {
-        int passed = 0, total = 0, res = m_cosThetaResolution*m_phiResolution;
-        pcg32 random; /* Pseudorandom number generator */
-
-        std::unique_ptr<double[]> obsFrequencies(new double[res]);
-        std::unique_ptr<double[]> expFrequencies(new double[res]);
+        int res = m_cosThetaResolution*m_phiResolution;
+        pcg32 random = parameterRandom();
 
+        std::vector<double> obsFrequencies(res), expFrequencies(res);
 
         /* Test each registered BSDF */
         for (auto bsdf : m_bsdfs) {
             /* Run several tests per BSDF to be on the safe side */
             for (int l = 0; l<m_testCount; ++l) {
-                memset(obsFrequencies.get(), 0, res*sizeof(double));
-                memset(expFrequencies.get(), 0, res*sizeof(double));
+                int test = getTestCount();
 
                 cout << "------------------------------------------------------" << endl;
                 cout << "Testing: " << bsdf->toString() << endl;
-                ++total;
 
                 float cosTheta = random.nextFloat();
                 float sinTheta = std::sqrt(std::max((float) 0, 1-cosTheta*cosTheta));
@@ -119,79 +118,87 @@ public:
                      << "x" << m_phiResolution << " contingency table .. ";
                 cout.flush();
 
-                /* Generate many samples from the BSDF and create
-                   a histogram / contingency table */
-                BSDFQueryRecord bRec(wi);
-                for (int i=0; i<m_sampleCount; ++i) {
-                    Point2f sample(random.nextFloat(), random.nextFloat());
-                    Color3f result = bsdf->sample(bRec, sample);
-
-                    if ((result.array() == 0).all())
-                        continue;
-
-                    int cosThetaBin = std::min(std::max(0, (int) std::floor((bRec.wo.z()*0.5f+0.5f)
-                            * m_cosThetaResolution)), m_cosThetaResolution-1);
-
-                    float scaledPhi = std::atan2(bRec.wo.y(), bRec.wo.x()) * INV_TWOPI;
-                    if (scaledPhi < 0)
-                        scaledPhi += 1;
-
-                    int phiBin = std::min(std::max(0,
-                        (int) std::floor(scaledPhi * m_phiResolution)), m_phiResolution-1);
-                    obsFrequencies[cosThetaBin * m_phiResolution + phiBin] += 1;
+                /* Generate many samples from the BSDF and create a histogram /
+                   contingency table per thread. The bins hold integer counts,
+                   so the sum over threads does not depend on the scheduling. */
+                tbb::enumerable_thread_specific<std::vector<double>> histograms(std::vector<double>(res, 0.0));
+                tbb::parallel_for(0, chunkCount(m_sampleCount), [&](int chunk) {
+                    std::vector<double> &histogram = histograms.local();
+                    pcg32 chunkRng = chunkRandom(test, chunk);
+                    BSDFQueryRecord bRec(wi);
+                    for (int i = 0, n = chunkSamples(m_sampleCount, chunk); i < n; ++i) {
+                        Point2f sample(chunkRng.nextFloat(), chunkRng.nextFloat());
+                        Color3f result = bsdf->sample(bRec, sample);
+
+                        if ((result.array() == 0).all())
+                            continue;
+
+                        int cosThetaBin = std::min(std::max(0, (int) std::floor((bRec.wo.z()*0.5f+0.5f)
+                                * m_cosThetaResolution)), m_cosThetaResolution-1);
+
+                        float scaledPhi = std::atan2(bRec.wo.y(), bRec.wo.x()) * INV_TWOPI;
+                        if (scaledPhi < 0)
+                            scaledPhi += 1;
+
+                        int phiBin = std::min(std::max(0,
+                            (int) std::floor(scaledPhi * m_phiResolution)), m_phiResolution-1);
+                        histogram[cosThetaBin * m_phiResolution + phiBin] += 1;
+                    }
+                });
+                std::fill(obsFrequencies.begin(), obsFrequencies.end(), 0.0);
+                for (const std::vector<double> &histogram : histograms) {
+                    for (int i = 0; i < res; ++i)
+                        obsFrequencies[i] += histogram[i];
                 }
                 cout << "done." << endl;
 
                 /* Numerically integrate the probability density
-                   function over rectangles in spherical coordinates. */
-                double *ptr = expFrequencies.get();
+                   function over rectangles in spherical coordinates.
+                   Every bin is independent and written by one task. */
                 cout << "Integrating expected frequencies .. ";
                 cout.flush();
-                for (int i=0; i<m_cosThetaResolution; ++i) {
+                tbb::parallel_for(0, res, [&](int bin) {
+                    int i = bin / m_phiResolution, j = bin % m_phiResolution;
                     double cosThetaStart = -1.0 + i     * 2.0 / m_cosThetaResolution;
                     double cosThetaEnd   = -1.0 + (i+1) * 2.0 / m_cosThetaResolution;
-                    for (int j=0; j<m_phiResolution; ++j) {
-                        double phiStart = j     * 2*M_PI / m_phiResolution;
-                        double phiEnd   = (j+1) * 2*M_PI / m_phiResolution;
+                    double phiStart = j     * 2*M_PI / m_phiResolution;
+                    double phiEnd   = (j+1) * 2*M_PI / m_phiResolution;
 
-                        auto integrand = [&](double cosTheta, double phi) -> double {
-                            double sinTheta = std::sqrt(1 - cosTheta * cosTheta);
-                            double sinPhi = std::sin(phi), cosPhi = std::cos(phi);
+                    auto integrand = [&](double cosTheta, double phi) -> double {
+                        double sinTheta = std::sqrt(1 - cosTheta * cosTheta);
+                        double sinPhi = std::sin(phi), cosPhi = std::cos(phi);
 
-                            Vector3f wo((float) (sinTheta * cosPhi),
-                                        (float) (sinTheta * sinPhi),
-                                        (float) cosTheta);
+                        Vector3f wo((float) (sinTheta * cosPhi),
+                                    (float) (sinTheta * sinPhi),
+                                    (float) cosTheta);
 
-                            BSDFQueryRecord bRec(wi, wo, ESolidAngle);
-                            return bsdf->pdf(bRec);
-                        };
+                        BSDFQueryRecord bRec(wi, wo, ESolidAngle);
+                        return bsdf->pdf(bRec);
+                    };
 
-                        double integral = hypothesis::adaptiveSimpson2D(
-                            integrand, cosThetaStart, phiStart, cosThetaEnd,
-                            phiEnd);
+                    double integral = hypothesis::adaptiveSimpson2D(
+                        integrand, cosThetaStart, phiStart, cosThetaEnd,
+                        phiEnd);
 
-                        *ptr++ = integral * m_sampleCount;
-                    }
-                }
+                    expFrequencies[bin] = integral * m_sampleCount;
+                });
                 cout << "done." << endl;
 
                 /* Write the test input data to disk for debugging */
-                hypothesis::chi2_dump(m_cosThetaResolution, m_phiResolution, obsFrequencies.get(), expFrequencies.get(),
-                    tfm::format("chi2test_%i.m", total));
+                hypothesis::chi2_dump(m_cosThetaResolution, m_phiResolution, obsFrequencies.data(), expFrequencies.data(),
+                    tfm::format("chi2test_%i.m", test + 1));
 
                 /* Perform the Chi^2 test */
                 std::pair<bool, std::string> result =
-                    hypothesis::chi2_test(m_cosThetaResolution*m_phiResolution, obsFrequencies.get(), expFrequencies.get(),
+                    hypothesis::chi2_test(m_cosThetaResolution*m_phiResolution, obsFrequencies.data(), expFrequencies.data(),
                         m_sampleCount, m_minExpFrequency, m_significanceLevel, m_testCount * (int) m_bsdfs.size());
 
-                if (result.first)
-                    ++passed;
-
+                record(result.first);
                 cout << result.second << endl;
             }
         }
 
-        cout << "Passed " << passed << "/" << total << " tests." << endl;
+        cout << "Passed " << getPassedCount() << "/" << getTestCount() << " tests." << endl;
     }
 
     virtual std::string toString() const override {
@@ -201,18 +208,19 @@ public:
             "  minExpFrequency = %i,\n"
             "  sampleCount = %i,\n"
             "  testCount = %i,\n"
-            "  significanceLevel = %f\n"
+            "  significanceLevel = %f,\n"
+            "  seed = %i\n"
             "]",
             m_cosThetaResolution,
             m_phiResolution,
             m_minExpFrequency,
             m_sampleCount,
             m_testCount,
-            m_significanceLevel
+            m_significanceLevel,
+            m_seed
         );
     }
 
-    virtual EClassType getClassType() const override { return ETest; }
 private:
     int m_cosThetaResolution;
     int m_phiResolution;
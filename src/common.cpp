@@ -21,6 +21,7 @@
 #include <Eigen/LU>
 #include <filesystem/resolver.h>
 #include <iomanip>
+#include <sys/stat.h>
 
 #if defined(PLATFORM_LINUX)
 #include <malloc.h>
@@ -184,6 +185,32 @@ std::string memString(size_t size, bool precise) {
     return os.str();
 }
 
+uint64_t fileStamp(const std::string &filename) {
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0)
+        return 0;
+    return ((uint64_t) st.st_size << 32) ^ (uint64_t) st.st_mtime;
+}
+
+std::string jsonString(const std::string &value) {
+    std::string result = "\"";
+    for (char c : value) {
+        switch (c) {
+            case '"': result += "\\\""; break;
+            case '\\': result += "\\\\"; break;
+            case '\n': result += "\\n"; break;
+            case '\r': result += "\\r"; break;
+            case '\t': result += "\\t"; break;
+            default:
+                if ((unsigned char) c < 0x20)
+                    result += tfm::format("\\u%04x", (int) c);
+                else
+                    result += c;
+        }
+    }
+    return result + "\"";
+}
+
 filesystem::resolver *getFileResolver() {
     static filesystem::resolver *resolver = new filesystem::resolver();
     return resolver;
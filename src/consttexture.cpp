@@ -27,10 +27,14 @@ public:
 
     virtual std::string toString() const override;
 
-    virtual T eval(const Point2f & uv) override {
+    virtual T eval(const Point2f & uv) const override {
         return m_value;
     }
 
+    virtual void evalBatch(const Point2f * uv, T * result, size_t count) const override {
+        std::fill(result, result + count, m_value);
+    }
+
 protected:
     T m_value;
 };
@@ -0,0 +1,230 @@
+#include <nori/denoiser.h>
+#include <nori/bitmap.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+NORI_NAMESPACE_BEGIN
+
+namespace {
+    /// Albedo values below this are clamped before demodulation
+    const float MIN_ALBEDO = 0.01f;
+
+    /// Copy one channel of an interleaved buffer into a plane
+    void extractPlane(const float *source, int stride, int channel, std::vector<float> &plane) {
+        for (size_t i = 0; i < plane.size(); ++i)
+            plane[i] = source[i * stride + channel];
+    }
+
+    inline float luminance(const std::vector<float> *color, size_t i) {
+        return 0.212671f * color[0][i] + 0.715160f * color[1][i] + 0.072169f * color[2][i];
+    }
+
+    /// Variance of the luminance in the 3x3 neighborhood of each pixel of row \c y
+    void luminanceVariance(const std::vector<float> *color, int width, int height, int y, float *variance) {
+        for (int x = 0; x < width; ++x) {
+            float sum = 0.f, sum2 = 0.f;
+            int count = 0;
+            for (int yq = std::max(y - 1, 0); yq <= std::min(y + 1, height - 1); ++yq) {
+                for (int xq = std::max(x - 1, 0); xq <= std::min(x + 1, width - 1); ++xq) {
+                    float l = luminance(color, (size_t) yq * width + xq);
+                    sum += l;
+                    sum2 += l * l;
+                    ++count;
+                }
+            }
+            float mean = sum / count;
+            variance[(size_t) y * width + x] = std::max(0.f, sum2 / count - mean * mean);
+        }
+    }
+
+    /// Guiding features (planar, \c nullptr if not available)
+    struct Features {
+        const std::vector<float> *albedo;
+        const std::vector<float> *normal;
+        const float *depth;
+        int width, height;
+    };
+
+    /// Parameters of one à-trous pass
+    struct Weights {
+        int step;
+        float sigmaColor;
+        float invSigmaNormal2;
+        float invSigmaAlbedo2;
+        float invSigmaDepth;
+        const float *variance;
+    };
+
+    /// Filter rows [y0, y1) with the edge-stopping functions of the available features
+    template <bool UseAlbedo, bool UseNormal, bool UseDepth>
+    void atrousRows(const Features &f, const Weights &w, const std::vector<float> *color,
+                    std::vector<float> *filtered, int y0, int y1) {
+        static const float h[5] = { 1.f / 16.f, 1.f / 4.f, 3.f / 8.f, 1.f / 4.f, 1.f / 16.f };
+        const int width = f.width, height = f.height, step = w.step;
+
+        for (int y = y0; y < y1; ++y) {
+            for (int x = 0; x < width; ++x) {
+                size_t p = (size_t) y * width + x;
+                float cr = color[0][p], cg = color[1][p], cb = color[2][p];
+                float invColorScale = 1.f / (w.sigmaColor * std::sqrt(w.variance[p]) + 1e-4f);
+
+                float sumR = 0.f, sumG = 0.f, sumB = 0.f, sumWeight = 0.f;
+                for (int dy = -2; dy <= 2; ++dy) {
+                    int yq = y + dy * step;
+                    if (yq < 0 || yq >= height)
+                        continue;
+                    for (int dx = -2; dx <= 2; ++dx) {
+                        int xq = x + dx * step;
+                        if (xq < 0 || xq >= width)
+                            continue;
+                        size_t q = (size_t) yq * width + xq;
+
+                        /* Sum the exponents of all edge-stopping functions to evaluate a single exp() */
+                        float dr = color[0][q] - cr, dg = color[1][q] - cg, db = color[2][q] - cb;
+                        float exponent = std::sqrt(dr * dr + dg * dg + db * db) * invColorScale;
+                        if (UseNormal) {
+                            float nx = f.normal[0][q] - f.normal[0][p], ny = f.normal[1][q] - f.normal[1][p],
+                                  nz = f.normal[2][q] - f.normal[2][p];
+                            exponent += (nx * nx + ny * ny + nz * nz) * w.invSigmaNormal2;
+                        }
+                        if (UseAlbedo) {
+                            float ar = f.albedo[0][q] - f.albedo[0][p], ag = f.albedo[1][q] - f.albedo[1][p],
+                                  ab = f.albedo[2][q] - f.albedo[2][p];
+                            exponent += (ar * ar + ag * ag + ab * ab) * w.invSigmaAlbedo2;
+                        }
+                        if (UseDepth) {
+                            float zp = f.depth[p], zq = f.depth[q];
+                            exponent += std::abs(zq - zp) * w.invSigmaDepth / (std::max(zp, zq) + 1e-4f);
+                        }
+
+                        float weight = h[dx + 2] * h[dy + 2] * std::exp(-exponent);
+                        sumR += weight * color[0][q];
+                        sumG += weight * color[1][q];
+                        sumB += weight * color[2][q];
+                        sumWeight += weight;
+                    }
+                }
+
+                /* The center tap always has a weight of h[2]^2 */
+                float invWeight = 1.f / sumWeight;
+                filtered[0][p] = sumR * invWeight;
+                filtered[1][p] = sumG * invWeight;
+                filtered[2][p] = sumB * invWeight;
+            }
+        }
+    }
+};
+
+Denoiser::Denoiser(int iterations, float sigmaColor, float sigmaNormal, float sigmaDepth, float sigmaAlbedo)
+    : m_iterations(iterations), m_sigmaColor(sigmaColor), m_sigmaNormal(sigmaNormal),
+      m_sigmaDepth(sigmaDepth), m_sigmaAlbedo(sigmaAlbedo) {
+    if (iterations < 1 || iterations > 10)
+        throw NoriException("Denoiser: the number of iterations must be between 1 and 10");
+    if (!(sigmaColor > 0) || !(sigmaNormal > 0) || !(sigmaDepth > 0) || !(sigmaAlbedo > 0))
+        throw NoriException("Denoiser: all sigma values must be positive");
+}
+
+Bitmap *Denoiser::denoise(const Bitmap &bitmap) const {
+    const int width = (int) bitmap.cols(), height = (int) bitmap.rows();
+    const size_t pixelCount = (size_t) width * height;
+
+    /* Planar copies of the color and the features, so that the
+       inner loop reads contiguous memory for every quantity */
+    std::vector<float> color[3], albedo[3], normal[3], depth;
+    const float *rgb = reinterpret_cast<const float *>(bitmap.data());
+    for (int ch = 0; ch < 3; ++ch) {
+        color[ch].resize(pixelCount);
+        extractPlane(rgb, 3, ch, color[ch]);
+    }
+
+    const Bitmap::Layer *albedoLayer = bitmap.getLayer("albedo"),
+                        *normalLayer = bitmap.getLayer("normal"),
+                        *depthLayer = bitmap.getLayer("depth");
+    if (albedoLayer) {
+        for (int ch = 0; ch < 3; ++ch) {
+            albedo[ch].resize(pixelCount);
+            extractPlane(albedoLayer->data.data(), 3, ch, albedo[ch]);
+            for (size_t i = 0; i < pixelCount; ++i)
+                color[ch][i] /= std::max(albedo[ch][i], MIN_ALBEDO);
+        }
+    }
+    if (normalLayer) {
+        for (int ch = 0; ch < 3; ++ch) {
+            normal[ch].resize(pixelCount);
+            extractPlane(normalLayer->data.data(), 3, ch, normal[ch]);
+        }
+    }
+    if (depthLayer)
+        depth = depthLayer->data;
+
+    std::vector<float> filtered[3], variance(pixelCount);
+    for (int ch = 0; ch < 3; ++ch)
+        filtered[ch].resize(pixelCount);
+
+    Features features;
+    features.albedo = albedoLayer ? albedo : nullptr;
+    features.normal = normalLayer ? normal : nullptr;
+    features.depth = depthLayer ? depth.data() : nullptr;
+    features.width = width;
+    features.height = height;
+
+    /* Instantiate the kernel for the available features, so that the
+       inner loop does not test for them */
+    void (*filterRows)(const Features &, const Weights &, const std::vector<float> *,
+                       std::vector<float> *, int, int);
+    int mask = (albedoLayer ? 1 : 0) | (normalLayer ? 2 : 0) | (depthLayer ? 4 : 0);
+    switch (mask) {
+        case 0: filterRows = atrousRows<false, false, false>; break;
+        case 1: filterRows = atrousRows<true,  false, false>; break;
+        case 2: filterRows = atrousRows<false, true,  false>; break;
+        case 3: filterRows = atrousRows<true,  true,  false>; break;
+        case 4: filterRows = atrousRows<false, false, true>;  break;
+        case 5: filterRows = atrousRows<true,  false, true>;  break;
+        case 6: filterRows = atrousRows<false, true,  true>;  break;
+        default: filterRows = atrousRows<true, true,  true>;  break;
+    }
+
+    for (int it = 0; it < m_iterations; ++it) {
+        /* Local luminance variance of the current image, which scales
+           the color tolerance to the remaining amount of noise */
+        tbb::parallel_for(tbb::blocked_range<int>(0, height, 8), [&](const tbb::blocked_range<int> &range) {
+            for (int y = range.begin(); y < range.end(); ++y)
+                luminanceVariance(color, width, height, y, variance.data());
+        });
+
+        Weights weights;
+        weights.step = 1 << it;
+        weights.sigmaColor = m_sigmaColor;
+        weights.invSigmaNormal2 = 1.f / (m_sigmaNormal * m_sigmaNormal);
+        weights.invSigmaAlbedo2 = 1.f / (m_sigmaAlbedo * m_sigmaAlbedo);
+        weights.invSigmaDepth = 1.f / (m_sigmaDepth * weights.step);
+        weights.variance = variance.data();
+
+        tbb::parallel_for(tbb::blocked_range<int>(0, height, 8), [&](const tbb::blocked_range<int> &range) {
+            filterRows(features, weights, color, filtered, range.begin(), range.end());
+        });
+
+        for (int ch = 0; ch < 3; ++ch)
+            color[ch].swap(filtered[ch]);
+    }
+
+    Bitmap *result = new Bitmap(Vector2i(width, height));
+    float *target = reinterpret_cast<float *>(result->data());
+    for (int ch = 0; ch < 3; ++ch) {
+        for (size_t i = 0; i < pixelCount; ++i) {
+            float value = color[ch][i];
+            if (!albedo[0].empty())
+                value *= std::max(albedo[ch][i], MIN_ALBEDO);
+            target[3 * i + ch] = value;
+        }
+    }
+    return result;
+}
+
+std::string Denoiser::toString() const {
+    return tfm::format(
+        "Denoiser[iterations = %i, sigmaColor = %f, sigmaNormal = %f, sigmaDepth = %f, sigmaAlbedo = %f]",
+        m_iterations, m_sigmaColor, m_sigmaNormal, m_sigmaDepth, m_sigmaAlbedo);
+}
+
+NORI_NAMESPACE_END
@@ -73,6 +73,10 @@ public:
 
     }
 
+    virtual bool isDelta() const override {
+        return true;
+    }
+
     virtual std::string toString() const override {
         return tfm::format(
             "Dielectric[\n"
@@ -78,7 +78,7 @@ public:
             return Color3f(0.0f);
 
         /* The BRDF is simply the albedo / pi */
-        return m_albedo->eval(bRec.uv) * INV_PI;
+        return m_albedo->eval(bRec.uv, bRec.dUVdx, bRec.dUVdy) * INV_PI;
     }
 
     /// Compute the density of \ref sample() wrt. solid angles
@@ -116,13 +116,17 @@ public:
 
         /* eval() / pdf() * cos(theta) = albedo. There
            is no need to call these functions. */
-        return m_albedo->eval(bRec.uv);
+        return m_albedo->eval(bRec.uv, bRec.dUVdx, bRec.dUVdy);
     }
 
     bool isDiffuse() const {
         return true;
     }
 
+    Color3f albedo(const BSDFQueryRecord &bRec) const override {
+        return m_albedo->eval(bRec.uv, bRec.dUVdx, bRec.dUVdy);
+    }
+
     /// Return a human-readable summary
     virtual std::string toString() const override {
         return tfm::format(
@@ -38,6 +38,8 @@ public:
             // Evaluate the BSDF for a pair of directions (lRec and ray)
             BSDFQueryRecord bsdfRec(localLRec, localRay, ESolidAngle);
             bsdfRec.uv = its.uv;
+            bsdfRec.dUVdx = its.dUVdx;
+            bsdfRec.dUVdy = its.dUVdy;
             auto bsdf = its.mesh->getBSDF()->eval(bsdfRec);
 
             color += value * cosineTerm * bsdf;
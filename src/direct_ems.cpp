@@ -45,6 +45,8 @@ public:
             // Evaluate the BSDF for a pair of directions (lRec and ray)
             BSDFQueryRecord bsdfRec(localRay, localLRec, ESolidAngle);
             bsdfRec.uv = its.uv;
+            bsdfRec.dUVdx = its.dUVdx;
+            bsdfRec.dUVdy = its.dUVdy;
             auto fr = its.mesh->getBSDF()->eval(bsdfRec);
 
             auto F = fr * LeOverPdf * cosTheta;
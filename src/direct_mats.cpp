@@ -28,6 +28,8 @@ public:
         // Sample from BSDF
         BSDFQueryRecord bRec(its.shFrame.toLocal(-ray.d));
         bRec.uv = its.uv;
+        bRec.dUVdx = its.dUVdx;
+        bRec.dUVdy = its.dUVdy;
         auto frCosThetaOverPdf = its.mesh->getBSDF()->sample(bRec, sampler->next2D());
 
         // Cast ray based on sample
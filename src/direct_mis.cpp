@@ -50,6 +50,8 @@ public:
                 // Evaluate the BSDF for a pair of directions (lRec and ray)
                 BSDFQueryRecord bsdfRec(localRay, localLRec, ESolidAngle);
                 bsdfRec.uv = its.uv;
+                bsdfRec.dUVdx = its.dUVdx;
+                bsdfRec.dUVdy = its.dUVdy;
                 auto fr = its.mesh->getBSDF()->eval(bsdfRec);
                 auto pdfMat = its.mesh->getBSDF()->pdf(bsdfRec);
 
@@ -68,6 +70,8 @@ public:
             // Sample from BSDF
             BSDFQueryRecord bRec(its.shFrame.toLocal(-ray.d));
             bRec.uv = its.uv;
+            bRec.dUVdx = its.dUVdx;
+            bRec.dUVdy = its.dUVdy;
             auto frCosThetaOverPdf = its.mesh->getBSDF()->sample(bRec, sampler->next2D());
             auto pdfMat = its.mesh->getBSDF()->pdf(bRec);
 
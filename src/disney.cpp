@@ -67,7 +67,7 @@ public:
         }
 
         // Define colors
-        auto baseColor = m_albedo->eval(bRec.uv);
+        auto baseColor = m_albedo->eval(bRec.uv, bRec.dUVdx, bRec.dUVdy);
         auto luminance = baseColor.getLuminance();
         auto tintColor = luminance > 0 ? Color3f(baseColor / luminance) : Color3f(1);
         auto specularColor = mix(m_specular * .08f * mix(1, tintColor, m_specularTint), baseColor, m_metallic);
@@ -157,6 +157,10 @@ public:
         return true;
     }
 
+    Color3f albedo(const BSDFQueryRecord &bRec) const override {
+        return m_albedo->eval(bRec.uv, bRec.dUVdx, bRec.dUVdy);
+    }
+
     void activate() override {
         if(!m_albedo) {
             PropertyList l;
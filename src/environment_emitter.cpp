@@ -2,6 +2,7 @@
 #include <nori/warp.h>
 #include <nori/shape.h>
 #include <nori/bitmap.h>
+#include <nori/snapshot.h>
 #include "utils.cpp"
 
 NORI_NAMESPACE_BEGIN
@@ -19,6 +20,19 @@ private:
 
 public:
     explicit EnvironmentEmitter(const PropertyList &props) {
+        // The map and its sampling tables are part of scene snapshots
+        Snapshot *snapshot = Snapshot::active();
+        std::string key = snapshot ? snapshot->nextKey("environment") : std::string();
+        if (snapshot && snapshot->getMatrix(key + ".map", m_envMap) &&
+            snapshot->getMatrix(key + ".pdfTheta", m_pdfTheta) &&
+            snapshot->getMatrix(key + ".cdfTheta", m_cdfTheta) &&
+            snapshot->getMatrix(key + ".conditionalPdfPhi", m_conditionalPdfPhi) &&
+            snapshot->getMatrix(key + ".conditionalCdfPhi", m_conditionalCdfPhi)) {
+            m_rows = m_envMap.rows();
+            m_cols = m_envMap.cols();
+            return;
+        }
+
         auto envMapPath = props.getString("envMapPath");
         m_envMap = Bitmap(envMapPath);
         m_rows = m_envMap.rows();
@@ -26,6 +40,14 @@ public:
 
         // Precompute (marginal) pdf and cdf
         preCompute();
+
+        if (snapshot && !snapshot->isReading()) {
+            snapshot->putMatrix(key + ".map", m_envMap);
+            snapshot->putMatrix(key + ".pdfTheta", m_pdfTheta);
+            snapshot->putMatrix(key + ".cdfTheta", m_cdfTheta);
+            snapshot->putMatrix(key + ".conditionalPdfPhi", m_conditionalPdfPhi);
+            snapshot->putMatrix(key + ".conditionalCdfPhi", m_conditionalCdfPhi);
+        }
     }
 
     void preCompute() {
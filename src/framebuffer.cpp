@@ -0,0 +1,172 @@
+#include <nori/framebuffer.h>
+#include <nori/block.h>
+#include <nori/bitmap.h>
+#include <nori/mmap.h>
+#include <tbb/parallel_for.h>
+#include <cstring>
+#include <new>
+
+#if defined(PLATFORM_WINDOWS)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+NORI_NAMESPACE_BEGIN
+
+namespace {
+    const char Magic[8] = "NORI_FB";
+    const uint32_t Version = 1;
+
+    /// Number of attempts of \ref LiveFramebuffer::read() to copy a frame that is not overwritten meanwhile
+    const int ReadAttempts = 8;
+};
+
+size_t LiveFramebuffer::slotOffset(const Vector2i &size, int slot) {
+    size_t slotSize = sizeof(FrameHeader) + sizeof(float) * 3 * (size_t) size.x() * size.y();
+    return sizeof(Header) + slot * slotSize;
+}
+
+#if defined(PLATFORM_WINDOWS)
+
+LiveFramebuffer::LiveFramebuffer(const std::string &filename, const Vector2i &size, uint32_t totalPasses)
+    : m_filename(filename), m_size(size), m_fileSize(slotOffset(size, 2)) {
+    m_file = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                         nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE)
+        throw NoriException("LiveFramebuffer: could not create \"%s\"", filename);
+
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READWRITE, (DWORD) ((uint64_t) m_fileSize >> 32),
+                                   (DWORD) m_fileSize, nullptr);
+    if (!m_mapping) {
+        CloseHandle(m_file);
+        throw NoriException("LiveFramebuffer: could not map \"%s\"", filename);
+    }
+    m_data = (uint8_t *) MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, m_fileSize);
+    if (!m_data) {
+        CloseHandle(m_mapping);
+        CloseHandle(m_file);
+        throw NoriException("LiveFramebuffer: could not map \"%s\"", filename);
+    }
+    init(totalPasses);
+}
+
+LiveFramebuffer::~LiveFramebuffer() {
+    UnmapViewOfFile(m_data);
+    CloseHandle(m_mapping);
+    CloseHandle(m_file);
+}
+
+#else
+
+LiveFramebuffer::LiveFramebuffer(const std::string &filename, const Vector2i &size, uint32_t totalPasses)
+    : m_filename(filename), m_size(size), m_fileSize(slotOffset(size, 2)) {
+    int fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1)
+        throw NoriException("LiveFramebuffer: could not create \"%s\": %s", filename, strerror(errno));
+    if (ftruncate(fd, (off_t) m_fileSize) != 0) {
+        close(fd);
+        throw NoriException("LiveFramebuffer: could not resize \"%s\": %s", filename, strerror(errno));
+    }
+
+    void *ptr = mmap(nullptr, m_fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); /* The mapping keeps its own reference to the file */
+    if (ptr == MAP_FAILED)
+        throw NoriException("LiveFramebuffer: could not map \"%s\": %s", filename, strerror(errno));
+    m_data = (uint8_t *) ptr;
+    init(totalPasses);
+}
+
+LiveFramebuffer::~LiveFramebuffer() {
+    munmap(m_data, m_fileSize);
+}
+
+#endif
+
+void LiveFramebuffer::init(uint32_t totalPasses) {
+    /* The file starts out zeroed, i.e. with sequence number 0 (no frame) */
+    Header *header = new (m_data) Header();
+    memcpy(header->magic, Magic, sizeof(Magic));
+    header->version = Version;
+    header->width = (uint32_t) m_size.x();
+    header->height = (uint32_t) m_size.y();
+    header->totalPasses = totalPasses;
+    header->sequence.store(0, std::memory_order_release);
+}
+
+void LiveFramebuffer::publish(const ImageBlock &block, uint32_t passes) {
+    if (block.getSize() != m_size)
+        throw NoriException("LiveFramebuffer::publish(): the block size does not match the file");
+
+    Header *header = (Header *) m_data;
+    uint64_t frame = ++m_frame;
+
+    /* Mark the frame as being written before touching its slot (the slot
+       still holds frame - 2, which readers must now discard) */
+    header->sequence.store(2 * frame - 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    uint8_t *slot = m_data + slotOffset(m_size, (int) (frame % 2));
+    FrameHeader *frameHeader = (FrameHeader *) slot;
+    frameHeader->frame = frame;
+    frameHeader->passes = passes;
+    frameHeader->reserved = 0;
+
+    /* Copy the rows in parallel, since every render thread waits for the next pass */
+    float *pixels = (float *) (slot + sizeof(FrameHeader));
+    int border = block.getBorderSize();
+    tbb::parallel_for(tbb::blocked_range<int>(0, m_size.y()), [&](const tbb::blocked_range<int> &range) {
+        for (int y = range.begin(); y < range.end(); ++y) {
+            float *target = pixels + 3 * (size_t) y * m_size.x();
+            for (int x = 0; x < m_size.x(); ++x) {
+                Color3f value = block.coeff(y + border, x + border).divideByFilterWeight();
+                *target++ = value.r();
+                *target++ = value.g();
+                *target++ = value.b();
+            }
+        }
+    });
+
+    header->sequence.store(2 * frame, std::memory_order_release);
+}
+
+bool LiveFramebuffer::read(const std::string &filename, Bitmap &bitmap, uint32_t &passes, uint32_t &totalPasses) {
+    MemoryMappedFile file(filename);
+    const Header *header = (const Header *) file.data();
+    if (file.size() < sizeof(Header) || memcmp(header->magic, Magic, sizeof(Magic)) != 0 ||
+        header->version != Version)
+        throw NoriException("LiveFramebuffer: \"%s\" is not a framebuffer file", filename);
+
+    Vector2i size((int) header->width, (int) header->height);
+    if (file.size() < slotOffset(size, 2))
+        throw NoriException("LiveFramebuffer: \"%s\" is truncated", filename);
+    totalPasses = header->totalPasses;
+
+    for (int attempt = 0; attempt < ReadAttempts; ++attempt) {
+        uint64_t sequence = header->sequence.load(std::memory_order_acquire);
+        uint64_t frame = sequence / 2;
+        if (frame == 0)
+            return false;
+
+        const uint8_t *slot = file.data() + slotOffset(size, (int) (frame % 2));
+        const FrameHeader *frameHeader = (const FrameHeader *) slot;
+        const float *source = (const float *) (slot + sizeof(FrameHeader));
+        bitmap.resize(size.y(), size.x());
+        for (int y = 0; y < size.y(); ++y) {
+            for (int x = 0; x < size.x(); ++x, source += 3)
+                bitmap.coeffRef(y, x) = Color3f(source[0], source[1], source[2]);
+        }
+        passes = frameHeader->passes;
+
+        /* The copy is valid unless the writer has started to reuse the slot */
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header->sequence.load(std::memory_order_relaxed) < 2 * frame + 3)
+            return true;
+    }
+    return false;
+}
+
+NORI_NAMESPACE_END
@@ -29,6 +29,7 @@
 #include <nanogui/progressbar.h>
 
 #include <filesystem/resolver.h>
+#include <cstring>
 
 NORI_NAMESPACE_BEGIN
 
@@ -47,7 +48,7 @@ NoriScreen::NoriScreen(ImageBlock &block)
     buttonOpen->setCallback(
             [this]() {
                 using FileType = std::pair<std::string,std::string>;
-                std::vector<FileType> filetypes = { FileType("xml", "Nori Scene File"), FileType("exr", "EXR Image File") };
+                std::vector<FileType> filetypes = { FileType("xml", "Nori Scene File"), FileType("bin", "Nori Scene Snapshot"), FileType("exr", "EXR Image File") };
                 std::string filename = nanogui::file_dialog(filetypes, false);
                 dropEvent({ filename });
             }
@@ -140,18 +141,44 @@ NoriScreen::~NoriScreen() {
 }
 
 void NoriScreen::drawContents() {
-    /* Reload the partially rendered image onto the GPU */
+    /* Copy the regions of the partially rendered image that changed since
+       the last frame. The block is only locked for this copy, the upload
+       onto the GPU happens afterwards */
     m_block.lock();
     int borderSize = m_block.getBorderSize();
-    const Vector2i &size = m_block.getSize();
+    Vector2i size = m_block.getSize();
+    bool allDirty = m_block.takeDirtyRegions(m_dirtyRegions);
+    if (allDirty)
+        m_dirtyRegions.assign(1, BoundingBox2i(Point2i(0, 0), Point2i(size)));
+    size_t uploadSize = 0;
+    for (const BoundingBox2i &region : m_dirtyRegions)
+        uploadSize += (size_t) region.getExtents().prod() * 4;
+    m_uploadBuffer.resize(uploadSize);
+    float *target = m_uploadBuffer.data();
+    for (const BoundingBox2i &region : m_dirtyRegions) {
+        Vector2i extents = region.getExtents();
+        for (int y = region.min.y(); y < region.max.y(); ++y) {
+            const Color4f *source = &m_block.coeff(y + borderSize, region.min.x() + borderSize);
+            memcpy(target, source, sizeof(float) * 4 * extents.x());
+            target += 4 * extents.x();
+        }
+    }
+    m_block.unlock();
+
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, m_texture);
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, m_block.cols());
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, size.x(), size.y(),
-            0, GL_RGBA, GL_FLOAT, (uint8_t *) m_block.data() +
-            (borderSize * m_block.cols() + borderSize) * sizeof(Color4f));
-    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-    m_block.unlock();
+    if (allDirty && size != m_textureSize) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, size.x(), size.y(),
+                0, GL_RGBA, GL_FLOAT, nullptr);
+        m_textureSize = size;
+    }
+    const float *source = m_uploadBuffer.data();
+    for (const BoundingBox2i &region : m_dirtyRegions) {
+        Vector2i extents = region.getExtents();
+        glTexSubImage2D(GL_TEXTURE_2D, 0, region.min.x(), region.min.y(), extents.x(), extents.y(),
+                GL_RGBA, GL_FLOAT, source);
+        source += 4 * extents.x() * extents.y();
+    }
 
     m_progressBar->setValue(m_renderThread.getProgress());
 
@@ -168,7 +195,7 @@ void NoriScreen::dropEvent(const std::vector<std::string> &filenames) {
         std::string filename = filenames[0];
         filesystem::path path(filename);
 
-        if (path.extension() == "xml") {
+        if (path.extension() == "xml" || path.extension() == "bin") {
             /* Render the XML scene file */
             openXML(filename);
         } else if (path.extension() == "exr") {
@@ -176,7 +203,7 @@ void NoriScreen::dropEvent(const std::vector<std::string> &filenames) {
             openEXR(filename);
         } else {
             cerr << "Error: unknown file \"" << filename
-            << "\", expected an extension of type .xml or .exr" << endl;
+            << "\", expected an extension of type .xml, .bin or .exr" << endl;
         }
     }
 }
@@ -184,7 +211,7 @@ void NoriScreen::dropEvent(const std::vector<std::string> &filenames) {
 bool NoriScreen::keyboardEvent(int key, int scancode, bool press, int modifiers) {
     if(press && key == GLFW_KEY_O && modifiers & GLFW_MOD_CONTROL) {
         using FileType = std::pair<std::string,std::string>;
-        std::vector<FileType> filetypes = { FileType("xml", "Nori Scene File"), FileType("exr", "EXR Image File") };
+        std::vector<FileType> filetypes = { FileType("xml", "Nori Scene File"), FileType("bin", "Nori Scene Snapshot"), FileType("exr", "EXR Image File") };
         std::string filename = nanogui::file_dialog(filetypes, false);
         dropEvent({ filename });
         return true;
@@ -18,33 +18,379 @@
 
 #include <nori/bitmap.h>
 #include <filesystem/path.h>
+#include <ImfInputFile.h>
+#include <ImfChannelList.h>
+#include <ImfThreading.h>
+#include <stb_image_write.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_scheduler_init.h>
+#include <tbb/mutex.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
 
-int main(int argc, char **argv) {
-    using namespace nori;
+#if defined(PLATFORM_WINDOWS)
+#include <io.h>
+#else
+#include <dirent.h>
+#include <glob.h>
+#endif
 
-    try {
+using namespace nori;
+
+namespace {
+
+enum ECurve {
+    EGamma = 0,
+    EFilmic,
+    EACES
+};
+
+struct TonemapOptions {
+    float exposure = 0.f;            ///< Exposure adjustment in stops
+    ECurve curve = EGamma;           ///< Tone curve applied before sRGB encoding
+    Vector2i size = Vector2i(0, 0);  ///< Output size (0 keeps the aspect ratio)
+    std::string outputDir;           ///< Output directory (empty: next to the input)
+};
+
+/// Filmic curve by John Hable (Uncharted 2)
+float hable(float x) {
+    const float A = 0.15f, B = 0.50f, C = 0.10f, D = 0.20f, E = 0.02f, F = 0.30f;
+    return (x * (A * x + C * B) + D * E) / (x * (A * x + B) + D * F) - E / F;
+}
+
+/// Map a linear value through the tone curve (the result is still linear)
+float applyCurve(float value, ECurve curve) {
+    switch (curve) {
+        case EFilmic: {
+            static const float whiteScale = 1.f / hable(11.2f);
+            return hable(2.f * std::max(value, 0.f)) * whiteScale;
+        }
+        case EACES: {
+            /* Fit of the ACES reference rendering transform by Krzysztof Narkowicz */
+            value = std::max(value, 0.f);
+            return value * (2.51f * value + 0.03f) / (value * (2.43f * value + 0.59f) + 0.14f);
+        }
+        default:
+            return value;
+    }
+}
+
+/**
+ * \brief Reads the RGB channels of an OpenEXR file in strips of rows
+ *
+ * Only one strip is resident at a time, so that images of any size can be
+ * processed with a bounded amount of memory. Rows must be requested in
+ * non-decreasing order.
+ */
+class EXRStripReader {
+public:
+    static const int StripRows = 64;
+
+    EXRStripReader(const std::string &filename) : m_file(filename.c_str()) {
+        const Imf::ChannelList &channels = m_file.header().channels();
+        m_channels[0] = findChannel(channels, "r", "red");
+        m_channels[1] = findChannel(channels, "g", "green");
+        m_channels[2] = findChannel(channels, "b", "blue");
+        if (!m_channels[0] || !m_channels[1] || !m_channels[2])
+            throw NoriException("\"%s\" is not a standard RGB OpenEXR file!", filename);
+
+        Imath::Box2i dw = m_file.header().dataWindow();
+        m_min = Vector2i(dw.min.x, dw.min.y);
+        m_size = Vector2i(dw.max.x - dw.min.x + 1, dw.max.y - dw.min.y + 1);
+        m_strip.resize((size_t) 3 * m_size.x() * StripRows);
+        m_stripBegin = m_stripEnd = 0;
+    }
+
+    const Vector2i &getSize() const { return m_size; }
+
+    /// Return the interleaved RGB values of row \c y
+    const float *row(int y) {
+        if (y < m_stripBegin || y >= m_stripEnd) {
+            if (y < m_stripBegin)
+                throw NoriException("EXRStripReader: rows must be read in order");
+            m_stripBegin = y;
+            m_stripEnd = std::min(y + StripRows, m_size.y());
+
+            size_t compStride = sizeof(float),
+                   pixelStride = 3 * compStride,
+                   rowStride = pixelStride * m_size.x();
+
+            /* OpenEXR addresses slices with absolute pixel coordinates */
+            char *ptr = reinterpret_cast<char *>(m_strip.data())
+                - (ptrdiff_t) (m_min.y() + m_stripBegin) * rowStride - (ptrdiff_t) m_min.x() * pixelStride;
+
+            Imf::FrameBuffer frameBuffer;
+            for (int ch = 0; ch < 3; ++ch) {
+                frameBuffer.insert(m_channels[ch], Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride));
+                ptr += compStride;
+            }
+            m_file.setFrameBuffer(frameBuffer);
+            m_file.readPixels(m_min.y() + m_stripBegin, m_min.y() + m_stripEnd - 1);
+        }
+        return m_strip.data() + (size_t) 3 * m_size.x() * (y - m_stripBegin);
+    }
+
+private:
+    static const char *findChannel(const Imf::ChannelList &channels, const char *shortName, const char *longName) {
+        for (Imf::ChannelList::ConstIterator it = channels.begin(); it != channels.end(); ++it) {
+            if (it.channel().xSampling != 1 || it.channel().ySampling != 1)
+                continue;
+            std::string name = toLower(it.name());
+            if (name == shortName || name == longName ||
+                endsWith(name, std::string(".") + shortName) || endsWith(name, std::string(".") + longName))
+                return it.name();
+        }
+        return nullptr;
+    }
+
+    Imf::InputFile m_file;
+    const char *m_channels[3];
+    Vector2i m_min, m_size;
+    std::vector<float> m_strip;
+    int m_stripBegin, m_stripEnd;
+};
+
+/**
+ * \brief Area-weighted resampling taps along one axis
+ *
+ * Output pixel \c i averages the input pixels overlapping its footprint
+ * <tt>[i, i+1) * srcSize / dstSize</tt>, which is a box filter when
+ * downscaling and nearest neighbor when upscaling.
+ */
+struct Taps {
+    std::vector<int> begin;    ///< First tap of each output pixel (plus end marker)
+    std::vector<int> index;    ///< Input pixel of each tap
+    std::vector<float> weight; ///< Weight of each tap
+
+    Taps(int srcSize, int dstSize) {
+        double scale = (double) srcSize / dstSize;
+        for (int i = 0; i < dstSize; ++i) {
+            begin.push_back((int) index.size());
+            double start = i * scale, end = (i + 1) * scale;
+            for (int j = (int) start; j < std::min((double) srcSize, std::ceil(end)); ++j) {
+                double overlap = std::min(end, (double) j + 1) - std::max(start, (double) j);
+                if (overlap <= 0)
+                    continue;
+                index.push_back(j);
+                weight.push_back((float) (overlap / scale));
+            }
+        }
+        begin.push_back((int) index.size());
+    }
+};
 
-        // if file is passed as argument, handle it
-        if (argc == 2) {
-            std::string filename = argv[1];
-            filesystem::path path(filename);
+/// Convert one OpenEXR file into a PNG file, streaming the input row by row
+Vector2i tonemapFile(const std::string &input, const std::string &output, const TonemapOptions &options) {
+    EXRStripReader reader(input);
+    Vector2i srcSize = reader.getSize(), dstSize = options.size;
+    if (dstSize.x() <= 0 && dstSize.y() <= 0)
+        dstSize = srcSize;
+    else if (dstSize.y() <= 0)
+        dstSize.y() = std::max(1, (int) std::round((double) srcSize.y() * dstSize.x() / srcSize.x()));
+    else if (dstSize.x() <= 0)
+        dstSize.x() = std::max(1, (int) std::round((double) srcSize.x() * dstSize.y() / srcSize.y()));
 
-            if (path.extension() == "exr") {
-                Bitmap bitmap(filename);
+    Taps tapsX(srcSize.x(), dstSize.x()), tapsY(srcSize.y(), dstSize.y());
+    float scale = std::pow(2.f, options.exposure);
 
-                size_t lastdot = filename.find_last_of(".");
-                std::string pngFilename = filename.substr(0, lastdot) + ".png";
-                bitmap.saveToLDR(pngFilename);
+    std::unique_ptr<uint8_t[]> rgb8(new uint8_t[(size_t) 3 * dstSize.x() * dstSize.y()]);
+    std::vector<float> resampled(3 * dstSize.x()), accum(3 * dstSize.x());
+    int resampledRow = -1;
+
+    for (int y = 0; y < dstSize.y(); ++y) {
+        std::fill(accum.begin(), accum.end(), 0.f);
+        for (int t = tapsY.begin[y]; t < tapsY.begin[y + 1]; ++t) {
+            /* Neighboring output rows share input rows when upscaling */
+            if (tapsY.index[t] != resampledRow) {
+                resampledRow = tapsY.index[t];
+                const float *source = reader.row(resampledRow);
+                for (int x = 0; x < dstSize.x(); ++x) {
+                    float r = 0.f, g = 0.f, b = 0.f;
+                    for (int s = tapsX.begin[x]; s < tapsX.begin[x + 1]; ++s) {
+                        const float *value = source + 3 * tapsX.index[s];
+                        float w = tapsX.weight[s];
+                        r += w * value[0]; g += w * value[1]; b += w * value[2];
+                    }
+                    resampled[3 * x] = r; resampled[3 * x + 1] = g; resampled[3 * x + 2] = b;
+                }
+            }
+            float w = tapsY.weight[t];
+            for (size_t i = 0; i < accum.size(); ++i)
+                accum[i] += w * resampled[i];
+        }
+
+        uint8_t *target = rgb8.get() + (size_t) 3 * dstSize.x() * y;
+        for (size_t i = 0; i < accum.size(); ++i)
+            target[i] = linearToSRGB8(applyCurve(scale * accum[i], options.curve));
+    }
+
+    if (!stbi_write_png(output.c_str(), dstSize.x(), dstSize.y(), 3, rgb8.get(), 3 * dstSize.x()))
+        throw NoriException("Unable to write \"%s\"", output);
+    return dstSize;
+}
+
+bool isEXR(const std::string &filename) {
+    return endsWith(toLower(filename), ".exr");
+}
+
+/// Append all OpenEXR files of a directory
+void listDirectory(const std::string &dir, std::vector<std::string> &files) {
+#if defined(PLATFORM_WINDOWS)
+    _finddata_t data;
+    intptr_t handle = _findfirst((dir + "\\*.exr").c_str(), &data);
+    if (handle == -1)
+        return;
+    do {
+        if (!(data.attrib & _A_SUBDIR))
+            files.push_back(dir + "\\" + data.name);
+    } while (_findnext(handle, &data) == 0);
+    _findclose(handle);
+#else
+    DIR *d = opendir(dir.c_str());
+    if (!d)
+        throw NoriException("Unable to open directory \"%s\"", dir);
+    while (dirent *entry = readdir(d)) {
+        std::string name = entry->d_name;
+        if (isEXR(name) && filesystem::path(dir + "/" + name).is_file())
+            files.push_back(dir + "/" + name);
+    }
+    closedir(d);
+#endif
+}
+
+/// Append all files matching a wildcard pattern
+void expandPattern(const std::string &pattern, std::vector<std::string> &files) {
+#if defined(PLATFORM_WINDOWS)
+    std::string dir;
+    size_t sep = pattern.find_last_of("/\\");
+    if (sep != std::string::npos)
+        dir = pattern.substr(0, sep + 1);
+    _finddata_t data;
+    intptr_t handle = _findfirst(pattern.c_str(), &data);
+    if (handle == -1)
+        return;
+    do {
+        if (!(data.attrib & _A_SUBDIR))
+            files.push_back(dir + data.name);
+    } while (_findnext(handle, &data) == 0);
+    _findclose(handle);
+#else
+    glob_t result;
+    if (glob(pattern.c_str(), 0, nullptr, &result) == 0) {
+        for (size_t i = 0; i < result.gl_pathc; ++i)
+            files.push_back(result.gl_pathv[i]);
+    }
+    globfree(&result);
+#endif
+}
+
+std::string outputFilename(const std::string &input, const TonemapOptions &options) {
+    std::string base = input.substr(0, input.find_last_of(".")) + ".png";
+    if (options.outputDir.empty())
+        return base;
+    size_t sep = base.find_last_of("/\\");
+    return options.outputDir + "/" + (sep == std::string::npos ? base : base.substr(sep + 1));
+}
+
+void printUsage() {
+    cout << "Syntax: tonemapper [options] <file.exr | directory | pattern> ..." << endl
+         << "Converts OpenEXR images into PNG images, processing files in parallel." << endl << endl
+         << "Options:" << endl
+         << "  -e, --exposure <stops>  Exposure adjustment (default: 0)" << endl
+         << "  -c, --curve <name>      Tone curve: gamma, filmic or aces (default: gamma)" << endl
+         << "  -s, --size <W>x<H>      Output size; 0 for one side keeps the aspect ratio" << endl
+         << "  -o, --output <dir>      Output directory (default: next to each input)" << endl;
+}
+
+};
+
+int main(int argc, char **argv) {
+    try {
+        TonemapOptions options;
+        std::vector<std::string> inputs;
+
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+            if (arg == "-h" || arg == "--help") {
+                printUsage();
+                return 0;
+            } else if ((arg == "-e" || arg == "--exposure") && hasValue) {
+                options.exposure = toFloat(argv[++i]);
+            } else if ((arg == "-c" || arg == "--curve") && hasValue) {
+                std::string curve = toLower(argv[++i]);
+                if (curve == "gamma")
+                    options.curve = EGamma;
+                else if (curve == "filmic")
+                    options.curve = EFilmic;
+                else if (curve == "aces")
+                    options.curve = EACES;
+                else
+                    throw NoriException("Unknown tone curve \"%s\" (expected gamma, filmic or aces)", curve);
+            } else if ((arg == "-s" || arg == "--size") && hasValue) {
+                std::vector<std::string> tokens = tokenize(toLower(argv[++i]), "x");
+                if (tokens.size() != 2)
+                    throw NoriException("Invalid output size \"%s\" (expected <W>x<H>)", argv[i]);
+                options.size = Vector2i(toInt(tokens[0]), toInt(tokens[1]));
+            } else if ((arg == "-o" || arg == "--output") && hasValue) {
+                options.outputDir = argv[++i];
+                if (!filesystem::path(options.outputDir).is_directory())
+                    throw NoriException("Output directory \"%s\" does not exist", options.outputDir);
+            } else if (!arg.empty() && arg[0] == '-') {
+                throw NoriException("Unknown or incomplete option \"%s\"", arg);
             } else {
-                cerr << "Error: unknown file \"" << filename
-                << "\", expected an extension of type .exr" << endl;
+                inputs.push_back(arg);
             }
         }
 
+        /* Expand directories and wildcard patterns */
+        std::vector<std::string> files;
+        for (const std::string &input : inputs) {
+            if (filesystem::path(input).is_directory()) {
+                std::vector<std::string> dirFiles;
+                listDirectory(input, dirFiles);
+                std::sort(dirFiles.begin(), dirFiles.end());
+                files.insert(files.end(), dirFiles.begin(), dirFiles.end());
+            } else if (input.find_first_of("*?[") != std::string::npos) {
+                expandPattern(input, files);
+            } else if (isEXR(input)) {
+                files.push_back(input);
+            } else {
+                cerr << "Error: unknown file \"" << input
+                     << "\", expected an extension of type .exr" << endl;
+            }
+        }
+
+        if (files.empty()) {
+            printUsage();
+            return inputs.empty() ? 0 : -1;
+        }
+
+        Imf::setGlobalThreadCount(tbb::task_scheduler_init::default_num_threads());
+
+        tbb::mutex outputMutex;
+        std::atomic<int> failures(0);
+        tbb::parallel_for(size_t(0), files.size(), [&](size_t i) {
+            const std::string &input = files[i];
+            std::string output = outputFilename(input, options);
+            try {
+                Vector2i size = tonemapFile(input, output, options);
+                tbb::mutex::scoped_lock lock(outputMutex);
+                cout << "Wrote a " << size.x() << "x" << size.y() << " PNG file to \""
+                     << output << "\"" << endl;
+            } catch (const std::exception &e) {
+                tbb::mutex::scoped_lock lock(outputMutex);
+                cerr << "Error while converting \"" << input << "\": " << e.what() << endl;
+                ++failures;
+            }
+        });
 
+        if (files.size() > 1)
+            cout << "Converted " << files.size() - failures << " of " << files.size() << " files" << endl;
+        return failures > 0 ? -1 : 0;
     } catch (const std::exception &e) {
         cerr << "Fatal error: " << e.what() << endl;
         return -1;
     }
-    return 0;
 }
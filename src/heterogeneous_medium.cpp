@@ -1,12 +1,32 @@
 #include <nori/medium.h>
 #include <nori/sampler.h>
+#include <nori/timer.h>
+#include <nori/brickgrid.h>
+#include <nori/stats.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/parallel_reduce.h>
+#include <tbb/blocked_range.h>
+#include <pcg32.h>
+#include <memory>
 
 NORI_NAMESPACE_BEGIN
 
+NORI_STAT_RATIO(statFreePathSteps, "Medium", "Null-collision steps per free path");
+NORI_STAT_RATIO(statTransmittanceSteps, "Medium", "Ratio-tracking steps per transmittance");
+
 class HeterogeneousMedium : public Medium {
 
 private:
+    /// Read-only accessor which caches the most recently visited tree nodes
+    typedef openvdb::FloatGrid::ConstAccessor DensityAccessor;
+    /// One accessor per thread: OpenVDB accessors must not be shared between threads
+    typedef tbb::enumerable_thread_specific<DensityAccessor,
+        tbb::cache_aligned_allocator<DensityAccessor>, tbb::ets_key_per_instance> DensityAccessors;
+
     openvdb::FloatGrid::Ptr m_density;
+    std::unique_ptr<DensityAccessors> m_accessors;
+    std::unique_ptr<BrickGrid> m_bricks; // Flattened copy of the density grid (replaces m_density when set)
+    bool m_trilinear; // Interpolate between voxels instead of rounding to the nearest one
     Color3f m_sigmaA; // Absorption coefficient
     Color3f m_sigmaS; // Scattering coefficient
     Color3f m_sigmaT; // Extinction coefficient
@@ -31,6 +51,40 @@ public:
 
         auto filePath = props.getString("vdb_path");
 
+        /* Density reconstruction: "nearest" (default) or "trilinear" */
+        auto interpolation = toLower(props.getString("interpolation", "nearest"));
+        if (interpolation != "nearest" && interpolation != "trilinear")
+            throw NoriException("HeterogeneousMedium: unknown interpolation \"%s\"", interpolation);
+        m_trilinear = interpolation == "trilinear";
+
+        /* Density storage: "vdb" (default) or "bricks" (flat array of dense 8^3 bricks) */
+        auto storage = toLower(props.getString("storage", "vdb"));
+        if (storage != "vdb" && storage != "bricks")
+            throw NoriException("HeterogeneousMedium: unknown storage \"%s\"", storage);
+
+        auto precision = toLower(props.getString("brick_precision", "float"));
+        if (precision != "float" && precision != "half")
+            throw NoriException("HeterogeneousMedium: unknown brick precision \"%s\"", precision);
+
+        /* Optional cache file of the brick grid, which is memory-mapped on later runs */
+        auto cachePath = props.getString("brick_cache", "");
+        uint64_t sourceStamp = fileStamp(filePath);
+
+        if (storage == "bricks" && !cachePath.empty()) {
+            std::unique_ptr<BrickGrid> bricks(new BrickGrid());
+            if (bricks->load(cachePath, sourceStamp) &&
+                (bricks->getMaxValue() > 0) && (bricks->getMinValue() >= 0)) {
+                cout << "Memory-mapped density bricks from \"" << cachePath << "\"" << endl;
+                m_bricks = std::move(bricks);
+                m_bboxVoxelGrid = BoundingBox3i(m_bricks->getMin(),
+                    m_bricks->getMin() + m_bricks->getSize() - Vector3i(1));
+                m_maxDensity = m_bricks->getMaxValue();
+                if (props.getBoolean("benchmark", false))
+                    benchmarkLookups();
+                return;
+            }
+        }
+
         openvdb::initialize();
         openvdb::io::File file(filePath);
         file.open();
@@ -60,21 +114,52 @@ public:
 
         file.close();
 
-        m_maxDensity = 0;
-        for (int x = bboxMin.x(); x < bboxMax.x(); ++x) {
-            for (int y = bboxMin.y(); y < bboxMax.y(); ++y) {
-                for (int z = bboxMin.z(); z < bboxMax.z(); ++z) {
-                    auto density =  m_density->getAccessor().getValue(openvdb::Coord(x, y, z));
-                    m_maxDensity = std::max(m_maxDensity, density);
-                    if (density < 0) {
-                        throw NoriException("A negative density value is not allowed.");
+        /* Find the density range, one x-slab at a time in parallel */
+        typedef std::pair<float, float> Range;
+        Range range = tbb::parallel_reduce(
+            tbb::blocked_range<int>(bboxMin.x(), bboxMax.x() + 1),
+            Range(std::numeric_limits<float>::infinity(), 0.f),
+            [&](const tbb::blocked_range<int> &slabs, Range result) {
+                auto accessor = m_density->getConstAccessor();
+                for (int x = slabs.begin(); x != slabs.end(); ++x) {
+                    for (int y = bboxMin.y(); y <= bboxMax.y(); ++y) {
+                        for (int z = bboxMin.z(); z <= bboxMax.z(); ++z) {
+                            auto density = accessor.getValue(openvdb::Coord(x, y, z));
+                            result.first = std::min(result.first, density);
+                            result.second = std::max(result.second, density);
+                        }
                     }
                 }
+                return result;
+            },
+            [](const Range &a, const Range &b) {
+                return Range(std::min(a.first, b.first), std::max(a.second, b.second));
             }
+        );
+        if (range.first < 0) {
+            throw NoriException("A negative density value is not allowed.");
         }
+        m_maxDensity = range.second;
         if (m_maxDensity == 0) {
             throw NoriException("The density grid need to have at least one positive value.");
         }
+
+        /* Every thread lazily receives its own copy of this exemplar accessor */
+        m_accessors.reset(new DensityAccessors(m_density->getConstAccessor()));
+
+        if (storage == "bricks") {
+            buildBricks(precision == "half" ? BrickGrid::EFloat16 : BrickGrid::EFloat32);
+            if (!cachePath.empty()) {
+                m_bricks->save(cachePath, sourceStamp);
+                cout << "Wrote density bricks to \"" << cachePath << "\"" << endl;
+            }
+            /* The OpenVDB tree is no longer needed */
+            m_accessors.reset();
+            m_density.reset();
+        }
+
+        if (props.getBoolean("benchmark", false))
+            benchmarkLookups();
     }
 
     Color3f sampleFreePath(const Ray3f &ray, Sampler *sampler, MediumQueryRecord &mRec) const override {
@@ -84,13 +169,17 @@ public:
         rayIntersect(ray, nearT, farT);
         float tMax = std::min(mRec.tMax, farT);
 
+        NORI_STAT_ONLY(uint32_t steps = 0);
         while ((t += sampleDt(sampler)) < tMax) {
+            NORI_STAT_ONLY(++steps);
             if (evalDensity(ray(t)) / m_maxDensity > sampler->next1D()) {
                 mRec.hasInteraction = true;
                 mRec.p = ray(t);
+                NORI_STAT_RATIO_ADD(statFreePathSteps, steps, 1);
                 return m_sigmaS / m_sigmaT; // Real collision
             }
         }
+        NORI_STAT_RATIO_ADD(statFreePathSteps, steps, 1);
         return 1; // No real collision
     }
 
@@ -102,9 +191,12 @@ public:
         rayIntersect(ray, nearT, farT);
         float tMax = std::min(mRec.tMax, farT);
 
+        NORI_STAT_ONLY(uint32_t steps = 0);
         while ((t += sampleDt(sampler)) < tMax) {
+            NORI_STAT_ONLY(++steps);
             tr *= 1 - evalDensity(ray(t)) / m_maxDensity;
         }
+        NORI_STAT_RATIO_ADD(statTransmittanceSteps, steps, 1);
         return tr;
     }
 
@@ -116,12 +208,87 @@ public:
 
         Vector3i gridSize = m_bboxVoxelGrid.max - m_bboxVoxelGrid.min;
 
-        int x = m_bboxVoxelGrid.min.x() + int(round(pGrid.x() * gridSize.x()));
-        int y = m_bboxVoxelGrid.min.y() + int(round(pGrid.y() * gridSize.y()));
-        int z = m_bboxVoxelGrid.min.z() + int(round(pGrid.z() * gridSize.z()));
+        /* Continuous position in voxel coordinates (voxel centers are at integer positions) */
+        float x = m_bboxVoxelGrid.min.x() + pGrid.x() * gridSize.x();
+        float y = m_bboxVoxelGrid.min.y() + pGrid.y() * gridSize.y();
+        float z = m_bboxVoxelGrid.min.z() + pGrid.z() * gridSize.z();
+
+        if (m_bricks) {
+            const BrickGrid &bricks = *m_bricks;
+            return reconstruct(x, y, z, [&](int ix, int iy, int iz) {
+                return bricks.lookup(ix, iy, iz);
+            });
+        } else {
+            const DensityAccessor &accessor = m_accessors->local();
+            return reconstruct(x, y, z, [&](int ix, int iy, int iz) {
+                return accessor.getValue(openvdb::Coord(ix, iy, iz));
+            });
+        }
+    }
+
+    /// Reconstruct the density at a continuous voxel position from integer lookups
+    template <typename Lookup> float reconstruct(float x, float y, float z, const Lookup &lookup) const {
+        if (!m_trilinear)
+            return lookup(int(round(x)), int(round(y)), int(round(z)));
+
+        int x0 = (int) std::floor(x), y0 = (int) std::floor(y), z0 = (int) std::floor(z);
+        float fx = x - x0, fy = y - y0, fz = z - z0;
+
+        /* The eight lookups hit the same leaf node (or brick) most of the time */
+        float d000 = lookup(x0,     y0,     z0);
+        float d100 = lookup(x0 + 1, y0,     z0);
+        float d010 = lookup(x0,     y0 + 1, z0);
+        float d110 = lookup(x0 + 1, y0 + 1, z0);
+        float d001 = lookup(x0,     y0,     z0 + 1);
+        float d101 = lookup(x0 + 1, y0,     z0 + 1);
+        float d011 = lookup(x0,     y0 + 1, z0 + 1);
+        float d111 = lookup(x0 + 1, y0 + 1, z0 + 1);
+
+        return lerp(lerp(lerp(d000, d100, fx), lerp(d010, d110, fx), fy),
+                    lerp(lerp(d001, d101, fx), lerp(d011, d111, fx), fy), fz);
+    }
+
+    /// Copy the OpenVDB grid into a flat brick grid covering the file bounding box
+    void buildBricks(BrickGrid::EPrecision precision) {
+        Timer timer;
+        m_bricks.reset(new BrickGrid());
+        m_bricks->build(m_bboxVoxelGrid.min,
+            m_bboxVoxelGrid.max - m_bboxVoxelGrid.min + Vector3i(1), precision,
+            [&](const Point3i &origin, float *values) {
+                const DensityAccessor &accessor = m_accessors->local();
+                const int res = BrickGrid::BRICK_RES;
+                for (int z = 0; z < res; ++z)
+                    for (int y = 0; y < res; ++y)
+                        for (int x = 0; x < res; ++x)
+                            *values++ = accessor.getValue(openvdb::Coord(
+                                origin.x() + x, origin.y() + y, origin.z() + z));
+            }
+        );
+        cout << "Built density bricks in " << timer.elapsedString() << ": "
+             << m_bricks->getStoredBrickCount() << " bricks, "
+             << memString(m_bricks->getMemoryUsage()) << endl;
+    }
+
+    /// Measure the single-threaded throughput of \ref evalDensity() at random positions
+    void benchmarkLookups() const {
+        const int lookupCount = 1 << 22;
+        pcg32 random;
+        std::vector<Point3f> positions(lookupCount);
+        for (auto &p : positions) {
+            Vector3f u(random.nextFloat(), random.nextFloat(), random.nextFloat());
+            p = m_bbox.min + u.cwiseProduct(m_bbox.max - m_bbox.min);
+        }
+
+        Timer timer;
+        float sum = 0;
+        for (const auto &p : positions)
+            sum += evalDensity(p);
+        double elapsed = std::max(timer.elapsed(), 1.0);
 
-        openvdb::Coord xyz(x, y, z);
-        return m_density->getAccessor().getValue(xyz);
+        cout << tfm::format("Density lookups (%s, %s): %.2f M/s (checksum %f)",
+                            m_bricks ? "bricks" : "vdb",
+                            m_trilinear ? "trilinear" : "nearest",
+                            lookupCount / (elapsed * 1000.0), sum) << endl;
     }
 
     float sampleDt(Sampler *sampler) const {
@@ -137,7 +304,8 @@ public:
     }
 
     std::string toString() const override {
-        return "HeterogeneousMedium[]";
+        return tfm::format("HeterogeneousMedium[storage = %s, interpolation = %s]",
+                           m_bricks ? "bricks" : "vdb", m_trilinear ? "trilinear" : "nearest");
     }
 
 };
@@ -0,0 +1,169 @@
+#include <nori/texture.h>
+#include <nori/texcache.h>
+#include <filesystem/resolver.h>
+#include <tbb/enumerable_thread_specific.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Color texture backed by an image file
+ *
+ * The image is converted once into a tiled, MIP-mapped file (see
+ * \ref TiledImage) and texels are then fetched on demand through the global
+ * \ref TextureCache, so that the memory used by textures stays within the
+ * budget configured on the scene (\c textureCacheMB). Lookups with ray
+ * differentials blend the two MIP levels matching the pixel footprint.
+ *
+ * Every thread remembers the tiles it used last (one per MIP level parity,
+ * so that the two levels of a blend do not replace each other). Lookups that
+ * stay within these tiles do not go through the cache at all, which keeps
+ * the render threads off the shared lock words and reference counts of the
+ * cache. A remembered tile stays in memory until the thread moves on, even
+ * if the cache has evicted it in the meantime.
+ */
+class ImageTexture : public Texture<Color3f> {
+public:
+    ImageTexture(const PropertyList &props) {
+        filesystem::path filename =
+            getFileResolver()->resolve(props.getString("filename"));
+        m_filename = filename.str();
+
+        std::string precision = toLower(props.getString("precision", "half"));
+        TiledImage::EPrecision tiledPrecision;
+        if (precision == "float")
+            tiledPrecision = TiledImage::EFloat32;
+        else if (precision == "half")
+            tiledPrecision = TiledImage::EFloat16;
+        else if (precision == "byte")
+            tiledPrecision = TiledImage::EUInt8;
+        else
+            throw NoriException("ImageTexture: unknown precision \"%s\"", precision);
+
+        std::string wrap = toLower(props.getString("wrap", "repeat"));
+        if (wrap != "repeat" && wrap != "clamp")
+            throw NoriException("ImageTexture: unknown wrap mode \"%s\"", wrap);
+        m_repeat = wrap == "repeat";
+
+        std::string filter = toLower(props.getString("filter", "bilinear"));
+        if (filter != "nearest" && filter != "bilinear")
+            throw NoriException("ImageTexture: unknown filter \"%s\"", filter);
+        m_bilinear = filter == "bilinear";
+
+        m_scale = props.getVector2("scale", Vector2f(1));
+
+        /* The tiled version is stored next to the image unless specified otherwise */
+        std::string tiledFile = props.getString("tiledFilename", m_filename + "." + precision + ".tiles");
+        m_image.reset(new TiledImage(m_filename, tiledFile, tiledPrecision));
+    }
+
+    virtual Color3f eval(const Point2f &uv) const override {
+        return lookup(0, uv, tileRef(0));
+    }
+
+    /// Trilinear MIP map lookup over the pixel footprint given by the UV derivatives
+    virtual Color3f eval(const Point2f &uv, const Vector2f &dUVdx, const Vector2f &dUVdy) const override {
+        Vector2f size = m_image->getSize(0).cast<float>().cwiseProduct(m_scale);
+        float width = std::max(dUVdx.cwiseProduct(size).norm(), dUVdy.cwiseProduct(size).norm());
+        if (!(width > 1.f))
+            return lookup(0, uv, tileRef(0));
+
+        float level = std::log2(width);
+        int maxLevel = m_image->getLevelCount() - 1;
+        if (level >= maxLevel)
+            return lookup(maxLevel, uv, tileRef(maxLevel));
+
+        int level0 = (int) level;
+        float t = level - level0;
+        return (1.f - t) * lookup(level0, uv, tileRef(level0)) + t * lookup(level0 + 1, uv, tileRef(level0 + 1));
+    }
+
+    /// Finest-level lookups that reuse the current tile across the whole batch
+    virtual void evalBatch(const Point2f *uv, Color3f *result, size_t count) const override {
+        TileRef &tile = tileRef(0);
+        for (size_t i = 0; i < count; ++i)
+            result[i] = lookup(0, uv[i], tile);
+    }
+
+    virtual std::string toString() const override {
+        return tfm::format(
+            "ImageTexture[\n"
+            "  filename = \"%s\",\n"
+            "  size = %s,\n"
+            "  levels = %i,\n"
+            "  wrap = %s,\n"
+            "  filter = %s,\n"
+            "  scale = %s\n"
+            "]",
+            m_filename,
+            m_image->getSize(0).toString(),
+            m_image->getLevelCount(),
+            m_repeat ? "repeat" : "clamp",
+            m_bilinear ? "bilinear" : "nearest",
+            m_scale.toString()
+        );
+    }
+
+protected:
+    /// Most recently used tile of a lookup (neighboring texels mostly share it)
+    struct TileRef {
+        TextureCache::Tile data;
+        int level = -1, x = -1, y = -1;
+    };
+
+    /// Tiles most recently used by one thread, indexed by the parity of their MIP level
+    struct ThreadTiles {
+        TileRef tiles[2];
+    };
+
+    /// Return the tile of the calling thread that lookups in a MIP level should start from
+    TileRef &tileRef(int level) const {
+        return m_threadTiles.local().tiles[level & 1];
+    }
+
+    /// Filtered lookup in one MIP level (image rows run from v = 1 down to v = 0)
+    Color3f lookup(int level, const Point2f &uv, TileRef &tile) const {
+        const Vector2i &size = m_image->getSize(level);
+        float s = uv.x() * m_scale.x() * size.x(),
+              t = (1.f - uv.y() * m_scale.y()) * size.y();
+
+        if (!m_bilinear)
+            return texel(level, (int) std::floor(s), (int) std::floor(t), tile);
+
+        s -= 0.5f; t -= 0.5f;
+        int x0 = (int) std::floor(s), y0 = (int) std::floor(t);
+        float fx = s - x0, fy = t - y0;
+
+        return (1 - fy) * ((1 - fx) * texel(level, x0, y0, tile) + fx * texel(level, x0 + 1, y0, tile)) +
+                     fy * ((1 - fx) * texel(level, x0, y0 + 1, tile) + fx * texel(level, x0 + 1, y0 + 1, tile));
+    }
+
+    /// Fetch a single texel, applying the wrap mode
+    Color3f texel(int level, int x, int y, TileRef &tile) const {
+        const Vector2i &size = m_image->getSize(level);
+        if (m_repeat) {
+            x %= size.x(); if (x < 0) x += size.x();
+            y %= size.y(); if (y < 0) y += size.y();
+        } else {
+            x = clamp(x, 0, size.x() - 1);
+            y = clamp(y, 0, size.y() - 1);
+        }
+
+        const int res = TiledImage::TILE_RES;
+        int tx = x / res, ty = y / res;
+        if (tile.level != level || tile.x != tx || tile.y != ty) {
+            tile.data = TextureCache::instance().lookup(*m_image, level, tx, ty);
+            tile.level = level; tile.x = tx; tile.y = ty;
+        }
+        return m_image->decode(tile.data->data(), (y % res) * res + (x % res));
+    }
+
+    std::string m_filename;
+    std::unique_ptr<TiledImage> m_image;
+    Vector2f m_scale;
+    bool m_repeat;
+    bool m_bilinear;
+    mutable tbb::enumerable_thread_specific<ThreadTiles> m_threadTiles;
+};
+
+NORI_REGISTER_CLASS(ImageTexture, "image_texture");
+NORI_NAMESPACE_END
@@ -52,6 +52,10 @@ public:
         );
     }
 
+    void seed(uint64_t seed, uint64_t stream) {
+        m_random.seed(seed, stream);
+    }
+
     void generate() { /* No-op for this sampler */ }
     void advance()  { /* No-op for this sampler */ }
 
@@ -0,0 +1,27 @@
+#include <nori/integrator.h>
+#include <nori/scene.h>
+
+NORI_NAMESPACE_BEGIN
+
+Color3f Integrator::LiAOV(const Scene *scene, Sampler *sampler, const Ray3f &ray, AOVRecord &aovs) const {
+    Color3f result = Li(scene, sampler, ray);
+    estimateAOVs(scene, ray, result, aovs);
+    return result;
+}
+
+void Integrator::estimateAOVs(const Scene *scene, const Ray3f &ray, const Color3f &Li, AOVRecord &aovs) {
+    aovs.diffuse = Li;
+
+    Intersection its;
+    if (!scene->rayIntersect(ray, its))
+        return;
+    aovs.setSurface(its);
+
+    if (its.mesh->isEmitter()) {
+        EmitterQueryRecord lRec(ray.o, its.p, its.shFrame.n);
+        aovs.emission = its.mesh->getEmitter()->eval(lRec);
+        aovs.diffuse = Li - aovs.emission;
+    }
+}
+
+NORI_NAMESPACE_END
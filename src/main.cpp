@@ -18,12 +18,154 @@
 
 #include <nori/block.h>
 #include <nori/gui.h>
+#include <nori/bitmap.h>
+#include <nori/framebuffer.h>
+#include <nori/rfilter.h>
+#include <nori/samplebuffer.h>
+#include <nori/snapshot.h>
+#include <nori/stattest.h>
+#include <nori/trace.h>
 #include <filesystem/path.h>
+#include <chrono>
+#include <memory>
+#include <thread>
+
+/**
+ * Reconstruct the image stored in a sample file (see the "saveSamples"
+ * scene option) with another reconstruction filter, without re-rendering
+ */
+static int refilter(int argc, char **argv) {
+    using namespace nori;
+
+    if (argc < 4 || argc > 5) {
+        cerr << "Syntax: " << argv[0] << " --refilter <file.samples> <gaussian|mitchell|tent|box> [radius]" << endl;
+        return -1;
+    }
+
+    PropertyList props;
+    if (argc == 5)
+        props.setFloat("radius", (float) std::atof(argv[4]));
+    std::unique_ptr<NoriObject> filter(NoriObjectFactory::createInstance(argv[3], props));
+    if (filter->getClassType() != NoriObject::EReconstructionFilter)
+        throw NoriException("\"%s\" is not a reconstruction filter", argv[3]);
+    filter->activate();
+
+    std::string outputName = argv[2];
+    size_t lastdot = outputName.find_last_of(".");
+    if (lastdot != std::string::npos)
+        outputName.erase(lastdot, std::string::npos);
+    outputName += "_" + std::string(argv[3]);
+
+    std::unique_ptr<Bitmap> bitmap(SampleBuffer::refilter(argv[2],
+        static_cast<const ReconstructionFilter *>(filter.get())));
+    bitmap->save(outputName + ".exr");
+    bitmap->saveToLDR(outputName + ".png");
+    cout << "Wrote \"" << outputName << ".exr\" and \"" << outputName << ".png\"" << endl;
+    return 0;
+}
+
+/**
+ * Load an XML scene and store it as a binary snapshot, which can then be
+ * rendered without re-parsing meshes or rebuilding the BVH
+ */
+static int snapshot(int argc, char **argv) {
+    using namespace nori;
+
+    if (argc < 3 || argc > 4) {
+        cerr << "Syntax: " << argv[0] << " --snapshot <scene.xml> [snapshot.bin]" << endl;
+        return -1;
+    }
+
+    std::string outputName = argc == 4 ? argv[3] : argv[2];
+    if (argc == 3) {
+        size_t lastdot = outputName.find_last_of(".");
+        if (lastdot != std::string::npos)
+            outputName.erase(lastdot, std::string::npos);
+        outputName += ".bin";
+    }
+    createSnapshot(argv[2], outputName);
+    return 0;
+}
+
+/**
+ * Follow a render in another process through its live framebuffer (see the
+ * "liveFramebuffer" scene option), writing every new frame to an image until
+ * the render is complete
+ */
+static int watch(int argc, char **argv) {
+    using namespace nori;
+
+    if (argc < 3 || argc > 4) {
+        cerr << "Syntax: " << argv[0] << " --watch <scene.framebuffer> [output]" << endl;
+        return -1;
+    }
+
+    std::string outputName = argc == 4 ? argv[3] : argv[2];
+    if (argc == 3) {
+        size_t lastdot = outputName.find_last_of(".");
+        if (lastdot != std::string::npos)
+            outputName.erase(lastdot, std::string::npos);
+        outputName += "_live";
+    }
+
+    /* Interval between two polls of the file */
+    const std::chrono::milliseconds interval(250);
+
+    Bitmap bitmap;
+    uint32_t lastPasses = 0, passes = 0, totalPasses = 0;
+    bool found = false;
+    while (true) {
+        bool published = false;
+        if (filesystem::path(argv[2]).exists()) {
+            try {
+                published = LiveFramebuffer::read(argv[2], bitmap, passes, totalPasses);
+                found = true;
+            } catch (const NoriException &) {
+                /* The render may still be creating the file */
+                if (found)
+                    throw;
+            }
+        }
+
+        if (published && passes != lastPasses) {
+            bitmap.save(outputName + ".exr");
+            bitmap.saveToLDR(outputName + ".png");
+            cout << "Pass " << passes << "/" << totalPasses << ": wrote \"" << outputName
+                 << ".exr\" and \"" << outputName << ".png\"" << endl;
+            lastPasses = passes;
+            if (passes >= totalPasses)
+                return 0;
+        }
+        std::this_thread::sleep_for(interval);
+    }
+}
 
 int main(int argc, char **argv) {
     using namespace nori;
 
     try {
+        if (argc >= 2 && std::string(argv[1]) == "--refilter")
+            return refilter(argc, argv);
+        if (argc >= 2 && std::string(argv[1]) == "--snapshot")
+            return snapshot(argc, argv);
+        if (argc >= 2 && std::string(argv[1]) == "--watch")
+            return watch(argc, argv);
+        if (argc >= 2 && std::string(argv[1]) == "--test") {
+            /* Run all statistical tests of a directory, e.g. for CI */
+            if (argc != 3) {
+                cerr << "Syntax: " << argv[0] << " --test <directory>" << endl;
+                return -1;
+            }
+            return runTestDirectory(argv[2]) == 0 ? 0 : 1;
+        }
+
+        /* Record a timeline of every render (written to <scene>_trace.json) */
+        int fileArg = 1;
+        if (argc >= 2 && std::string(argv[1]) == "--trace") {
+            Trace::setEnabled(true);
+            fileArg = 2;
+        }
+
         nanogui::init();
 
         // Open the UI with a dummy image
@@ -31,11 +173,11 @@ int main(int argc, char **argv) {
         NoriScreen *screen = new NoriScreen(block);
 
         // if file is passed as argument, handle it
-        if (argc == 2) {
-            std::string filename = argv[1];
+        if (argc == fileArg + 1) {
+            std::string filename = argv[fileArg];
             filesystem::path path(filename);
 
-            if (path.extension() == "xml") {
+            if (path.extension() == "xml" || path.extension() == "bin") {
                 /* Render the XML scene file */
                 screen->openXML(filename);
             } else if (path.extension() == "exr") {
@@ -43,7 +185,7 @@ int main(int argc, char **argv) {
                 screen->openEXR(filename);
             } else {
                 cerr << "Error: unknown file \"" << filename
-                << "\", expected an extension of type .xml or .exr" << endl;
+                << "\", expected an extension of type .xml, .bin or .exr" << endl;
             }
         }
 
@@ -21,6 +21,7 @@
 #include <nori/bsdf.h>
 #include <nori/emitter.h>
 #include <nori/warp.h>
+#include <nori/snapshot.h>
 #include <Eigen/Geometry>
 
 NORI_NAMESPACE_BEGIN
@@ -30,11 +31,62 @@ Mesh::Mesh() { }
 void Mesh::activate() {
     Shape::activate();
 
+    /* The area CDF is part of scene snapshots */
+    Snapshot *snapshot = Snapshot::active();
+    std::vector<float> cdf, sum;
+    if (snapshot && !m_snapshotKey.empty() && snapshot->getVector(m_snapshotKey + ".cdf", cdf) &&
+        snapshot->getVector(m_snapshotKey + ".cdfSum", sum) && cdf.size() == getPrimitiveCount() + 1 &&
+        sum.size() == 1) {
+        m_pdf.setNormalizedCDF(cdf, sum[0]);
+        return;
+    }
+
     m_pdf.reserve(getPrimitiveCount());
     for(uint32_t i = 0 ; i < getPrimitiveCount() ; ++i) {
         m_pdf.append(surfaceArea(i));
     }
     m_pdf.normalize();
+
+    if (snapshot && !snapshot->isReading() && !m_snapshotKey.empty()) {
+        snapshot->putVector(m_snapshotKey + ".cdf", m_pdf.getCDF());
+        snapshot->putVector(m_snapshotKey + ".cdfSum", std::vector<float>(1, m_pdf.getSum()));
+    }
+}
+
+bool Mesh::loadFromSnapshot(const std::string &kind) {
+    Snapshot *snapshot = Snapshot::active();
+    if (!snapshot)
+        return false;
+    m_snapshotKey = snapshot->nextKey(kind);
+
+    Eigen::Matrix<float, 3, 2> bbox;
+    std::vector<char> name;
+    if (!snapshot->getMatrix(m_snapshotKey + ".V", m_V) ||
+        !snapshot->getMatrix(m_snapshotKey + ".N", m_N) ||
+        !snapshot->getMatrix(m_snapshotKey + ".UV", m_UV) ||
+        !snapshot->getMatrix(m_snapshotKey + ".F", m_F) ||
+        !snapshot->getMatrix(m_snapshotKey + ".bbox", bbox) ||
+        !snapshot->getVector(m_snapshotKey + ".name", name))
+        return false;
+
+    m_bbox = BoundingBox3f(bbox.col(0), bbox.col(1));
+    m_name.assign(name.begin(), name.end());
+    return true;
+}
+
+void Mesh::saveToSnapshot() const {
+    Snapshot *snapshot = Snapshot::active();
+    if (!snapshot || snapshot->isReading() || m_snapshotKey.empty())
+        return;
+
+    Eigen::Matrix<float, 3, 2> bbox;
+    bbox << m_bbox.min, m_bbox.max;
+    snapshot->putMatrix(m_snapshotKey + ".V", m_V);
+    snapshot->putMatrix(m_snapshotKey + ".N", m_N);
+    snapshot->putMatrix(m_snapshotKey + ".UV", m_UV);
+    snapshot->putMatrix(m_snapshotKey + ".F", m_F);
+    snapshot->putMatrix(m_snapshotKey + ".bbox", bbox);
+    snapshot->putVector(m_snapshotKey + ".name", std::vector<char>(m_name.begin(), m_name.end()));
 }
 
 void Mesh::sampleSurface(ShapeQueryRecord & sRec, const Point2f & sample) const {
@@ -142,6 +194,32 @@ void Mesh::setHitInformation(uint32_t index, const Ray3f &ray, Intersection & it
     /* Compute the geometry frame */
     its.geoFrame = Frame((p1-p0).cross(p2-p0).normalized());
 
+    /* Partial derivatives with respect to the UV parameterization
+       (the barycentric coordinates if the mesh has no texture coordinates) */
+    Vector2f duv1(1.f, 0.f), duv2(0.f, 1.f);
+    if (m_UV.size() > 0) {
+        duv1 = m_UV.col(idx1) - m_UV.col(idx0);
+        duv2 = m_UV.col(idx2) - m_UV.col(idx0);
+    }
+    float det = duv1.x() * duv2.y() - duv1.y() * duv2.x();
+    bool degenerateUV = std::abs(det) < 1e-12f;
+    float invDet = degenerateUV ? 0.f : 1.f / det;
+    if (degenerateUV) {
+        its.dpdu = its.geoFrame.s;
+        its.dpdv = its.geoFrame.t;
+    } else {
+        Vector3f dp1 = p1 - p0, dp2 = p2 - p0;
+        its.dpdu = ( duv2.y() * dp1 - duv1.y() * dp2) * invDet;
+        its.dpdv = (-duv2.x() * dp1 + duv1.x() * dp2) * invDet;
+    }
+
+    its.dndu = its.dndv = Vector3f(0.f);
+    if (m_N.size() > 0 && !degenerateUV) {
+        Vector3f dn1 = m_N.col(idx1) - m_N.col(idx0), dn2 = m_N.col(idx2) - m_N.col(idx0);
+        its.dndu = ( duv2.y() * dn1 - duv1.y() * dn2) * invDet;
+        its.dndv = (-duv2.x() * dn1 + duv1.x() * dn2) * invDet;
+    }
+
     if (m_N.size() > 0) {
         /* Compute the shading frame. Note that for simplicity,
            the current implementation doesn't attempt to provide
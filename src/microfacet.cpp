@@ -143,6 +143,10 @@ public:
         return eval(bRec) * cosTheta / pdf(bRec);
     }
 
+    virtual Color3f albedo(const BSDFQueryRecord &) const override {
+        return m_kd + Color3f(m_ks);
+    }
+
     virtual std::string toString() const override {
         return tfm::format(
             "Microfacet[\n"
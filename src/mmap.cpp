@@ -0,0 +1,74 @@
+#include <nori/mmap.h>
+
+#if defined(PLATFORM_WINDOWS)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+NORI_NAMESPACE_BEGIN
+
+#if defined(PLATFORM_WINDOWS)
+
+MemoryMappedFile::MemoryMappedFile(const std::string &filename) : m_filename(filename) {
+    m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                         OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE)
+        throw NoriException("MemoryMappedFile: could not open \"%s\"", filename);
+
+    LARGE_INTEGER size;
+    GetFileSizeEx(m_file, &size);
+    m_size = (size_t) size.QuadPart;
+
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mapping) {
+        CloseHandle(m_file);
+        throw NoriException("MemoryMappedFile: could not map \"%s\"", filename);
+    }
+    m_data = (const uint8_t *) MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!m_data) {
+        CloseHandle(m_mapping);
+        CloseHandle(m_file);
+        throw NoriException("MemoryMappedFile: could not map \"%s\"", filename);
+    }
+}
+
+MemoryMappedFile::~MemoryMappedFile() {
+    UnmapViewOfFile(m_data);
+    CloseHandle(m_mapping);
+    CloseHandle(m_file);
+}
+
+#else
+
+MemoryMappedFile::MemoryMappedFile(const std::string &filename) : m_filename(filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+        throw NoriException("MemoryMappedFile: could not open \"%s\": %s", filename, strerror(errno));
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw NoriException("MemoryMappedFile: could not stat \"%s\": %s", filename, strerror(errno));
+    }
+    m_size = (size_t) st.st_size;
+
+    void *ptr = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); /* The mapping keeps its own reference to the file */
+    if (ptr == MAP_FAILED)
+        throw NoriException("MemoryMappedFile: could not map \"%s\": %s", filename, strerror(errno));
+    m_data = (const uint8_t *) ptr;
+}
+
+MemoryMappedFile::~MemoryMappedFile() {
+    munmap((void *) m_data, m_size);
+}
+
+#endif
+
+NORI_NAMESPACE_END
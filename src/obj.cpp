@@ -32,6 +32,10 @@ public:
     WavefrontOBJ(const PropertyList &propList) {
         typedef std::unordered_map<OBJVertex, uint32_t, OBJVertexHash> VertexMap;
 
+        /* Skip parsing when loading a scene snapshot */
+        if (loadFromSnapshot("obj"))
+            return;
+
         filesystem::path filename =
             getFileResolver()->resolve(propList.getString("filename"));
 
@@ -129,6 +133,8 @@ public:
              << memString(m_F.size() * sizeof(uint32_t) +
                           sizeof(float) * (m_V.size() + m_N.size() + m_UV.size()))
              << ")" << endl;
+
+        saveToSnapshot();
     }
 
 protected:
@@ -18,34 +18,42 @@
 
 #include <nori/parser.h>
 #include <nori/proplist.h>
+#include <nori/trace.h>
 #include <Eigen/Geometry>
 #include <pugixml.hpp>
 #include <fstream>
+#include <iterator>
 #include <set>
 
 NORI_NAMESPACE_BEGIN
 
 NoriObject *loadFromXML(const std::string &filename) {
-    /* Load the XML file using 'pugi' (a tiny self-contained XML parser implemented in C++) */
+    std::ifstream is(filename, std::ios::binary);
+    if (is.fail())
+        throw NoriException("Error while parsing \"%s\": unable to open the file", filename);
+    std::string xml((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    return loadFromXMLString(xml, filename);
+}
+
+NoriObject *loadFromXMLString(const std::string &xml, const std::string &filename) {
+    /* Load the XML document using 'pugi' (a tiny self-contained XML parser implemented in C++) */
     pugi::xml_document doc;
-    pugi::xml_parse_result result = doc.load_file(filename.c_str());
+    pugi::xml_parse_result result;
+    {
+        NORI_TRACE_SCOPE("load", "Parse XML");
+        result = doc.load_buffer(xml.data(), xml.size());
+    }
 
     /* Helper function: map a position offset in bytes to a more readable row/column value */
     auto offset = [&](ptrdiff_t pos) -> std::string {
-        std::fstream is(filename);
-        char buffer[1024];
-        int line = 0, linestart = 0, offset = 0;
-        while (is.good()) {
-            is.read(buffer, sizeof(buffer));
-            for (int i = 0; i < is.gcount(); ++i) {
-                if (buffer[i] == '\n') {
-                    if (offset + i >= pos)
-                        return tfm::format("row %i, col %i", line + 1, pos - linestart);
-                    ++line;
-                    linestart = offset + i;
-                }
+        int line = 0, linestart = 0;
+        for (ptrdiff_t i = 0; i < (ptrdiff_t) xml.size(); ++i) {
+            if (xml[i] == '\n') {
+                if (i >= pos)
+                    return tfm::format("row %i, col %i", line + 1, pos - linestart);
+                ++line;
+                linestart = (int) i;
             }
-            offset += (int) is.gcount();
         }
         return "byte offset " + std::to_string(pos);
     };
@@ -188,6 +196,13 @@ NoriObject *loadFromXML(const std::string &filename) {
             if (currentIsObject) {
                 //check_attributes(node, { "type" });
 
+                /* Trace the construction and activation, e.g. "mesh obj" */
+                Trace::Scope traceScope("load");
+                if (traceScope.isActive()) {
+                    traceScope.setName(std::string(node.name()) + " " + node.attribute("type").value());
+                    traceScope.setArgs("\"name\": " + jsonString(node.attribute("name").value()));
+                }
+
                 /* This is an object, first instantiate it */
                 result = NoriObjectFactory::createInstance(
                     node.attribute("type").value(),
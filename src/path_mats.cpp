@@ -3,12 +3,16 @@
 #include <nori/bsdf.h>
 #include <nori/sampler.h>
 #include <nori/warp.h>
+#include <nori/stats.h>
+#include <nori/termination.h>
 
 NORI_NAMESPACE_BEGIN
 
+NORI_STAT_HISTOGRAM(statPathLength, "Integrator", "Path length", 16);
+
 class PathMatsIntegrator : public Integrator {
 public:
-    PathMatsIntegrator(const PropertyList &props) {}
+    PathMatsIntegrator(const PropertyList &props) : m_termination(props, .99f) {}
 
     Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray) const override {
 
@@ -18,6 +22,7 @@ public:
 
         Intersection x0;
         Ray3f pathRay = ray;
+        uint32_t depth = 0;
 
         while (true) {
 
@@ -41,6 +46,8 @@ public:
                 Tr = medium->sampleFreePath(pathRay, sampler, mRec);
             }
 
+            ++depth;
+
             // Volume interaction
             if (mRec.hasInteraction) {
 
@@ -67,29 +74,32 @@ public:
                 // Sample from BSDF
                 BSDFQueryRecord bRec(x0.shFrame.toLocal(-pathRay.d));
                 bRec.uv = x0.uv;
+                bRec.dUVdx = x0.dUVdx;
+                bRec.dUVdy = x0.dUVdy;
                 auto frCosThetaOverPdf = x0.mesh->getBSDF()->sample(bRec, sampler->next2D());
                 tNew = t * frCosThetaOverPdf;
 
-                pathRay = Ray3f(x0.p, x0.shFrame.toWorld(bRec.wo));
+                pathRay = x0.spawnRay(pathRay, bRec);
             }
             else {
                 break;
             }
 
-            // russian roulette with success probability p
-            auto p = std::min(t.maxCoeff(), .99f);
-            if (sampler->next1D() > p)  {
+            // Russian roulette and path length limit
+            t = tNew;
+            if (!m_termination.survive(depth, t, sampler))
                 break;
-            }
-            t = tNew / p;
         }
+        NORI_STAT_ADD(statPathLength, depth);
         return Li;
     }
 
     std::string toString() const override {
-        return "PathMatsIntegrator[]";
+        return tfm::format("PathMatsIntegrator[termination = %s]", m_termination.toString());
     }
 
+private:
+    PathTermination m_termination;
 };
 
 NORI_REGISTER_CLASS(PathMatsIntegrator, "path_mats");
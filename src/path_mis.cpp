@@ -2,30 +2,256 @@
 #include <nori/scene.h>
 #include <nori/bsdf.h>
 #include <nori/sampler.h>
+#include <nori/camera.h>
 #include <nori/warp.h>
+#include <nori/timer.h>
+#include <nori/stats.h>
+#include <nori/termination.h>
+#include <nori/trace.h>
+#include <nori/sdtree.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <tbb/enumerable_thread_specific.h>
 
 NORI_NAMESPACE_BEGIN
 
+NORI_STAT_HISTOGRAM(statPathLength, "Integrator", "Path length", 16);
+NORI_STAT_COUNTER(statSplits, "Integrator", "ADRRS splits");
+NORI_STAT_COUNTER(statAdrrsTerminations, "Integrator", "ADRRS terminations");
+
+namespace {
+    /**
+     * Coarse estimate of the radiance that the surfaces inside each cell of
+     * a uniform grid reflect along the paths reaching them (averaged over
+     * all visits, i.e. without any directional resolution)
+     */
+    class RadianceGrid {
+    public:
+        struct Cell {
+            double sum = 0;
+            uint32_t count = 0;
+        };
+
+        /// Cover the bounding box with cubic cells, \c resolution along its longest axis
+        void init(const BoundingBox3f &bbox, int resolution) {
+            m_bbox = bbox;
+            Vector3f extents = bbox.getExtents();
+            float cellSize = std::max(extents.maxCoeff() / resolution, Epsilon);
+            for (int i = 0; i < 3; ++i)
+                m_res[i] = std::max(1, (int) std::ceil(extents[i] / cellSize));
+            m_invCellSize = 1.f / cellSize;
+            m_cells.assign((size_t) m_res[0] * m_res[1] * m_res[2], Cell());
+        }
+
+        /// Return the index of the cell containing a point
+        size_t index(const Point3f &p) const {
+            Vector3f q = (p - m_bbox.min) * m_invCellSize;
+            int x = clamp((int) q.x(), 0, m_res[0] - 1),
+                y = clamp((int) q.y(), 0, m_res[1] - 1),
+                z = clamp((int) q.z(), 0, m_res[2] - 1);
+            return ((size_t) z * m_res[1] + y) * m_res[0] + x;
+        }
+
+        /// Return the mean radiance luminance around a point, or -1 if no path got there
+        float lookup(const Point3f &p) const {
+            const Cell &cell = m_cells[index(p)];
+            return cell.count > 0 ? (float) (cell.sum / cell.count) : -1.f;
+        }
+
+        /// Add the cells of another grid with the same layout
+        void merge(const std::vector<Cell> &cells) {
+            for (size_t i = 0; i < cells.size(); ++i) {
+                m_cells[i].sum += cells[i].sum;
+                m_cells[i].count += cells[i].count;
+            }
+        }
+
+        size_t getCellCount() const { return m_cells.size(); }
+
+        size_t getVisitedCellCount() const {
+            return (size_t) std::count_if(m_cells.begin(), m_cells.end(), [](const Cell &cell) { return cell.count > 0; });
+        }
+
+    private:
+        BoundingBox3f m_bbox;
+        int m_res[3] = { 0, 0, 0 };
+        float m_invCellSize = 0;
+        std::vector<Cell> m_cells;
+    };
+
+    /// Lowest survival probability of adjoint-driven Russian roulette
+    const float MinAdrrsSurvival = .05f;
+
+    /// Number of vertices per path whose radiance is recorded for path guiding
+    const int MaxGuidingVertices = 32;
+};
+
+/**
+ * \brief Path tracer with multiple importance sampling of emitters and BSDFs
+ *
+ * With <tt>&lt;boolean name="adrrs" value="true"/&gt;</tt>, paths are
+ * split and terminated by adjoint-driven Russian roulette and splitting
+ * (ADRRS, Vorba and Křivánek 2016). A short training pass
+ * (\c adrrsTrainingSpp camera paths per pixel) records the radiance reflected
+ * at every path vertex in a grid of \c adrrsGridResolution cells along the
+ * longest scene axis. While rendering, the expected contribution of the rest
+ * of a path (its throughput times the cached radiance) is compared to the
+ * estimate of the whole pixel, taken from the cache at the first vertex:
+ * paths above the weight window (of width \c adrrsWindow) are split into up
+ * to \c adrrsMaxSplits branches, paths below it are terminated by roulette.
+ * Where the cache has no estimate, and for the first \c minDepth bounces,
+ * the termination policy (see \ref PathTermination) applies as usual.
+ *
+ * With <tt>&lt;boolean name="guiding" value="true"/&gt;</tt>, directions at
+ * surfaces are sampled from a learned distribution of the incident radiance
+ * (practical path guiding, Müller et al. 2017, see \ref SDTree), combined
+ * with BSDF sampling by one-sample MIS (\c guidingBsdfFraction of the
+ * samples come from the BSDF). The distribution is trained during the first
+ * \c guidingIterations iterations of the render, iteration \c i lasting
+ * <tt>2^i</tt> passes, and is frozen afterwards. The spatial and directional
+ * trees never use more than \c guidingMemory MB. Media and discrete BSDFs
+ * are not guided.
+ */
 class PathMisIntegrator : public Integrator {
 public:
-    PathMisIntegrator(const PropertyList &props) {}
+    PathMisIntegrator(const PropertyList &props) : m_termination(props, .95f) {
+        m_adrrs = props.getBoolean("adrrs", false);
+        m_trainingSpp = props.getInteger("adrrsTrainingSpp", 1);
+        m_gridResolution = props.getInteger("adrrsGridResolution", 32);
+        m_maxSplits = props.getInteger("adrrsMaxSplits", 8);
+        float window = props.getFloat("adrrsWindow", 5.f);
+        if (m_trainingSpp < 1 || m_gridResolution < 1 || m_maxSplits < 1 || window < 1)
+            throw NoriException("PathMisIntegrator: invalid ADRRS parameters");
+
+        /* Weight window around the pixel estimate, as in the ADRRS paper */
+        m_windowMin = 2.f / (1.f + window);
+        m_windowMax = window * m_windowMin;
+
+        m_guiding = props.getBoolean("guiding", false);
+        m_guidingIterations = props.getInteger("guidingIterations", 5);
+        m_guidingBsdfFraction = props.getFloat("guidingBsdfFraction", .5f);
+        m_guidingMemory = props.getInteger("guidingMemory", 64);
+        if (m_guidingIterations < 0 || m_guidingBsdfFraction < 0 || m_guidingBsdfFraction >= 1 || m_guidingMemory < 1)
+            throw NoriException("PathMisIntegrator: invalid path guiding parameters");
+    }
+
+    void preprocess(const Scene *scene) override {
+        if (m_adrrs)
+            train(scene);
+
+        /* Created after the ADRRS training, which must not be guided */
+        m_guide.reset();
+        if (m_guiding) {
+            m_guide.reset(new SDTree(scene->getBoundingBox(), (size_t) m_guidingMemory * 1024 * 1024));
+            m_guidingIteration = 0;
+            m_guidingRecording = m_guidingIterations > 0;
+        }
+    }
+
+    void endPass(const Scene *scene, uint32_t pass) override {
+        if (!m_guide || !m_guidingRecording)
+            return;
+
+        /* Training iteration i lasts 2^i passes, i.e. iterations end after 2^n - 1 passes */
+        uint32_t passes = pass + 1;
+        if ((passes & (passes + 1)) != 0)
+            return;
+        m_guide->refine(m_guidingIteration);
+        if (++m_guidingIteration >= m_guidingIterations)
+            m_guidingRecording = false;
+    }
 
     Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray) const override {
+        return tracePath(scene, sampler, startPath(ray, nullptr), nullptr, nullptr);
+    }
+
+    Color3f LiAOV(const Scene *scene, Sampler *sampler, const Ray3f &ray, AOVRecord &aovs) const override {
+        return tracePath(scene, sampler, startPath(ray, &aovs), &aovs, nullptr);
+    }
+
+    std::string toString() const override {
+        return tfm::format("PathMisIntegrator[termination = %s, adrrs = %s, guiding = %s]", m_termination.toString(),
+                           m_adrrs ? tfm::format("{trainingSpp = %i, gridResolution = %i, window = [%f, %f], maxSplits = %i}",
+                                                 m_trainingSpp, m_gridResolution, m_windowMin, m_windowMax, m_maxSplits)
+                                   : std::string("off"),
+                           m_guiding ? tfm::format("{iterations = %i, bsdfFraction = %f, memory = %i MB}",
+                                                   m_guidingIterations, m_guidingBsdfFraction, m_guidingMemory)
+                                     : std::string("off"));
+    }
+
+private:
+    /// State of a path, or of one branch of a split path, before it traces its next segment
+    struct PathState {
+        Ray3f ray;
+        Color3f t;
+        float wMat;
+        uint32_t depth;
+        bool firstVertex;
+        Color3f *lobe;       ///< AOV receiving the contributions (diffuse until the first BSDF sample decides)
+        float pixelEstimate; ///< Expected luminance of the whole path for ADRRS (0 if unknown)
+    };
+
+    /// Surface vertex of a training path
+    struct TrainingVertex {
+        size_t cell;
+        Color3f t;  ///< Throughput of the rest of the path
+        Color3f Li; ///< Radiance collected before the rest of the path
+    };
 
-        Color3f t(1);
+    /// Surface vertex of a path whose incident radiance trains the guiding distribution
+    struct GuidingVertex {
+        SDTree::Region *region;
+        Vector3f dir; ///< Sampled direction (world space)
+        float pdf;    ///< Solid angle density of the direction
+        Color3f t;    ///< Throughput after the vertex
+        Color3f Li;   ///< Radiance collected up to the vertex (including its emitter sample)
+    };
+
+    static PathState startPath(const Ray3f &ray, AOVRecord *aovs) {
+        PathState path;
+        path.ray = ray;
+        path.t = Color3f(1);
+        path.wMat = 1.f;
+        path.depth = 0;
+        path.firstVertex = true;
+        path.lobe = aovs ? &aovs->diffuse : nullptr;
+        path.pixelEstimate = 0.f;
+        return path;
+    }
+
+    /**
+     * Trace a path, optionally splitting its contributions by the lobe of the
+     * first bounce. If \c training is given, the surface vertices of the path
+     * are recorded there
+     */
+    Color3f tracePath(const Scene *scene, Sampler *sampler, PathState path, AOVRecord *aovs,
+                      std::vector<TrainingVertex> *training) const {
         Color3f Li(0);
 
         Intersection x0;
-        Ray3f pathRay = ray;
+        auto contribute = [&](const Color3f &value) {
+            Li += value;
+            if (path.lobe)
+                *path.lobe += value;
+        };
 
         auto wEm = 1.f;
-        auto wMat = 1.f;
+
+        GuidingVertex guidingVertices[MaxGuidingVertices];
+        int guidingVertexCount = 0;
+        bool recordGuiding = m_guide && m_guidingRecording;
 
         while (true) {
+            Ray3f &pathRay = path.ray;
+            Color3f &t = path.t;
 
             if (!scene->rayIntersect(pathRay, x0)) {
                 break;
             }
+            ++path.depth;
+
+            if (aovs && path.firstVertex)
+                aovs->setSurface(x0);
 
             float tMax = pathRay.maxt;
             float nearT, farT;
@@ -47,14 +273,11 @@ public:
 
                 // Multiply with transmittance
                 t *= Tr;
-                Li += t;
+                contribute(t);
 
-                // russian roulette with termination probability (1 - p)
-                auto p = std::min(t.maxCoeff(), .95f);
-                if (sampler->next1D() > p) {
+                // Russian roulette and path length limit
+                if (!m_termination.survive(path.depth, t, sampler))
                     break;
-                }
-                t /= p;
 
                 auto emitter = scene->getRandomEmitter(sampler->next1D());
                 EmitterQueryRecord eRec(mRec.p);
@@ -69,7 +292,7 @@ public:
                         wEm = pdfEm / (pdfEm + pdfMat);
                     }
 
-                    Li += wEm * t * Tr * LeOverPdf;
+                    contribute(wEm * t * Tr * LeOverPdf);
                 }
 
                 // Isotropic Scattering
@@ -77,6 +300,7 @@ public:
                 auto pdfMat = Warp::squareToUniformSpherePdf(direction);
 
                 pathRay = Ray3f(mRec.p, direction);
+                path.firstVertex = false;
 
                 // Compute new wMat
                 Intersection its;
@@ -85,7 +309,7 @@ public:
                         EmitterQueryRecord itsERec(pathRay.o, its.p, its.shFrame.n);
                         auto pdfEm = its.mesh->getEmitter()->pdf(itsERec);
                         if (pdfEm + pdfMat > 0) {
-                            wMat = pdfMat / (pdfEm + pdfMat);
+                            path.wMat = pdfMat / (pdfEm + pdfMat);
                         }
                     }
                 }
@@ -98,71 +322,262 @@ public:
                 }
 
                 // Contrib from material sampling
-                Li += wMat * t * Le;
+                if (aovs && path.firstVertex) {
+                    Li += path.wMat * t * Le;
+                    aovs->emission += path.wMat * t * Le;
+                } else {
+                    contribute(path.wMat * t * Le);
+                }
+
+                // The cached radiance of the first vertex estimates the whole pixel
+                float cached = m_adrrs ? m_grid.lookup(x0.p) : -1.f;
+                if (path.firstVertex && m_adrrs)
+                    path.pixelEstimate = Li.getLuminance() + std::max(cached, 0.f);
 
-                // russian roulette with termination probability (1 - p)
-                auto p = std::min(t.maxCoeff(), .95f);
-                if (sampler->next1D() > p) {
+                // Russian roulette, splitting and path length limit
+                int branches = continuation(path, cached, sampler);
+                if (branches == 0)
                     break;
-                }
-                t /= p;
-
-                // Contribution from emitter sampling
-                auto light = scene->getRandomEmitter(sampler->next1D());
-                EmitterQueryRecord lRec(x0.p);
-                Color3f LeOverPdf = light->sample(lRec, sampler->next2D()) * scene->getLights().size();
-                if (!scene->rayIntersect(lRec.shadowRay)) {
-                    auto localRay = x0.shFrame.toLocal(-pathRay.d); // wi
-                    auto localLRec = x0.shFrame.toLocal(lRec.wi); // wo
-                    auto cosTheta = Frame::cosTheta(localLRec);
-                    BSDFQueryRecord bsdfRec(localRay, localLRec, ESolidAngle);
-                    bsdfRec.uv = x0.uv;
-                    auto fr = x0.mesh->getBSDF()->eval(bsdfRec);
-
-                    auto pdfEm = light->pdf(lRec);
-                    auto pdfMat = x0.mesh->getBSDF()->pdf(bsdfRec);
-                    if (pdfEm + pdfMat != 0) {
-                        wEm = pdfEm / (pdfEm + pdfMat);
-                    }
 
-                    Li += wEm * t * (fr * LeOverPdf * cosTheta);
+                if (training)
+                    training->push_back(TrainingVertex { m_grid.index(x0.p), t, Li });
+
+                SDTree::Region *region = m_guide ? m_guide->lookup(x0.p) : nullptr;
+                float pdf;
+
+                // Every additional branch continues the path independently
+                for (int k = 1; k < branches; ++k) {
+                    PathState branch = path;
+                    Color3f *lobe = branch.lobe;
+                    Color3f LeSample = scatter(scene, sampler, x0, branch, aovs, region, pdf);
+                    Li += LeSample;
+                    if (lobe)
+                        *lobe += LeSample;
+                    Li += tracePath(scene, sampler, branch, aovs, nullptr);
                 }
 
+                contribute(scatter(scene, sampler, x0, path, aovs, region, pdf));
+
+                if (recordGuiding && pdf > 0 && guidingVertexCount < MaxGuidingVertices)
+                    guidingVertices[guidingVertexCount++] = GuidingVertex { region, path.ray.d, pdf, path.t, Li };
+            }
+        }
+        NORI_STAT_ADD(statPathLength, path.depth);
 
-                // Sample from BSDF
-                BSDFQueryRecord bRec(x0.shFrame.toLocal(-pathRay.d));
-                bRec.uv = x0.uv;
-                auto frCosThetaOverPdf = x0.mesh->getBSDF()->sample(bRec, sampler->next2D());
+        /* Radiance that arrived at each vertex from its sampled direction */
+        for (int i = 0; i < guidingVertexCount; ++i) {
+            const GuidingVertex &vertex = guidingVertices[i];
+            Color3f Lin = Li - vertex.Li;
+            for (int ch = 0; ch < 3; ++ch)
+                Lin[ch] = vertex.t[ch] > 0 ? Lin[ch] / vertex.t[ch] : 0.f;
+            vertex.region->recording.record(vertex.dir, Lin.getLuminance() / vertex.pdf);
+        }
+        return Li;
+    }
 
-                pathRay = Ray3f(x0.p, x0.shFrame.toWorld(bRec.wo));
-                t *= frCosThetaOverPdf;
+    /**
+     * Sample an emitter and the next direction at a surface vertex. Returns
+     * the contribution of the emitter sample and continues \c path in the
+     * sampled direction, whose solid angle density is stored in \c pdf (0 for
+     * discrete directions). The direction is guided by the distribution of
+     * \c region, if it has learned one
+     */
+    Color3f scatter(const Scene *scene, Sampler *sampler, const Intersection &x0, PathState &path,
+                    AOVRecord *aovs, SDTree::Region *region, float &pdf) const {
+        Ray3f pathRay = path.ray;
+        Color3f result(0);
+        const BSDF *bsdf = x0.mesh->getBSDF();
 
-                // Compute new wMat
-                if (bRec.measure == EDiscrete) {
-                    wMat = 1;
-                }
-                else {
-                    Intersection its;
-                    if (scene->rayIntersect(pathRay, its)) {
-                        if (its.mesh->isEmitter()) {
-                            EmitterQueryRecord itsERec(x0.p, its.p, its.shFrame.n);
-                            auto pdfMat = x0.mesh->getBSDF()->pdf(bRec);
-                            auto pdfEm = its.mesh->getEmitter()->pdf(itsERec);
-                            if (pdfEm + pdfMat > 0) {
-                                wMat = pdfMat / (pdfEm + pdfMat);
-                            }
-                        }
+        /* One-sample MIS of BSDF and guided sampling */
+        const DTree *guide = region && !bsdf->isDelta() && region->sampling.isValid() ? &region->sampling : nullptr;
+        float bsdfFraction = guide ? m_guidingBsdfFraction : 1.f;
+        auto mixturePdf = [&](const Vector3f &wo, float pdfBsdf) {
+            return guide ? bsdfFraction * pdfBsdf + (1 - bsdfFraction) * guide->pdf(wo) : pdfBsdf;
+        };
+
+        // Contribution from emitter sampling
+        auto light = scene->getRandomEmitter(sampler->next1D());
+        EmitterQueryRecord lRec(x0.p);
+        Color3f LeOverPdf = light->sample(lRec, sampler->next2D()) * scene->getLights().size();
+        if (!scene->rayIntersect(lRec.shadowRay)) {
+            auto localRay = x0.shFrame.toLocal(-pathRay.d); // wi
+            auto localLRec = x0.shFrame.toLocal(lRec.wi); // wo
+            auto cosTheta = Frame::cosTheta(localLRec);
+            BSDFQueryRecord bsdfRec(localRay, localLRec, ESolidAngle);
+            bsdfRec.uv = x0.uv;
+            bsdfRec.dUVdx = x0.dUVdx;
+            bsdfRec.dUVdy = x0.dUVdy;
+            auto fr = bsdf->eval(bsdfRec);
+
+            auto wEm = 1.f;
+            auto pdfEm = light->pdf(lRec);
+            auto pdfMat = mixturePdf(lRec.wi, bsdf->pdf(bsdfRec));
+            if (pdfEm + pdfMat != 0) {
+                wEm = pdfEm / (pdfEm + pdfMat);
+            }
+
+            result = wEm * path.t * (fr * LeOverPdf * cosTheta);
+        }
+
+        // Sample from BSDF or from the guiding distribution
+        BSDFQueryRecord bRec(x0.shFrame.toLocal(-pathRay.d));
+        bRec.uv = x0.uv;
+        bRec.dUVdx = x0.dUVdx;
+        bRec.dUVdy = x0.dUVdy;
+        Color3f frCosThetaOverPdf;
+        pdf = -1.f; /* Not computed yet */
+        if (guide && sampler->next1D() >= bsdfFraction) {
+            Vector3f wo = guide->sample(sampler->next2D());
+            bRec.wo = x0.shFrame.toLocal(wo);
+            bRec.measure = ESolidAngle;
+            bRec.eta = 1.f;
+            pdf = mixturePdf(wo, bsdf->pdf(bRec));
+            frCosThetaOverPdf = pdf > 0 ? bsdf->eval(bRec) * std::abs(Frame::cosTheta(bRec.wo)) / pdf : Color3f(0.f);
+        } else {
+            frCosThetaOverPdf = bsdf->sample(bRec, sampler->next2D());
+            if (bRec.measure == EDiscrete) {
+                frCosThetaOverPdf /= bsdfFraction;
+                pdf = 0.f;
+            } else if (guide) {
+                float pdfBsdf = bsdf->pdf(bRec);
+                pdf = mixturePdf(x0.shFrame.toWorld(bRec.wo), pdfBsdf);
+                frCosThetaOverPdf = pdf > 0 ? Color3f(frCosThetaOverPdf * (pdfBsdf / pdf)) : Color3f(0.f);
+            }
+        }
+        if (pdf < 0 && region)
+            pdf = bsdf->pdf(bRec);
+
+        path.ray = x0.spawnRay(pathRay, bRec);
+        path.t *= frCosThetaOverPdf;
+
+        if (aovs && path.firstVertex)
+            path.lobe = bRec.measure == EDiscrete ? &aovs->specular : &aovs->diffuse;
+        path.firstVertex = false;
+
+        // Compute new wMat
+        if (bRec.measure == EDiscrete) {
+            path.wMat = 1;
+        }
+        else {
+            Intersection its;
+            if (scene->rayIntersect(path.ray, its)) {
+                if (its.mesh->isEmitter()) {
+                    EmitterQueryRecord itsERec(x0.p, its.p, its.shFrame.n);
+                    auto pdfMat = pdf >= 0 ? pdf : bsdf->pdf(bRec);
+                    auto pdfEm = its.mesh->getEmitter()->pdf(itsERec);
+                    if (pdfEm + pdfMat > 0) {
+                        path.wMat = pdfMat / (pdfEm + pdfMat);
                     }
                 }
             }
         }
-        return Li;
+        return result;
     }
 
-    std::string toString() const override {
-        return "PathMisIntegrator[]";
+    /**
+     * Decide how many branches continue a path at a surface vertex (0 if it
+     * is terminated) and divide its throughput among them
+     */
+    int continuation(PathState &path, float cached, Sampler *sampler) const {
+        /* Bounces up to minDepth and beyond maxDepth follow the termination policy */
+        int maxDepth = m_termination.getMaxDepth();
+        if (!m_adrrs || cached < 0 || path.pixelEstimate <= 0 ||
+            path.depth <= (uint32_t) m_termination.getMinDepth() ||
+            (maxDepth >= 0 && path.depth > (uint32_t) maxDepth))
+            return m_termination.survive(path.depth, path.t, sampler) ? 1 : 0;
+
+        /* Expected contribution of the rest of the path relative to the pixel */
+        float ratio = path.t.getLuminance() * cached / path.pixelEstimate;
+        if (ratio < m_windowMin) {
+            float q = std::max(ratio, MinAdrrsSurvival);
+            if (sampler->next1D() >= q) {
+                NORI_STAT_ADD(statAdrrsTerminations, 1);
+                return 0;
+            }
+            path.t /= q;
+            return 1;
+        }
+        if (ratio > m_windowMax) {
+            int branches = std::min((int) (ratio + sampler->next1D()), m_maxSplits);
+            path.t /= (float) branches;
+            NORI_STAT_ADD(statSplits, branches - 1);
+            return branches;
+        }
+        return 1;
     }
 
+    /// Fill the radiance grid from a low-resolution pass of camera paths
+    void train(const Scene *scene) {
+        NORI_TRACE_SCOPE("preprocess", "ADRRS training");
+        cout << "Training the ADRRS radiance cache (" << m_trainingSpp << " spp) .. ";
+        cout.flush();
+        Timer timer;
+
+        /* The grid is empty while training, so the paths are terminated by the usual policy */
+        m_grid.init(scene->getBoundingBox(), m_gridResolution);
+
+        const Camera *camera = scene->getCamera();
+        Vector2i size = camera->getOutputSize();
+        size_t cellCount = m_grid.getCellCount();
+        tbb::enumerable_thread_specific<std::vector<RadianceGrid::Cell>> threadCells([cellCount] {
+            return std::vector<RadianceGrid::Cell>(cellCount);
+        });
+
+        tbb::parallel_for(tbb::blocked_range<int>(0, size.y()), [&](const tbb::blocked_range<int> &range) {
+            std::unique_ptr<Sampler> sampler(scene->getSampler()->clone());
+            std::vector<RadianceGrid::Cell> &cells = threadCells.local();
+            std::vector<TrainingVertex> vertices;
+
+            for (int y = range.begin(); y < range.end(); ++y) {
+                sampler->seed((uint64_t) y, 0x5eed);
+                for (int x = 0; x < size.x(); ++x) {
+                    for (int s = 0; s < m_trainingSpp; ++s) {
+                        Ray3f ray;
+                        Point2f pixelSample = Point2f((float) x, (float) y) + sampler->next2D();
+                        camera->sampleRay(ray, pixelSample, sampler->next2D());
+
+                        vertices.clear();
+                        Color3f Li = tracePath(scene, sampler.get(), startPath(ray, nullptr), nullptr, &vertices);
+
+                        /* Radiance reflected at each vertex: what the path collected afterwards */
+                        for (const TrainingVertex &vertex : vertices) {
+                            Color3f Lr = Li - vertex.Li;
+                            for (int ch = 0; ch < 3; ++ch)
+                                Lr[ch] = vertex.t[ch] > 0 ? Lr[ch] / vertex.t[ch] : 0.f;
+                            float luminance = Lr.getLuminance();
+                            if (!std::isfinite(luminance))
+                                continue;
+                            cells[vertex.cell].sum += luminance;
+                            cells[vertex.cell].count++;
+                        }
+                    }
+                }
+            }
+        });
+
+        for (const std::vector<RadianceGrid::Cell> &cells : threadCells)
+            m_grid.merge(cells);
+
+        cout << "done. (took " << timer.elapsedString() << ", " << m_grid.getVisitedCellCount()
+             << " of " << m_grid.getCellCount() << " cells visited)" << endl;
+    }
+
+    PathTermination m_termination;
+
+    bool m_adrrs;
+    int m_trainingSpp;
+    int m_gridResolution;
+    int m_maxSplits;
+    float m_windowMin, m_windowMax;
+    RadianceGrid m_grid;
+
+    bool m_guiding;
+    int m_guidingIterations;
+    float m_guidingBsdfFraction;
+    int m_guidingMemory;
+    std::unique_ptr<SDTree> m_guide;
+    int m_guidingIteration = 0;
+    bool m_guidingRecording = false;
 };
 
 NORI_REGISTER_CLASS(PathMisIntegrator, "path_mis");
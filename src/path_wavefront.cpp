@@ -0,0 +1,206 @@
+#include <nori/integrator.h>
+#include <nori/scene.h>
+#include <nori/bsdf.h>
+#include <nori/sampler.h>
+#include <nori/raypacket.h>
+#include <nori/stats.h>
+#include <nori/termination.h>
+#include <algorithm>
+#include <memory>
+
+NORI_NAMESPACE_BEGIN
+
+NORI_STAT_HISTOGRAM(statPathLength, "Integrator", "Path length", 16);
+
+/**
+ * \brief Path tracer with multiple importance sampling that processes a
+ * whole image block at a time
+ *
+ * Instead of following one path to the end before starting the next, all
+ * paths of a block are advanced together, one bounce per iteration. Every
+ * bounce runs a fixed sequence of stages as batched loops over a queue of
+ * path states stored in structure-of-arrays layout:
+ *
+ *  1. Extend: trace the next ray of every live path as one ray stream
+ *  2. Emission and Russian roulette: account for hit emitters, drop paths
+ *  3. Shade: sample an emitter and the BSDF, sorted by BSDF so that paths
+ *     hitting the same material are shaded back to back
+ *  4. Shadow: trace all shadow rays as one occlusion stream
+ *
+ * Produces the same estimator as \c path_mis for surfaces. Participating
+ * media are not supported.
+ */
+class PathWavefrontIntegrator : public Integrator {
+public:
+    PathWavefrontIntegrator(const PropertyList &props) : m_termination(props, .95f) {}
+
+    void preprocess(const Scene *scene) override {
+        if (!scene->getMedia().empty())
+            throw NoriException("PathWavefrontIntegrator: participating media are not supported, use \"path_mis\" instead");
+    }
+
+    Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray) const override {
+        Color3f result;
+        LiBatch(scene, sampler, &ray, &result, 1);
+        return result;
+    }
+
+    bool isBatched() const override { return true; }
+
+    void LiBatch(const Scene *scene, Sampler *sampler, const Ray3f *rays,
+                 Color3f *Li, size_t count) const override {
+        PathStates paths(count);
+        for (size_t i = 0; i < count; ++i) {
+            paths.rays.set(i, rays[i]);
+            paths.queue[i] = (uint32_t) i;
+            Li[i] = Color3f(0.f);
+        }
+
+        std::vector<uint32_t> survivors;
+        survivors.reserve(count);
+
+        while (!paths.queue.empty()) {
+            size_t queueSize = paths.queue.size();
+
+            /* Extend: gather the rays of the live paths and trace them together */
+            RayStream extend(queueSize);
+            for (size_t k = 0; k < queueSize; ++k)
+                extend.set(k, paths.rays.get(paths.queue[k]));
+            scene->rayIntersect(extend, paths.its.data(), paths.hit.get());
+
+            /* Ray streams carry no differentials: recover them for the camera rays */
+            if (queueSize == count && paths.bounces[paths.queue[0]] == 0) {
+                for (size_t k = 0; k < queueSize; ++k) {
+                    if (paths.hit[k])
+                        paths.its[k].computeDifferentials(rays[paths.queue[k]]);
+                }
+            }
+
+            /* Emission and Russian roulette */
+            survivors.clear();
+            for (size_t k = 0; k < queueSize; ++k) {
+                uint32_t i = paths.queue[k];
+                if (!paths.hit[k]) {
+                    NORI_STAT_ADD(statPathLength, paths.bounces[i]);
+                    continue;
+                }
+
+                const Intersection &its = paths.its[k];
+                if (its.mesh->isEmitter()) {
+                    EmitterQueryRecord lRec(paths.origin[i], its.p, its.shFrame.n);
+                    Color3f Le = its.mesh->getEmitter()->eval(lRec);
+
+                    /* Weight of the BSDF sample that led here */
+                    float wMat = 1.f;
+                    if (paths.bounces[i] > 0 && !paths.discrete[i]) {
+                        float pdfEm = its.mesh->getEmitter()->pdf(lRec);
+                        if (pdfEm + paths.pdfMat[i] > 0)
+                            wMat = paths.pdfMat[i] / (pdfEm + paths.pdfMat[i]);
+                    }
+                    Li[i] += wMat * paths.throughput[i] * Le;
+                }
+
+                /* Russian roulette and path length limit */
+                if (!m_termination.survive(paths.bounces[i] + 1, paths.throughput[i], sampler)) {
+                    NORI_STAT_ADD(statPathLength, paths.bounces[i] + 1);
+                    continue;
+                }
+
+                paths.slot[i] = (uint32_t) k;
+                survivors.push_back(i);
+            }
+
+            if (survivors.empty())
+                break;
+
+            /* Group the surviving paths by material to keep the shading loop coherent */
+            std::sort(survivors.begin(), survivors.end(), [&](uint32_t a, uint32_t b) {
+                const BSDF *bsdfA = paths.its[paths.slot[a]].mesh->getBSDF(),
+                           *bsdfB = paths.its[paths.slot[b]].mesh->getBSDF();
+                return bsdfA != bsdfB ? std::less<const BSDF *>()(bsdfA, bsdfB) : a < b;
+            });
+
+            /* Shade: emitter sampling (deferred) and BSDF sampling */
+            RayStream shadow(survivors.size());
+            std::vector<Color3f> shadowContrib(survivors.size());
+            for (size_t k = 0; k < survivors.size(); ++k) {
+                uint32_t i = survivors[k];
+                const Intersection &its = paths.its[paths.slot[i]];
+                const BSDF *bsdf = its.mesh->getBSDF();
+                Vector3f wi = its.shFrame.toLocal(-paths.rays.get(i).d);
+
+                /* Contribution from emitter sampling, pending a visibility test */
+                const Emitter *light = scene->getRandomEmitter(sampler->next1D());
+                EmitterQueryRecord lRec(its.p);
+                Color3f LeOverPdf = light->sample(lRec, sampler->next2D()) * scene->getLights().size();
+
+                BSDFQueryRecord lbRec(wi, its.shFrame.toLocal(lRec.wi), ESolidAngle);
+                lbRec.uv = its.uv;
+                lbRec.dUVdx = its.dUVdx;
+                lbRec.dUVdy = its.dUVdy;
+                Color3f fr = bsdf->eval(lbRec);
+
+                float pdfEm = light->pdf(lRec);
+                float pdfMat = bsdf->pdf(lbRec);
+                float wEm = pdfEm + pdfMat != 0 ? pdfEm / (pdfEm + pdfMat) : 1.f;
+
+                shadow.set(k, lRec.shadowRay);
+                shadowContrib[k] = wEm * paths.throughput[i] * fr * LeOverPdf * Frame::cosTheta(lbRec.wo);
+
+                /* Sample the BSDF to continue the path */
+                BSDFQueryRecord bRec(wi);
+                bRec.uv = its.uv;
+                bRec.dUVdx = its.dUVdx;
+                bRec.dUVdy = its.dUVdy;
+                Color3f frCosThetaOverPdf = bsdf->sample(bRec, sampler->next2D());
+
+                paths.throughput[i] *= frCosThetaOverPdf;
+                paths.discrete[i] = bRec.measure == EDiscrete;
+                paths.pdfMat[i] = paths.discrete[i] ? 0.f : bsdf->pdf(bRec);
+                paths.origin[i] = its.p;
+                paths.rays.set(i, Ray3f(its.p, its.shFrame.toWorld(bRec.wo)));
+                paths.bounces[i]++;
+            }
+
+            /* Shadow: resolve the visibility of all emitter samples at once */
+            std::unique_ptr<bool[]> occluded(new bool[survivors.size()]);
+            scene->rayIntersect(shadow, occluded.get());
+            for (size_t k = 0; k < survivors.size(); ++k) {
+                if (!occluded[k])
+                    Li[survivors[k]] += shadowContrib[k];
+            }
+
+            paths.queue.swap(survivors);
+        }
+    }
+
+    std::string toString() const override {
+        return tfm::format("PathWavefrontIntegrator[termination = %s]", m_termination.toString());
+    }
+
+private:
+    /// Structure-of-arrays state of all paths of a batch
+    struct PathStates {
+        RayStream rays;                  ///< Next ray of every path
+        std::vector<Color3f> throughput; ///< Path throughput
+        std::vector<Point3f> origin;     ///< Last scattering location
+        std::vector<float> pdfMat;       ///< Solid angle density of the last BSDF sample
+        std::vector<uint8_t> discrete;   ///< Whether the last BSDF sample was discrete
+        std::vector<uint32_t> bounces;   ///< Number of scattering events so far
+        std::vector<uint32_t> slot;      ///< Position of the path in the current queue
+
+        std::vector<uint32_t> queue;     ///< Indices of the live paths
+        std::vector<Intersection> its;   ///< Intersections of the current queue entries
+        std::unique_ptr<bool[]> hit;     ///< Hit flags of the current queue entries
+
+        PathStates(size_t count)
+            : rays(count), throughput(count, Color3f(1.f)), origin(count), pdfMat(count, 0.f),
+              discrete(count, 0), bounces(count, 0), slot(count, 0), queue(count), its(count),
+              hit(new bool[count]) { }
+    };
+
+    PathTermination m_termination;
+};
+
+NORI_REGISTER_CLASS(PathWavefrontIntegrator, "path_wavefront");
+NORI_NAMESPACE_END
@@ -107,6 +107,18 @@ public:
         ray.maxt = m_farClip * invZ;
         ray.update();
 
+        /* Ray differentials: rays through the positions one pixel to the right and below */
+        Vector3f dx = (m_sampleToCamera * Point3f(
+            (samplePosition.x() + 1) * m_invOutputSize.x(),
+            samplePosition.y() * m_invOutputSize.y(), 0.0f)).normalized();
+        Vector3f dy = (m_sampleToCamera * Point3f(
+            samplePosition.x() * m_invOutputSize.x(),
+            (samplePosition.y() + 1) * m_invOutputSize.y(), 0.0f)).normalized();
+        ray.rxOrigin = ray.ryOrigin = ray.o;
+        ray.rxDirection = m_cameraToWorld * dx;
+        ray.ryDirection = m_cameraToWorld * dy;
+        ray.hasDifferentials = true;
+
         return Color3f(1.0f);
     }
 
@@ -22,21 +22,27 @@
 #include <nori/bsdf.h>
 #include <nori/scene.h>
 #include <nori/photon.h>
+#include <nori/stats.h>
+#include <nori/trace.h>
+#include <nori/termination.h>
 
 NORI_NAMESPACE_BEGIN
 
+NORI_STAT_RATIO(statPhotonsPerLookup, "Photon map", "Photons found per lookup");
+
 class PhotonMapper : public Integrator {
 public:
     /// Photon map data structure
     typedef PointKDTree<Photon> PhotonMap;
 
-    PhotonMapper(const PropertyList &props) {
+    PhotonMapper(const PropertyList &props) : m_termination(props, .99f) {
         /* Lookup parameters */
         m_photonCount  = props.getInteger("photonCount", 1000000);
         m_photonRadius = props.getFloat("photonRadius", 0.0f /* Default: automatic */);
     }
 
     void preprocess(const Scene *scene) override {
+        NORI_TRACE_SCOPE("preprocess", "Photon tracing");
         cout << "Gathering " << m_photonCount << " photons .. ";
         cout.flush();
 
@@ -62,39 +68,45 @@ public:
             Intersection xi;
 
             auto randomEmitter = scene->getRandomEmitter(sampler->next1D());
-            Color3f W = randomEmitter->samplePhoton(pathRay, sampler->next2D(), sampler->next2D()) *
+            Color3f power = randomEmitter->samplePhoton(pathRay, sampler->next2D(), sampler->next2D()) *
                      scene->getLights().size();
 
+            /* The termination policy acts on the throughput, relative to the emitted power */
+            Color3f beta(1);
+            uint32_t depth = 0;
+
             while (true) {
 
                 if (!scene->rayIntersect(pathRay, xi)) {
                     break;
                 }
+                ++depth;
 
                 if (xi.mesh->getBSDF()->isDiffuse()) {
-                    m_photonMap->push_back(Photon(xi.p, -pathRay.d, W));
+                    m_photonMap->push_back(Photon(xi.p, -pathRay.d, power * beta));
                     ++depositedPhotonsCount;
                 }
 
-                // russian roulette with success probability p
-                auto p = std::min(W.maxCoeff(), .99f);
-                if (sampler->next1D() > p) {
+                // Russian roulette and path length limit
+                if (!m_termination.survive(depth, beta, sampler)) {
                     break;
                 }
-                W /= p;
 
 
                 // Sample from BSDF
                 BSDFQueryRecord bRec(xi.shFrame.toLocal(-pathRay.d));
                 bRec.uv = xi.uv;
+                bRec.dUVdx = xi.dUVdx;
+                bRec.dUVdy = xi.dUVdy;
                 auto bsdfCosThetaOverPdf = xi.mesh->getBSDF()->sample(bRec, sampler->next2D());
-                W *= bsdfCosThetaOverPdf;
+                beta *= bsdfCosThetaOverPdf;
 
                 pathRay = Ray3f(xi.p, xi.shFrame.toWorld(bRec.wo));
             }
         }
 
 		/* Build the photon map */
+        NORI_TRACE_SCOPE("preprocess", "Photon map build");
         m_photonMap->build();
     }
 
@@ -105,12 +117,14 @@ public:
 
         Color3f t(1);
         Color3f Li(0);
+        uint32_t depth = 0;
 
         while (true) {
 
             if (!scene->rayIntersect(pathRay, xo)) {
                 break;
             }
+            ++depth;
 
             if (xo.mesh->isEmitter()) {
                 EmitterQueryRecord eRec(pathRay.o, xo.p, xo.shFrame.n);
@@ -121,10 +135,13 @@ public:
                 Color3f photonDensityEstimation(0);
                 std::vector<uint32_t> results;
                 m_photonMap->search(xo.p, m_photonRadius,results);
+                NORI_STAT_RATIO_ADD(statPhotonsPerLookup, results.size(), 1);
                 for (auto i : results) {
                     const Photon &photon = (*m_photonMap)[i];
                     BSDFQueryRecord bRec(xo.shFrame.toLocal(-pathRay.d), xo.shFrame.toLocal(photon.getDirection()), ESolidAngle);
                     bRec.uv = xo.uv;
+                    bRec.dUVdx = xo.dUVdx;
+                    bRec.dUVdy = xo.dUVdy;
                     auto fr = xo.mesh->getBSDF()->eval(bRec);
                     photonDensityEstimation += fr * photon.getPower();
                 }
@@ -134,21 +151,21 @@ public:
                 break;
             }
 
-            // russian roulette with success probability p
-            auto p = std::min(t.maxCoeff(), .99f);
-            if (sampler->next1D() > p) {
+            // Russian roulette and path length limit
+            if (!m_termination.survive(depth, t, sampler)) {
                 break;
             }
-            t /= p;
 
 
             // Sample from BSDF
             BSDFQueryRecord bRec(xo.shFrame.toLocal(-pathRay.d));
             bRec.uv = xo.uv;
+            bRec.dUVdx = xo.dUVdx;
+            bRec.dUVdy = xo.dUVdy;
             auto bsdfCosThetaOverPdf = xo.mesh->getBSDF()->sample(bRec, sampler->next2D());
             t *= bsdfCosThetaOverPdf;
 
-            pathRay = Ray3f(xo.p, xo.shFrame.toWorld(bRec.wo));
+            pathRay = xo.spawnRay(pathRay, bRec);
         }
 		return Li;
     }
@@ -157,10 +174,12 @@ public:
         return tfm::format(
             "PhotonMapper[\n"
             "  photonCount = %i,\n"
-            "  photonRadius = %f\n"
+            "  photonRadius = %f,\n"
+            "  termination = %s\n"
             "]",
             m_photonCount,
-            m_photonRadius
+            m_photonRadius,
+            m_termination.toString()
         );
     }
 private:
@@ -172,6 +191,7 @@ private:
     int m_emittedCount;
     float m_photonRadius;
     std::unique_ptr<PhotonMap> m_photonMap;
+    PathTermination m_termination;
 };
 
 NORI_REGISTER_CLASS(PhotonMapper, "photonmapper");
@@ -18,6 +18,7 @@
 
 #include <nori/render.h>
 #include <nori/parser.h>
+#include <nori/snapshot.h>
 #include <nori/scene.h>
 #include <nori/camera.h>
 #include <nori/block.h>
@@ -26,10 +27,19 @@
 #include <nori/sampler.h>
 #include <nori/integrator.h>
 #include <nori/gui.h>
+#include <nori/texcache.h>
+#include <nori/denoiser.h>
+#include <nori/samplebuffer.h>
+#include <nori/stats.h>
+#include <nori/trace.h>
+#include <nori/framebuffer.h>
 #include <tbb/parallel_for.h>
 #include <tbb/blocked_range.h>
 #include <filesystem/resolver.h>
 #include <tbb/concurrent_vector.h>
+#include <tbb/mutex.h>
+#include <fstream>
+#include <chrono>
 
 
 NORI_NAMESPACE_BEGIN
@@ -69,55 +79,235 @@ float RenderThread::getProgress() {
     else return 1.f;
 }
 
-static void renderBlock(const Scene *scene, Sampler *sampler, ImageBlock &block) {
+namespace {
+    /**
+     * Time and number of rays spent on every pixel (see Scene::getCostHeatmap()).
+     * The blocks of a pass never overlap, so render threads accumulate into it
+     * without synchronization. Rays are read from the per-thread BVH counters
+     * and are therefore only available when Nori is built with NORI_STATS.
+     */
+    class PixelCost {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        /// Start of a measurement
+        struct Measurement {
+            Clock::time_point start;
+            uint64_t rays;
+        };
+
+        PixelCost(const Vector2i &size)
+            : m_size(size), m_time((size_t) size.x() * size.y(), 0.0),
+              m_rays((size_t) size.x() * size.y(), 0) {
+            for (const char *name : { "Closest-hit rays", "Shadow rays", "Rays in packets" }) {
+                int slot = Statistics::findStat("BVH", name);
+                if (slot >= 0)
+                    m_raySlots.push_back(slot);
+            }
+        }
+
+        Measurement begin() const {
+            Measurement measurement;
+            measurement.rays = threadRays();
+            measurement.start = Clock::now();
+            return measurement;
+        }
+
+        /// Add the cost since \c measurement to the pixels of a rectangle (in equal shares)
+        void end(const Measurement &measurement, const Point2i &offset, const Vector2i &size = Vector2i(1)) {
+            Clock::time_point now = Clock::now();
+            double time = std::chrono::duration<double, std::milli>(now - measurement.start).count();
+            uint64_t rays = threadRays() - measurement.rays;
+            double share = 1.0 / ((double) size.x() * size.y());
+            for (int y = offset.y(); y < offset.y() + size.y(); ++y) {
+                for (int x = offset.x(); x < offset.x() + size.x(); ++x) {
+                    size_t index = (size_t) y * m_size.x() + x;
+                    m_time[index] += time * share;
+                    m_rays[index] += rays * share;
+                }
+            }
+        }
+
+        /// Add the accumulated cost as the layer "cost" with the channels "time" (ms) and "rays"
+        void addLayer(Bitmap &bitmap) const {
+            std::vector<std::string> channels = { "time" };
+            if (!m_raySlots.empty())
+                channels.push_back("rays");
+            float *values = bitmap.addLayer("cost", channels, true);
+            for (size_t i = 0; i < m_time.size(); ++i) {
+                *values++ = (float) m_time[i];
+                if (!m_raySlots.empty())
+                    *values++ = (float) m_rays[i];
+            }
+        }
+
+    private:
+        /// Number of rays traced by the calling thread so far
+        uint64_t threadRays() const {
+            const uint64_t *slots = Statistics::threadSlots();
+            uint64_t rays = 0;
+            for (int slot : m_raySlots)
+                rays += slots[slot];
+            return rays;
+        }
+
+        Vector2i m_size;
+        std::vector<double> m_time, m_rays;
+        std::vector<int> m_raySlots;
+    };
+};
+
+/// Pack the AOVs of a sample, applying the camera weight to the radiance lobes
+static void packAOVs(const AOVLayout &layout, AOVRecord &aovs, const Color3f &weight, float *channels) {
+    aovs.emission *= weight;
+    aovs.diffuse *= weight;
+    aovs.specular *= weight;
+    layout.pack(aovs, channels);
+}
+
+/**
+ * Render one sample per pixel of a block. Samples are either splatted into
+ * the block right away or, if \c samples is given, only recorded there and
+ * reconstructed into the block once all of them have been computed. If \c cost
+ * is given, the time and rays spent on every pixel are added to it
+ */
+static void renderBlock(const Scene *scene, Sampler *sampler, ImageBlock &block, SampleBuffer *samples,
+                        PixelCost *cost) {
     const Camera *camera = scene->getCamera();
     const Integrator *integrator = scene->getIntegrator();
+    const AOVLayout &aovLayout = scene->getAOVLayout();
+    std::vector<float> aovChannels(aovLayout.getChannelCount());
 
     Point2i offset = block.getOffset();
     Vector2i size  = block.getSize();
 
     /* Clear the block contents */
     block.clear();
+    if (samples)
+        samples->clear();
+
+    auto store = [&](const Point2f &pixelSample, const Color3f &value, const float *aovs) {
+        if (samples)
+            samples->put(pixelSample, value, aovs);
+        else
+            block.put(pixelSample, value, aovs);
+    };
+
+    /* Each sample only covers a fraction of its pixel */
+    float differentialScale = 1.f / std::sqrt((float) sampler->getSampleCount());
+
+    if (integrator->isBatched()) {
+        /* Generate all camera rays of the block, then hand them over at once.
+           The cost of a batch cannot be attributed to single pixels, so it is
+           spread evenly over the block */
+        PixelCost::Measurement measurement;
+        if (cost)
+            measurement = cost->begin();
+
+        size_t count = (size_t) size.x() * size.y();
+        std::vector<Point2f> pixelSamples(count);
+        std::vector<Color3f> weights(count), values(count);
+        std::vector<Ray3f> rays(count);
+
+        for (int y=0; y<size.y(); ++y) {
+            for (int x=0; x<size.x(); ++x) {
+                size_t i = (size_t) y * size.x() + x;
+                pixelSamples[i] = Point2f((float) (x + offset.x()), (float) (y + offset.y())) + sampler->next2D();
+                Point2f apertureSample = sampler->next2D();
+                weights[i] = camera->sampleRay(rays[i], pixelSamples[i], apertureSample);
+                rays[i].scaleDifferentials(differentialScale);
+            }
+        }
 
-    /* For each pixel and pixel sample sample */
-    for (int y=0; y<size.y(); ++y) {
-        for (int x=0; x<size.x(); ++x) {
-            Point2f pixelSample = Point2f((float) (x + offset.x()), (float) (y + offset.y())) + sampler->next2D();
-            Point2f apertureSample = sampler->next2D();
-
-            /* Sample a ray from the camera */
-            Ray3f ray;
-            Color3f value = camera->sampleRay(ray, pixelSample, apertureSample);
+        integrator->LiBatch(scene, sampler, rays.data(), values.data(), count);
 
-            /* Compute the incident radiance */
-            value *= integrator->Li(scene, sampler, ray);
+        for (size_t i = 0; i < count; ++i) {
+            if (aovLayout.empty()) {
+                store(pixelSamples[i], weights[i] * values[i], nullptr);
+            } else {
+                AOVRecord aovs;
+                Integrator::estimateAOVs(scene, rays[i], values[i], aovs);
+                packAOVs(aovLayout, aovs, weights[i], aovChannels.data());
+                store(pixelSamples[i], weights[i] * values[i], aovChannels.data());
+            }
+        }
 
-            /* Store in the image block */
-            block.put(pixelSample, value);
+        if (cost)
+            cost->end(measurement, offset, size);
+    } else {
+        /* For each pixel and pixel sample sample */
+        for (int y=0; y<size.y(); ++y) {
+            for (int x=0; x<size.x(); ++x) {
+                PixelCost::Measurement measurement;
+                if (cost)
+                    measurement = cost->begin();
+
+                Point2f pixelSample = Point2f((float) (x + offset.x()), (float) (y + offset.y())) + sampler->next2D();
+                Point2f apertureSample = sampler->next2D();
+
+                /* Sample a ray from the camera */
+                Ray3f ray;
+                Color3f value = camera->sampleRay(ray, pixelSample, apertureSample);
+                ray.scaleDifferentials(differentialScale);
+
+                /* Compute the incident radiance */
+                if (aovLayout.empty()) {
+                    value *= integrator->Li(scene, sampler, ray);
+
+                    /* Store in the image block */
+                    store(pixelSample, value, nullptr);
+                } else {
+                    AOVRecord aovs;
+                    Color3f weight = value;
+                    value *= integrator->LiAOV(scene, sampler, ray, aovs);
+                    packAOVs(aovLayout, aovs, weight, aovChannels.data());
+                    store(pixelSample, value, aovChannels.data());
+                }
+
+                if (cost)
+                    cost->end(measurement, Point2i(x + offset.x(), y + offset.y()));
+            }
         }
     }
+
+    /* Deferred reconstruction: splat all samples of the block in one pass */
+    if (samples)
+        samples->reconstruct(block);
 }
 
 void RenderThread::renderScene(const std::string & filename) {
 
     filesystem::path path(filename);
 
+    /* Every render has its own timeline, starting with loading the scene */
+    if (Trace::isEnabled())
+        Trace::reset();
+
     /* Add the parent directory of the scene file to the
        file resolver. That way, the XML file can reference
        resources (OBJ files, textures) using relative paths */
     getFileResolver()->prepend(path.parent_path());
 
-    NoriObject* root = loadFromXML(filename);
+    /* Scene snapshots skip the expensive parts of loading an XML scene */
+    NoriObject* root;
+    {
+        NORI_TRACE_SCOPE("load", "Load scene");
+        root = path.extension() == "bin" ? loadFromSnapshot(filename) : loadFromXML(filename);
+    }
 
     // When the XML root object is a scene, start rendering it ..
     if (root->getClassType() == NoriObject::EScene) {
         m_scene = static_cast<Scene *>(root);
 
         const Camera *camera_ = m_scene->getCamera();
-        m_scene->getIntegrator()->preprocess(m_scene);
+        {
+            NORI_TRACE_SCOPE("preprocess", "Integrator preprocess");
+            m_scene->getIntegrator()->preprocess(m_scene);
+        }
 
         /* Allocate memory for the entire output image and clear it */
         m_block.init(camera_->getOutputSize(), camera_->getReconstructionFilter());
+        m_block.setAOVLayout(m_scene->getAOVLayout());
         m_block.clear();
 
         /* Determine the filename of the output bitmap */
@@ -135,6 +325,9 @@ void RenderThread::renderScene(const std::string & filename) {
             /* Create a block generator (i.e. a work scheduler) */
             BlockGenerator blockGenerator(outputSize, NORI_BLOCK_SIZE);
 
+            TextureCache::instance().resetStatistics();
+            Statistics::reset();
+
             cout << "Rendering .. ";
             cout.flush();
             Timer timer;
@@ -145,17 +338,52 @@ void RenderThread::renderScene(const std::string & filename) {
             tbb::concurrent_vector< std::unique_ptr<Sampler> > samplers;
             samplers.resize(numBlocks);
 
+            /* Optionally keep all samples in a file, so that the image can
+               later be reconstructed with a different filter */
+            std::ofstream sampleFile;
+            tbb::mutex sampleFileMutex;
+            if (m_scene->getSaveSamples()) {
+                sampleFile.open(outputName + ".samples", std::ios::binary);
+                if (sampleFile.is_open())
+                    SampleBuffer::writeHeader(sampleFile, outputSize);
+                else
+                    cerr << "Warning: unable to write \"" << outputName << ".samples\"" << endl;
+            }
+            bool deferred = m_scene->getDeferredReconstruction() || sampleFile.is_open();
+
+            /* Optionally measure the cost of every pixel */
+            std::unique_ptr<PixelCost> cost;
+            if (m_scene->getCostHeatmap())
+                cost.reset(new PixelCost(outputSize));
+
+            /* Optionally publish the image after every pass for external viewers */
+            std::unique_ptr<LiveFramebuffer> framebuffer;
+            if (m_scene->getLiveFramebuffer()) {
+                try {
+                    framebuffer.reset(new LiveFramebuffer(outputName + ".framebuffer", outputSize, numSamples));
+                } catch (const NoriException &e) {
+                    cerr << "Warning: " << e.what() << endl;
+                }
+            }
+
+            double renderStart = Trace::now();
             for (uint32_t k = 0; k < numSamples ; ++k) {
                 m_progress = k/float(numSamples);
                 if(m_render_status == 2)
                     break;
 
+                Trace::Scope passScope("render", "Pass");
+                if (passScope.isActive())
+                    passScope.setArgs(tfm::format("\"pass\": %i", k));
+
                 tbb::blocked_range<int> range(0, numBlocks);
 
                 auto map = [&](const tbb::blocked_range<int> &range) {
                     // Allocate memory for a small image block to be rendered by the current thread
                     ImageBlock block(Vector2i(NORI_BLOCK_SIZE),
                                      camera->getReconstructionFilter());
+                    block.setAOVLayout(m_scene->getAOVLayout());
+                    SampleBuffer samples(m_scene->getAOVLayout().getChannelCount());
 
                     for (int i = range.begin(); i < range.end(); ++i) {
                         // Request an image block from the block generator
@@ -170,9 +398,21 @@ void RenderThread::renderScene(const std::string & filename) {
                         }
 
                         // Render all contained pixels
-                        renderBlock(m_scene, samplers.at(blockId).get(), block);
+                        {
+                            Trace::Scope tileScope("render", "Tile");
+                            if (tileScope.isActive())
+                                tileScope.setArgs(tfm::format("\"tile\": %i, \"pass\": %i", blockId, k));
+                            renderBlock(m_scene, samplers.at(blockId).get(), block, deferred ? &samples : nullptr,
+                                        cost.get());
+                        }
+
+                        if (sampleFile.is_open()) {
+                            tbb::mutex::scoped_lock lock(sampleFileMutex);
+                            samples.write(sampleFile);
+                        }
 
                         // The image block has been processed. Now add it to the "big" block that represents the entire image
+                        NORI_TRACE_SCOPE("render", "Merge block");
                         m_block.put(block);
                     }
                 };
@@ -185,24 +425,67 @@ void RenderThread::renderScene(const std::string & filename) {
                 tbb::parallel_for(range, map);
 #endif
                 blockGenerator.reset();
+
+                {
+                    NORI_TRACE_SCOPE("render", "End of pass");
+                    m_scene->getIntegrator()->endPass(m_scene, k);
+                }
+
+                /* No thread merges blocks between two passes, so the image can be read without locking it */
+                if (framebuffer)
+                    framebuffer->publish(m_block, k + 1);
             }
+            if (Trace::isEnabled())
+                Trace::addEvent("Render", "render", renderStart, Trace::now(), "");
 
             cout << "done. (took " << timer.elapsedString() << ")" << endl;
 
+            if (TextureCache::instance().getHitCount() + TextureCache::instance().getMissCount() > 0)
+                cout << TextureCache::instance().getStatistics() << endl;
+
+            /* Render statistics (only if Nori was built with NORI_STATS=ON) */
+            if (!Statistics::isEmpty()) {
+                cout << Statistics::toString() << endl;
+                std::ofstream statsFile(outputName + "_stats.json");
+                statsFile << Statistics::toJSON() << endl;
+                if (statsFile.fail())
+                    cerr << "Warning: unable to write \"" << outputName << "_stats.json\"" << endl;
+            }
+
             /* Now turn the rendered image block into
                a properly normalized bitmap */
             m_block.lock();
             std::unique_ptr<Bitmap> bitmap(m_block.toBitmap());
             m_block.unlock();
+            if (cost)
+                cost->addLayer(*bitmap);
+
+            {
+                NORI_TRACE_SCOPE("output", "Write image");
+                /* Save using the OpenEXR format */
+                bitmap->save(outputName + ".exr", m_scene->getEXROptions());
+                // Save as PNG
+                bitmap->saveToLDR(outputName + ".png");
+            }
 
-            /* Save using the OpenEXR format */
-            bitmap->save(outputName + ".exr");
-            // Save as PNG
-            bitmap->saveToLDR(outputName + ".png");
+            if (m_scene->getDenoiser()) {
+                NORI_TRACE_SCOPE("output", "Denoise");
+                cout << "Denoising .. ";
+                cout.flush();
+                Timer denoiseTimer;
+                std::unique_ptr<Bitmap> denoised(m_scene->getDenoiser()->denoise(*bitmap));
+                cout << "done. (took " << denoiseTimer.elapsedString() << ")" << endl;
+
+                denoised->save(outputName + "_denoised.exr", m_scene->getEXROptions());
+                denoised->saveToLDR(outputName + "_denoised.png");
+            }
 
             delete m_scene;
             m_scene = nullptr;
 
+            if (Trace::isEnabled())
+                Trace::write(outputName + "_trace.json");
+
             m_render_status = 3;
         });
 
@@ -0,0 +1,93 @@
+#include <nori/samplebuffer.h>
+#include <nori/block.h>
+#include <nori/bitmap.h>
+#include <cstring>
+#include <fstream>
+
+NORI_NAMESPACE_BEGIN
+
+namespace {
+    /// Header of a sample file, followed by records of 5 floats (x, y, r, g, b)
+    struct SampleFileHeader {
+        char magic[8];
+        uint32_t version;
+        int32_t width, height;
+        uint32_t reserved;
+    };
+
+    const char SAMPLEFILE_MAGIC[8] = "NORISMP";
+    const uint32_t SAMPLEFILE_VERSION = 1;
+    const size_t SAMPLE_RECORD_FLOATS = 5;
+
+    /// Number of samples read at once by SampleBuffer::refilter()
+    const size_t REFILTER_CHUNK = 1 << 20;
+};
+
+void SampleBuffer::clear() {
+    m_x.clear(); m_y.clear();
+    m_r.clear(); m_g.clear(); m_b.clear();
+    m_aovs.clear();
+}
+
+void SampleBuffer::reconstruct(ImageBlock &block) const {
+    const float *aovs = m_aovChannels > 0 ? m_aovs.data() : nullptr;
+    for (size_t i = 0; i < m_x.size(); ++i) {
+        block.put(Point2f(m_x[i], m_y[i]), Color3f(m_r[i], m_g[i], m_b[i]), aovs);
+        if (aovs)
+            aovs += m_aovChannels;
+    }
+}
+
+void SampleBuffer::writeHeader(std::ostream &os, const Vector2i &size) {
+    SampleFileHeader header;
+    memset(&header, 0, sizeof(SampleFileHeader));
+    memcpy(header.magic, SAMPLEFILE_MAGIC, sizeof(header.magic));
+    header.version = SAMPLEFILE_VERSION;
+    header.width = size.x();
+    header.height = size.y();
+    os.write(reinterpret_cast<const char *>(&header), sizeof(SampleFileHeader));
+}
+
+void SampleBuffer::write(std::ostream &os) const {
+    std::vector<float> records(SAMPLE_RECORD_FLOATS * m_x.size());
+    for (size_t i = 0; i < m_x.size(); ++i) {
+        float *record = &records[SAMPLE_RECORD_FLOATS * i];
+        record[0] = m_x[i]; record[1] = m_y[i];
+        record[2] = m_r[i]; record[3] = m_g[i]; record[4] = m_b[i];
+    }
+    os.write(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(float));
+}
+
+Bitmap *SampleBuffer::refilter(const std::string &filename, const ReconstructionFilter *filter) {
+    std::ifstream is(filename, std::ios::binary);
+    if (is.fail())
+        throw NoriException("SampleBuffer: unable to open \"%s\"", filename);
+
+    SampleFileHeader header;
+    is.read(reinterpret_cast<char *>(&header), sizeof(SampleFileHeader));
+    if (is.fail() || memcmp(header.magic, SAMPLEFILE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != SAMPLEFILE_VERSION || header.width <= 0 || header.height <= 0)
+        throw NoriException("SampleBuffer: \"%s\" is not a valid sample file", filename);
+
+    Vector2i size(header.width, header.height);
+    ImageBlock block(size, filter);
+    block.clear();
+
+    std::vector<float> records(SAMPLE_RECORD_FLOATS * REFILTER_CHUNK);
+    size_t total = 0;
+    while (is) {
+        is.read(reinterpret_cast<char *>(records.data()), records.size() * sizeof(float));
+        size_t count = (size_t) is.gcount() / (SAMPLE_RECORD_FLOATS * sizeof(float));
+        for (size_t i = 0; i < count; ++i) {
+            const float *record = &records[SAMPLE_RECORD_FLOATS * i];
+            block.put(Point2f(record[0], record[1]), Color3f(record[2], record[3], record[4]));
+        }
+        total += count;
+    }
+
+    cout << "Reconstructed " << total << " samples of a " << size.x() << "x" << size.y()
+         << " image from \"" << filename << "\"" << endl;
+    return block.toBitmap();
+}
+
+NORI_NAMESPACE_END
@@ -22,11 +22,58 @@
 #include <nori/sampler.h>
 #include <nori/camera.h>
 #include <nori/emitter.h>
+#include <nori/texcache.h>
+#include <nori/denoiser.h>
 
 NORI_NAMESPACE_BEGIN
 
-Scene::Scene(const PropertyList &) {
+Scene::Scene(const PropertyList &props) {
     m_bvh = new BVH();
+
+    /* Memory budget of the texture tile cache in MiB */
+    int textureCacheMB = props.getInteger("textureCacheMB", 256);
+    if (textureCacheMB <= 0)
+        throw NoriException("Scene: textureCacheMB must be positive");
+    TextureCache::instance().setCapacity((size_t) textureCacheMB * 1024 * 1024);
+
+    /* Output format of the rendered OpenEXR image */
+    std::string exrPrecision = toLower(props.getString("exrPrecision", "float"));
+    if (exrPrecision != "float" && exrPrecision != "half")
+        throw NoriException("Scene: unknown exrPrecision \"%s\"", exrPrecision);
+    m_exrOptions.halfPrecision = exrPrecision == "half";
+
+    std::string exrLayout = toLower(props.getString("exrLayout", "scanline"));
+    if (exrLayout != "scanline" && exrLayout != "tiled")
+        throw NoriException("Scene: unknown exrLayout \"%s\"", exrLayout);
+    m_exrOptions.tiled = exrLayout == "tiled";
+
+    m_exrOptions.compression = EXROptions::parseCompression(props.getString("exrCompression", "zip"));
+
+    /* Arbitrary output variables, written as layers of the OpenEXR image */
+    m_aovLayout = AOVLayout(props.getString("aovs", ""));
+
+    /* Optional denoising of the final image, guided by the surface AOVs */
+    if (props.getBoolean("denoise", false)) {
+        m_denoiser = new Denoiser(
+            props.getInteger("denoiseIterations", 5),
+            props.getFloat("denoiseSigmaColor", 4.f),
+            props.getFloat("denoiseSigmaNormal", 0.3f),
+            props.getFloat("denoiseSigmaDepth", 0.05f),
+            props.getFloat("denoiseSigmaAlbedo", 0.1f));
+        m_aovLayout.add(AOVLayout::EAlbedo);
+        m_aovLayout.add(AOVLayout::ENormal);
+        m_aovLayout.add(AOVLayout::EDepth);
+    }
+
+    /* Sample storage for deferred reconstruction and re-filtering */
+    m_deferredReconstruction = props.getBoolean("deferredReconstruction", false);
+    m_saveSamples = props.getBoolean("saveSamples", false);
+
+    /* Per-pixel render cost for finding expensive parts of the scene */
+    m_costHeatmap = props.getBoolean("costHeatmap", false);
+
+    /* Progress of the render for external viewers */
+    m_liveFramebuffer = props.getBoolean("liveFramebuffer", false);
 }
 
 Scene::~Scene() {
@@ -34,6 +81,7 @@ Scene::~Scene() {
     delete m_sampler;
     delete m_camera;
     delete m_integrator;
+    delete m_denoiser;
     for(auto e : m_emitters)
         delete e;
     m_emitters.clear();
@@ -59,6 +107,36 @@ void Scene::activate() {
     cout << endl;
 }
 
+void Scene::rayIntersect(const RayStream &rays, Intersection *its, bool *hit) const {
+    RayStream::Packet packet;
+    for (size_t offset = 0; offset < rays.size(); offset += RayStream::PacketSize) {
+        int count = rays.gather(offset, packet);
+        if (count == RayStream::PacketSize) {
+            m_bvh->rayIntersect(packet, its + offset, hit + offset, false);
+        } else {
+            /* Partial packet at the end: trace into scratch space */
+            Intersection packetIts[RayStream::PacketSize];
+            bool packetHit[RayStream::PacketSize];
+            m_bvh->rayIntersect(packet, packetIts, packetHit, false);
+            for (int i = 0; i < count; ++i) {
+                its[offset + i] = packetIts[i];
+                hit[offset + i] = packetHit[i];
+            }
+        }
+    }
+}
+
+void Scene::rayIntersect(const RayStream &rays, bool *occluded) const {
+    RayStream::Packet packet;
+    for (size_t offset = 0; offset < rays.size(); offset += RayStream::PacketSize) {
+        int count = rays.gather(offset, packet);
+        bool packetOccluded[RayStream::PacketSize];
+        m_bvh->rayIntersect(packet, nullptr, packetOccluded, true);
+        for (int i = 0; i < count; ++i)
+            occluded[offset + i] = packetOccluded[i];
+    }
+}
+
 void Scene::addChild(NoriObject *obj) {
     switch (obj->getClassType()) {
         case EMesh: {
@@ -0,0 +1,297 @@
+#include <nori/sdtree.h>
+#include <tbb/parallel_for.h>
+
+NORI_NAMESPACE_BEGIN
+
+namespace {
+    /// Fraction of the radiance of a directional tree above which a quadrant is subdivided
+    const float DirectionalThreshold = .01f;
+
+    /// Maximum depth of the directional trees
+    const int MaxDirectionalDepth = 20;
+
+    /// Number of samples (per iteration of one sample per pixel) above which a spatial region is split
+    const float SpatialThreshold = 12000.f;
+
+    /// Largest float below 1
+    const float OneMinusEpsilon = 0.99999994f;
+
+    /// Add to an atomic float (std::atomic<float> has no fetch_add)
+    void atomicAdd(std::atomic<float> &target, float value) {
+        float current = target.load(std::memory_order_relaxed);
+        while (!target.compare_exchange_weak(current, current + value, std::memory_order_relaxed))
+            ;
+    }
+
+    /// Return the quadrant of the unit square containing \c p and map \c p to the quadrant
+    int selectQuadrant(Point2f &p) {
+        int quadrant = 0;
+        for (int i = 0; i < 2; ++i) {
+            if (p[i] >= .5f) {
+                quadrant |= 1 << i;
+                p[i] = 2 * p[i] - 1;
+            } else {
+                p[i] = 2 * p[i];
+            }
+        }
+        return quadrant;
+    }
+};
+
+DTree::Node::Node() {
+    for (int i = 0; i < 4; ++i) {
+        sum[i].store(0.f, std::memory_order_relaxed);
+        child[i] = 0;
+    }
+}
+
+DTree::Node::Node(const Node &node) {
+    *this = node;
+}
+
+DTree::Node &DTree::Node::operator=(const Node &node) {
+    for (int i = 0; i < 4; ++i) {
+        sum[i].store(node.sum[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        child[i] = node.child[i];
+    }
+    return *this;
+}
+
+float DTree::Node::getTotal() const {
+    float total = 0;
+    for (int i = 0; i < 4; ++i)
+        total += sum[i].load(std::memory_order_relaxed);
+    return total;
+}
+
+DTree::DTree() : m_nodes(1), m_samples(0) { }
+
+DTree::DTree(const DTree &tree) : m_nodes(tree.m_nodes), m_samples(tree.getSampleCount()) { }
+
+DTree &DTree::operator=(const DTree &tree) {
+    m_nodes = tree.m_nodes;
+    m_samples.store(tree.getSampleCount(), std::memory_order_relaxed);
+    return *this;
+}
+
+float DTree::getTotal() const {
+    return m_nodes[0].getTotal();
+}
+
+Point2f DTree::dirToCanonical(const Vector3f &dir) {
+    float cosTheta = clamp(dir.z(), -1.f, 1.f);
+    float phi = std::atan2(dir.y(), dir.x());
+    if (phi < 0)
+        phi += 2 * M_PI;
+    return Point2f(clamp((cosTheta + 1) * .5f, 0.f, OneMinusEpsilon),
+                   clamp(phi * INV_TWOPI, 0.f, OneMinusEpsilon));
+}
+
+Vector3f DTree::canonicalToDir(const Point2f &p) {
+    float cosTheta = 2 * p.x() - 1;
+    float sinTheta = std::sqrt(std::max(0.f, 1 - cosTheta * cosTheta));
+    float phi = 2 * M_PI * p.y();
+    return Vector3f(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+}
+
+void DTree::record(const Vector3f &dir, float radiance) {
+    m_samples.fetch_add(1, std::memory_order_relaxed);
+    if (!(radiance > 0) || !std::isfinite(radiance))
+        return;
+
+    /* Every level stores the radiance of its quadrants */
+    Point2f p = dirToCanonical(dir);
+    uint32_t node = 0;
+    while (true) {
+        int quadrant = selectQuadrant(p);
+        atomicAdd(m_nodes[node].sum[quadrant], radiance);
+        node = m_nodes[node].child[quadrant];
+        if (node == 0)
+            break;
+    }
+}
+
+Vector3f DTree::sample(const Point2f &sample_) const {
+    Point2f sample = sample_, origin(0.f);
+    float size = 1.f;
+    uint32_t node = 0;
+    while (true) {
+        const Node &n = m_nodes[node];
+        float sum[4];
+        for (int i = 0; i < 4; ++i)
+            sum[i] = n.sum[i].load(std::memory_order_relaxed);
+
+        /* Choose a column, then a quadrant within the column, and reuse the sample */
+        int quadrant = 0;
+        float left = sum[0] + sum[2], total = left + sum[1] + sum[3];
+        float pLeft = total > 0 ? left / total : .5f;
+        if (sample.x() < pLeft) {
+            sample.x() /= pLeft;
+        } else {
+            sample.x() = (sample.x() - pLeft) / (1 - pLeft);
+            quadrant |= 1;
+        }
+        float column = sum[quadrant] + sum[quadrant | 2];
+        float pBottom = column > 0 ? sum[quadrant] / column : .5f;
+        if (sample.y() < pBottom) {
+            sample.y() /= pBottom;
+        } else {
+            sample.y() = (sample.y() - pBottom) / (1 - pBottom);
+            quadrant |= 2;
+        }
+        sample = sample.cwiseMin(OneMinusEpsilon);
+
+        size *= .5f;
+        origin += size * Point2f((float) (quadrant & 1), (float) (quadrant >> 1));
+        node = n.child[quadrant];
+        if (node == 0)
+            return canonicalToDir(origin + size * sample);
+    }
+}
+
+float DTree::pdf(const Vector3f &dir) const {
+    Point2f p = dirToCanonical(dir);
+    float density = INV_FOURPI;
+    uint32_t node = 0;
+    while (true) {
+        const Node &n = m_nodes[node];
+        float total = n.getTotal();
+        if (total <= 0)
+            return 0.f;
+        int quadrant = selectQuadrant(p);
+        density *= 4 * n.sum[quadrant].load(std::memory_order_relaxed) / total;
+        node = n.child[quadrant];
+        if (node == 0)
+            return density;
+    }
+}
+
+DTree DTree::rebuild(const DTree &tree, float threshold, int maxDepth, size_t maxNodes) {
+    float total = tree.getTotal();
+    if (!(total > 0))
+        return DTree();
+
+    DTree result;
+    result.m_nodes.clear();
+    result.rebuild(tree, 0, total, threshold * total, 1, maxDepth, maxNodes);
+    return result;
+}
+
+uint32_t DTree::rebuild(const DTree &tree, int node, float energy, float threshold, int depth,
+                        int maxDepth, size_t maxNodes) {
+    uint32_t index = (uint32_t) m_nodes.size();
+    m_nodes.emplace_back();
+
+    for (int i = 0; i < 4; ++i) {
+        /* Quadrants that were not subdivided yet spread their radiance evenly */
+        float quadrantEnergy = node >= 0 ? tree.m_nodes[node].sum[i].load(std::memory_order_relaxed) : energy / 4;
+        if (quadrantEnergy <= threshold || depth >= maxDepth || m_nodes.size() >= maxNodes)
+            continue;
+        int child = node >= 0 && tree.m_nodes[node].child[i] != 0 ? (int) tree.m_nodes[node].child[i] : -1;
+        uint32_t childIndex = rebuild(tree, child, quadrantEnergy, threshold, depth + 1, maxDepth, maxNodes);
+        m_nodes[index].child[i] = childIndex;
+    }
+    return index;
+}
+
+SDTree::SDTree(const BoundingBox3f &bbox, size_t memoryBudget) : m_memoryBudget(memoryBudget) {
+    /* Cubic bounds, so that the regions stay roughly cubic as well */
+    float extent = std::max(bbox.getExtents().maxCoeff(), Epsilon) * (1 + Epsilon);
+    Point3f center = bbox.getCenter();
+    m_bbox = BoundingBox3f(center - Vector3f(.5f * extent), center + Vector3f(.5f * extent));
+    m_invExtents = Vector3f(1.f / extent);
+
+    Node root;
+    root.child[0] = root.child[1] = 0;
+    root.region = 0;
+    root.axis = 0;
+    m_nodes.push_back(root);
+    m_regions.emplace_back(new Region());
+}
+
+SDTree::Region *SDTree::lookup(const Point3f &p) const {
+    Vector3f q = (p - m_bbox.min).cwiseProduct(m_invExtents).cwiseMax(0.f).cwiseMin(OneMinusEpsilon);
+    uint32_t node = 0;
+    while (m_nodes[node].child[0] != 0) {
+        const Node &n = m_nodes[node];
+        float &x = q[n.axis];
+        if (x < .5f) {
+            x = 2 * x;
+            node = n.child[0];
+        } else {
+            x = 2 * x - 1;
+            node = n.child[1];
+        }
+    }
+    return m_regions[m_nodes[node].region].get();
+}
+
+void SDTree::split(uint32_t node, uint32_t threshold, size_t &memory) {
+    Region &region = *m_regions[m_nodes[node].region];
+    uint32_t samples = region.recording.getSampleCount();
+    if (samples <= threshold)
+        return;
+
+    size_t cost = 2 * sizeof(Node) + sizeof(Region) +
+        (region.sampling.getNodeCount() + region.recording.getNodeCount()) * DTree::getNodeSize();
+    if (memory + cost > m_memoryBudget)
+        return;
+    memory += cost;
+
+    /* Both halves start out with the trees of the region, and half of its samples */
+    region.recording.setSampleCount(samples / 2);
+    m_regions.emplace_back(new Region(region));
+
+    Node half;
+    half.child[0] = half.child[1] = 0;
+    half.axis = (m_nodes[node].axis + 1) % 3;
+    uint32_t first = (uint32_t) m_nodes.size();
+    half.region = m_nodes[node].region;
+    m_nodes.push_back(half);
+    half.region = (uint32_t) m_regions.size() - 1;
+    m_nodes.push_back(half);
+    m_nodes[node].child[0] = first;
+    m_nodes[node].child[1] = first + 1;
+
+    split(first, threshold, memory);
+    split(first + 1, threshold, memory);
+}
+
+void SDTree::refine(int iteration) {
+    /* Spatial refinement, following the number of samples of each region */
+    size_t memory = getMemoryUsage();
+    uint32_t threshold = (uint32_t) (SpatialThreshold * std::sqrt(std::pow(2.f, (float) iteration)));
+    size_t nodeCount = m_nodes.size();
+    for (uint32_t i = 0; i < nodeCount; ++i) {
+        if (m_nodes[i].child[0] == 0)
+            split(i, threshold, memory);
+    }
+
+    /* Directional refinement: the recorded trees become the sampling trees,
+       and the remaining budget is shared evenly by the new recording trees */
+    size_t fixed = m_nodes.size() * sizeof(Node) + m_regions.size() * sizeof(Region);
+    for (auto &region : m_regions) {
+        region->sampling = region->recording;
+        fixed += region->sampling.getNodeCount() * DTree::getNodeSize();
+    }
+    size_t maxNodes = fixed < m_memoryBudget ? (m_memoryBudget - fixed) / DTree::getNodeSize() / m_regions.size() : 0;
+    maxNodes = std::max(maxNodes, (size_t) 1);
+
+    tbb::parallel_for(size_t(0), m_regions.size(), [&](size_t i) {
+        Region &region = *m_regions[i];
+        region.recording = DTree::rebuild(region.sampling, DirectionalThreshold, MaxDirectionalDepth, maxNodes);
+    });
+}
+
+size_t SDTree::getMemoryUsage() const {
+    size_t memory = m_nodes.size() * sizeof(Node) + m_regions.size() * sizeof(Region);
+    for (const auto &region : m_regions)
+        memory += (region->sampling.getNodeCount() + region->recording.getNodeCount()) * DTree::getNodeSize();
+    return memory;
+}
+
+std::string SDTree::toString() const {
+    return tfm::format("SDTree[regions = %i, memory = %s]", m_regions.size(), memString(getMemoryUsage()));
+}
+
+NORI_NAMESPACE_END
@@ -61,6 +61,79 @@ void Shape::addChild(NoriObject *obj) {
     }
 }
 
+void Intersection::computeDifferentials(const Ray3f &ray) {
+    dpdx = dpdy = Vector3f(0.f);
+    dUVdx = dUVdy = Vector2f(0.f);
+    if (!ray.hasDifferentials)
+        return;
+
+    /* Intersect the offset rays with the tangent plane of the surface */
+    const Vector3f &n = geoFrame.n;
+    float d = n.dot(Vector3f(p));
+    float tx = (d - n.dot(Vector3f(ray.rxOrigin))) / n.dot(ray.rxDirection);
+    float ty = (d - n.dot(Vector3f(ray.ryOrigin))) / n.dot(ray.ryDirection);
+    if (!std::isfinite(tx) || !std::isfinite(ty))
+        return;
+
+    dpdx = ray.rxOrigin + tx * ray.rxDirection - p;
+    dpdy = ray.ryOrigin + ty * ray.ryDirection - p;
+
+    /* Express the offsets in terms of the UV parameterization (least squares) */
+    float a00 = dpdu.dot(dpdu), a01 = dpdu.dot(dpdv), a11 = dpdv.dot(dpdv);
+    float det = a00 * a11 - a01 * a01;
+    if (std::abs(det) < 1e-20f)
+        return;
+    float invDet = 1.f / det;
+
+    float bx0 = dpdu.dot(dpdx), bx1 = dpdv.dot(dpdx);
+    float by0 = dpdu.dot(dpdy), by1 = dpdv.dot(dpdy);
+    dUVdx = Vector2f(a11 * bx0 - a01 * bx1, a00 * bx1 - a01 * bx0) * invDet;
+    dUVdy = Vector2f(a11 * by0 - a01 * by1, a00 * by1 - a01 * by0) * invDet;
+
+    if (!dUVdx.allFinite() || !dUVdy.allFinite())
+        dUVdx = dUVdy = Vector2f(0.f);
+}
+
+Ray3f Intersection::spawnRay(const Ray3f &ray, const BSDFQueryRecord &bRec) const {
+    Vector3f wo = shFrame.toWorld(bRec.wo);
+    Ray3f result(p, wo);
+    if (!ray.hasDifferentials || bRec.measure != EDiscrete)
+        return result;
+
+    Vector3f n = shFrame.n, wi = -ray.d;
+    Vector3f dndx = dndu * dUVdx.x() + dndv * dUVdx.y();
+    Vector3f dndy = dndu * dUVdy.x() + dndv * dUVdy.y();
+    Vector3f dwidx = ray.d - ray.rxDirection, dwidy = ray.d - ray.ryDirection;
+    float dDNdx = dwidx.dot(n) + wi.dot(dndx);
+    float dDNdy = dwidy.dot(n) + wi.dot(dndy);
+
+    if (Frame::cosTheta(bRec.wi) * Frame::cosTheta(bRec.wo) > 0) {
+        /* Specular reflection: wo = -wi + 2 (wi . n) n */
+        float cosI = wi.dot(n);
+        result.rxDirection = wo - dwidx + 2 * (cosI * dndx + dDNdx * n);
+        result.ryDirection = wo - dwidy + 2 * (cosI * dndy + dDNdy * n);
+    } else {
+        /* Specular refraction: wo = -eta wi + mu n with mu = eta cos(theta_i) - cos(theta_t),
+           where n faces the incident side and eta is the ratio of the IORs */
+        if (wi.dot(n) < 0) {
+            n = -n; dndx = -dndx; dndy = -dndy;
+            dDNdx = -dDNdx; dDNdy = -dDNdy;
+        }
+        float eta = bRec.eta, cosI = wi.dot(n), cosT = -wo.dot(n);
+        if (cosT < 1e-6f)
+            return result;
+        float mu = eta * cosI - cosT;
+        float dmu = eta - eta * eta * cosI / cosT;
+        result.rxDirection = wo - eta * dwidx + mu * dndx + dmu * dDNdx * n;
+        result.ryDirection = wo - eta * dwidy + mu * dndy + dmu * dDNdy * n;
+    }
+
+    result.rxOrigin = p + dpdx;
+    result.ryOrigin = p + dpdy;
+    result.hasDifferentials = true;
+    return result;
+}
+
 std::string Intersection::toString() const {
     if (!mesh)
         return "Intersection[invalid]";
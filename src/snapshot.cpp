@@ -0,0 +1,231 @@
+#include <nori/snapshot.h>
+#include <nori/mmap.h>
+#include <nori/parser.h>
+#include <nori/timer.h>
+#include <filesystem/resolver.h>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+NORI_NAMESPACE_BEGIN
+
+namespace {
+    /**
+     * File layout: a header, the blobs (each aligned to BLOB_ALIGNMENT bytes),
+     * and a table with the key, dimensions, offset and size of every blob
+     */
+    struct SnapshotHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t entryCount;
+        uint64_t tableOffset;
+    };
+
+    const char SNAPSHOT_MAGIC[8] = "NORISNP";
+    const uint32_t SNAPSHOT_VERSION = 1;
+    const uint64_t BLOB_ALIGNMENT = 64;
+
+    /// Reads the table of a snapshot file with bounds checks
+    class TableReader {
+    public:
+        TableReader(const uint8_t *data, size_t size, const std::string &filename)
+            : m_data(data), m_size(size), m_pos(0), m_filename(filename) { }
+
+        void read(void *target, size_t size) {
+            if (m_pos + size > m_size)
+                throw NoriException("Snapshot: \"%s\" is truncated", m_filename);
+            memcpy(target, m_data + m_pos, size);
+            m_pos += size;
+        }
+
+        template <typename T> T read() {
+            T value;
+            read(&value, sizeof(T));
+            return value;
+        }
+
+    private:
+        const uint8_t *m_data;
+        size_t m_size, m_pos;
+        const std::string &m_filename;
+    };
+
+    template <typename T> void write(std::ostream &os, const T &value) {
+        os.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+};
+
+Snapshot *Snapshot::m_active = nullptr;
+
+Snapshot::Snapshot(const std::string &xml, const std::string &basePath)
+    : m_xml(xml), m_basePath(basePath) { }
+
+Snapshot::Snapshot(const std::string &filename) {
+    m_file.reset(new MemoryMappedFile(filename));
+    const uint8_t *data = m_file->data();
+    size_t size = m_file->size();
+
+    SnapshotHeader header;
+    if (size < sizeof(SnapshotHeader))
+        throw NoriException("Snapshot: \"%s\" is not a scene snapshot", filename);
+    memcpy(&header, data, sizeof(SnapshotHeader));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0)
+        throw NoriException("Snapshot: \"%s\" is not a scene snapshot", filename);
+    if (header.version != SNAPSHOT_VERSION)
+        throw NoriException("Snapshot: \"%s\" has version %i, expected version %i (re-create it from the XML file)",
+                            filename, header.version, SNAPSHOT_VERSION);
+    if (header.tableOffset > size)
+        throw NoriException("Snapshot: \"%s\" is truncated", filename);
+
+    TableReader reader(data + header.tableOffset, size - (size_t) header.tableOffset, filename);
+    for (uint32_t i = 0; i < header.entryCount; ++i) {
+        std::string key(reader.read<uint32_t>(), '\0');
+        reader.read(&key[0], key.size());
+        Entry entry;
+        entry.rows = reader.read<uint64_t>();
+        entry.cols = reader.read<uint64_t>();
+        entry.offset = reader.read<uint64_t>();
+        entry.size = reader.read<uint64_t>();
+        if (entry.offset > header.tableOffset || entry.size > header.tableOffset - entry.offset)
+            throw NoriException("Snapshot: blob \"%s\" of \"%s\" is out of bounds", key, filename);
+        m_entries[key] = std::move(entry);
+    }
+
+    std::vector<char> xml, basePath;
+    if (!getVector("scene.xml", xml) || !getVector("scene.basePath", basePath))
+        throw NoriException("Snapshot: \"%s\" does not contain a scene description", filename);
+    m_xml.assign(xml.begin(), xml.end());
+    m_basePath.assign(basePath.begin(), basePath.end());
+}
+
+Snapshot::~Snapshot() { }
+
+std::string Snapshot::nextKey(const std::string &kind) {
+    return kind + std::to_string(m_keyCounters[kind]++);
+}
+
+void Snapshot::put(const std::string &key, uint64_t rows, uint64_t cols, const void *data, size_t size) {
+    if (isReading())
+        throw NoriException("Snapshot::put(): the snapshot is read-only");
+    Entry &entry = m_entries[key];
+    entry.rows = rows;
+    entry.cols = cols;
+    entry.offset = 0;
+    entry.size = size;
+    entry.data.assign((const uint8_t *) data, (const uint8_t *) data + size);
+}
+
+const Snapshot::Entry *Snapshot::find(const std::string &key, size_t scalarSize) const {
+    if (!isReading())
+        return nullptr;
+    auto it = m_entries.find(key);
+    if (it == m_entries.end())
+        return nullptr;
+    const Entry &entry = it->second;
+    if (entry.rows * entry.cols * scalarSize != entry.size)
+        throw NoriException("Snapshot: blob \"%s\" of \"%s\" has an unexpected size",
+                            key, m_file->getFilename());
+    return &entry;
+}
+
+const uint8_t *Snapshot::blob(const Entry &entry) const {
+    return m_file->data() + entry.offset;
+}
+
+void Snapshot::save(const std::string &filename) const {
+    std::ofstream os(filename, std::ios::binary);
+    if (os.fail())
+        throw NoriException("Snapshot: unable to write \"%s\"", filename);
+
+    std::map<std::string, Entry> entries;
+    for (const auto &kv : m_entries) {
+        Entry &entry = entries[kv.first];
+        entry.rows = kv.second.rows;
+        entry.cols = kv.second.cols;
+        entry.size = kv.second.size;
+    }
+    Entry &xml = entries["scene.xml"], &basePath = entries["scene.basePath"];
+    xml.rows = xml.size = m_xml.size();
+    basePath.rows = basePath.size = m_basePath.size();
+    xml.cols = basePath.cols = 1;
+
+    /* Assign aligned offsets, the table follows the last blob */
+    uint64_t offset = sizeof(SnapshotHeader);
+    for (auto &kv : entries) {
+        offset = (offset + BLOB_ALIGNMENT - 1) / BLOB_ALIGNMENT * BLOB_ALIGNMENT;
+        kv.second.offset = offset;
+        offset += kv.second.size;
+    }
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(SnapshotHeader));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.entryCount = (uint32_t) entries.size();
+    header.tableOffset = offset;
+    write(os, header);
+
+    static const char padding[BLOB_ALIGNMENT] = { 0 };
+    uint64_t pos = sizeof(SnapshotHeader);
+    for (const auto &kv : entries) {
+        os.write(padding, (std::streamsize) (kv.second.offset - pos));
+        const char *data;
+        if (kv.first == "scene.xml")
+            data = m_xml.data();
+        else if (kv.first == "scene.basePath")
+            data = m_basePath.data();
+        else
+            data = reinterpret_cast<const char *>(m_entries.find(kv.first)->second.data.data());
+        os.write(data, (std::streamsize) kv.second.size);
+        pos = kv.second.offset + kv.second.size;
+    }
+
+    for (const auto &kv : entries) {
+        write(os, (uint32_t) kv.first.size());
+        os.write(kv.first.data(), (std::streamsize) kv.first.size());
+        write(os, kv.second.rows);
+        write(os, kv.second.cols);
+        write(os, kv.second.offset);
+        write(os, kv.second.size);
+    }
+
+    if (os.fail())
+        throw NoriException("Snapshot: error while writing \"%s\"", filename);
+}
+
+void createSnapshot(const std::string &xmlFilename, const std::string &snapshotFilename) {
+    std::ifstream is(xmlFilename, std::ios::binary);
+    if (is.fail())
+        throw NoriException("Unable to open \"%s\"", xmlFilename);
+    std::string xml((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+
+    filesystem::path basePath = filesystem::path(xmlFilename).make_absolute().parent_path();
+    getFileResolver()->prepend(basePath);
+
+    Snapshot snapshot(xml, basePath.str());
+    std::unique_ptr<NoriObject> root;
+    {
+        Snapshot::Scope scope(&snapshot);
+        root.reset(loadFromXMLString(xml, xmlFilename));
+    }
+    if (root->getClassType() != NoriObject::EScene)
+        throw NoriException("\"%s\" does not describe a scene", xmlFilename);
+
+    Timer timer;
+    snapshot.save(snapshotFilename);
+    cout << "Wrote the snapshot \"" << snapshotFilename << "\" (took " << timer.elapsedString() << ")" << endl;
+}
+
+NoriObject *loadFromSnapshot(const std::string &filename) {
+    Timer timer;
+
+    Snapshot snapshot(filename);
+    getFileResolver()->prepend(snapshot.getBasePath());
+
+    Snapshot::Scope scope(&snapshot);
+    NoriObject *root = loadFromXMLString(snapshot.getXML(), filename);
+    cout << "Loaded the snapshot \"" << filename << "\" (took " << timer.elapsedString() << ")" << endl;
+    return root;
+}
+
+NORI_NAMESPACE_END
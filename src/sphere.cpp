@@ -95,6 +95,18 @@ public:
         coordinates.x() = 0.5 + coordinates.x() / (2.f * M_PI);
         coordinates.y() /= M_PI;
         its.uv = coordinates;   
+
+        // Partial derivatives: u grows with theta, v with phi
+        float theta = std::acos(clamp(normal.z(), -1.f, 1.f));
+        float phi = std::atan2(normal.y(), normal.x());
+        float sinTheta = std::sin(theta), cosTheta = std::cos(theta);
+        float sinPhi = std::sin(phi), cosPhi = std::cos(phi);
+        Vector3f dndTheta(cosTheta * cosPhi, cosTheta * sinPhi, -sinTheta);
+        Vector3f dndPhi(-sinTheta * sinPhi, sinTheta * cosPhi, 0.f);
+        its.dndu = 2.f * M_PI * dndTheta;
+        its.dndv = M_PI * dndPhi;
+        its.dpdu = m_radius * its.dndu;
+        its.dpdv = m_radius * its.dndv;
     }
 
     virtual void sampleSurface(ShapeQueryRecord & sRec, const Point2f & sample) const override {
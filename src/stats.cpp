@@ -0,0 +1,203 @@
+#include <nori/stats.h>
+#include <tbb/mutex.h>
+#include <cstring>
+#include <algorithm>
+#include <set>
+
+NORI_NAMESPACE_BEGIN
+
+namespace {
+    struct StatInfo {
+        std::string category, name;
+        Statistics::EType type;
+        int slot, slotCount;
+    };
+
+    /**
+     * Registered statistics and thread buffers. This is created on first use,
+     * since statistics are registered during static initialization, and never
+     * destroyed, since worker threads may exit after static destruction.
+     */
+    struct Registry {
+        tbb::mutex mutex;
+        std::vector<StatInfo> stats;
+        int slotCount = 0;
+        std::set<uint64_t *> threadSlots;
+        uint64_t retiredSlots[Statistics::MaxSlots] = { 0 };
+
+        static Registry &instance() {
+            static Registry *registry = new Registry();
+            return *registry;
+        }
+
+        /**
+         * Return the sum of all thread buffers (including those of threads
+         * that have exited) and the statistics sorted by category
+         */
+        std::vector<uint64_t> collect(std::vector<StatInfo> &sortedStats) {
+            tbb::mutex::scoped_lock lock(mutex);
+            sortedStats = stats;
+            std::stable_sort(sortedStats.begin(), sortedStats.end(), [](const StatInfo &a, const StatInfo &b) {
+                return a.category < b.category;
+            });
+            std::vector<uint64_t> totals(retiredSlots, retiredSlots + slotCount);
+            for (uint64_t *slots : threadSlots)
+                for (int i = 0; i < slotCount; ++i)
+                    totals[i] += slots[i];
+            return totals;
+        }
+    };
+
+    double ratio(uint64_t numerator, uint64_t denominator) {
+        return denominator > 0 ? (double) numerator / (double) denominator : 0.0;
+    }
+};
+
+Statistics::ThreadBuffer::ThreadBuffer() {
+    memset(slots, 0, sizeof(slots));
+    Registry &registry = Registry::instance();
+    tbb::mutex::scoped_lock lock(registry.mutex);
+    registry.threadSlots.insert(slots);
+}
+
+Statistics::ThreadBuffer::~ThreadBuffer() {
+    Registry &registry = Registry::instance();
+    tbb::mutex::scoped_lock lock(registry.mutex);
+    for (int i = 0; i < MaxSlots; ++i)
+        registry.retiredSlots[i] += slots[i];
+    registry.threadSlots.erase(slots);
+}
+
+int Statistics::registerStat(const char *category, const char *name, EType type, int slotCount) {
+    Registry &registry = Registry::instance();
+    tbb::mutex::scoped_lock lock(registry.mutex);
+    for (const StatInfo &info : registry.stats) {
+        if (info.category == category && info.name == name) {
+            if (info.type != type || info.slotCount != slotCount)
+                throw NoriException("Statistic \"%s/%s\" was registered with different types", category, name);
+            return info.slot;
+        }
+    }
+    if (registry.slotCount + slotCount > MaxSlots)
+        throw NoriException("Too many statistics, increase Statistics::MaxSlots");
+
+    StatInfo info;
+    info.category = category;
+    info.name = name;
+    info.type = type;
+    info.slot = registry.slotCount;
+    info.slotCount = slotCount;
+    registry.stats.push_back(info);
+    registry.slotCount += slotCount;
+    return info.slot;
+}
+
+int Statistics::findStat(const char *category, const char *name) {
+    Registry &registry = Registry::instance();
+    tbb::mutex::scoped_lock lock(registry.mutex);
+    for (const StatInfo &info : registry.stats) {
+        if (info.category == category && info.name == name)
+            return info.slot;
+    }
+    return -1;
+}
+
+bool Statistics::isEmpty() {
+    Registry &registry = Registry::instance();
+    tbb::mutex::scoped_lock lock(registry.mutex);
+    return registry.stats.empty();
+}
+
+void Statistics::reset() {
+    Registry &registry = Registry::instance();
+    tbb::mutex::scoped_lock lock(registry.mutex);
+    memset(registry.retiredSlots, 0, sizeof(registry.retiredSlots));
+    for (uint64_t *slots : registry.threadSlots)
+        memset(slots, 0, sizeof(uint64_t) * MaxSlots);
+}
+
+std::string Statistics::toString() {
+    std::vector<StatInfo> stats;
+    std::vector<uint64_t> totals = Registry::instance().collect(stats);
+
+    std::string result = "Statistics:";
+    std::string category;
+    for (const StatInfo &info : stats) {
+        if (info.category != category) {
+            category = info.category;
+            result += "\n  " + category;
+        }
+        const uint64_t *values = &totals[info.slot];
+        switch (info.type) {
+            case ECounter:
+                result += tfm::format("\n    %-36s %12i", info.name, values[0]);
+                break;
+
+            case ERatio:
+                result += tfm::format("\n    %-36s %12.3f (%i / %i)", info.name,
+                                      ratio(values[0], values[1]), values[0], values[1]);
+                break;
+
+            case EHistogram: {
+                    uint64_t count = 0, sum = 0;
+                    for (int i = 0; i < info.slotCount; ++i) {
+                        count += values[i];
+                        sum += values[i] * (uint64_t) i;
+                    }
+                    result += tfm::format("\n    %-36s %12.3f (mean, %i values)", info.name, ratio(sum, count), count);
+                    for (int i = 0; i < info.slotCount; ++i) {
+                        if (values[i] == 0)
+                            continue;
+                        std::string bucket = tfm::format(i + 1 == info.slotCount ? "%i+" : "%i", i);
+                        result += tfm::format("\n      %-34s %12i (%.1f%%)", bucket, values[i],
+                                              100.0 * ratio(values[i], count));
+                    }
+                }
+                break;
+        }
+    }
+    return result;
+}
+
+std::string Statistics::toJSON() {
+    std::vector<StatInfo> stats;
+    std::vector<uint64_t> totals = Registry::instance().collect(stats);
+
+    std::string result = "{";
+    std::string category;
+    for (size_t k = 0; k < stats.size(); ++k) {
+        const StatInfo &info = stats[k];
+        if (k == 0 || info.category != category) {
+            if (k > 0)
+                result += "\n  },";
+            category = info.category;
+            result += "\n  " + jsonString(category) + ": {";
+        } else {
+            result += ",";
+        }
+        result += "\n    " + jsonString(info.name) + ": ";
+        const uint64_t *values = &totals[info.slot];
+        switch (info.type) {
+            case ECounter:
+                result += tfm::format("%i", values[0]);
+                break;
+
+            case ERatio:
+                result += tfm::format("{ \"total\": %i, \"count\": %i, \"mean\": %.6f }",
+                                      values[0], values[1], ratio(values[0], values[1]));
+                break;
+
+            case EHistogram:
+                result += "[";
+                for (int i = 0; i < info.slotCount; ++i)
+                    result += tfm::format("%s%i", i > 0 ? ", " : " ", values[i]);
+                result += " ]";
+                break;
+        }
+    }
+    if (!stats.empty())
+        result += "\n  }\n";
+    return result + "}";
+}
+
+NORI_NAMESPACE_END
@@ -0,0 +1,106 @@
+#include <nori/stattest.h>
+#include <nori/parser.h>
+#include <nori/timer.h>
+#include <filesystem/resolver.h>
+#include <pugixml.hpp>
+#include <algorithm>
+#include <memory>
+
+#if defined(PLATFORM_WINDOWS)
+#include <io.h>
+#else
+#include <dirent.h>
+#endif
+
+NORI_NAMESPACE_BEGIN
+
+namespace {
+    /// Return all XML files of a directory in alphabetical order
+    std::vector<std::string> listXMLFiles(const std::string &dir) {
+        std::vector<std::string> files;
+#if defined(PLATFORM_WINDOWS)
+        _finddata_t data;
+        intptr_t handle = _findfirst((dir + "\\*.xml").c_str(), &data);
+        if (handle != -1) {
+            do {
+                if (!(data.attrib & _A_SUBDIR))
+                    files.push_back(dir + "\\" + data.name);
+            } while (_findnext(handle, &data) == 0);
+            _findclose(handle);
+        }
+#else
+        DIR *d = opendir(dir.c_str());
+        if (!d)
+            throw NoriException("Unable to open directory \"%s\"", dir);
+        while (dirent *entry = readdir(d)) {
+            std::string name = entry->d_name;
+            if (endsWith(toLower(name), ".xml") && filesystem::path(dir + "/" + name).is_file())
+                files.push_back(dir + "/" + name);
+        }
+        closedir(d);
+#endif
+        std::sort(files.begin(), files.end());
+        return files;
+    }
+
+    /// Does the XML file describe a test (without instantiating it)?
+    bool isTestFile(const std::string &filename) {
+        pugi::xml_document doc;
+        return doc.load_file(filename.c_str()) && std::string(doc.document_element().name()) == "test";
+    }
+
+    struct TestFileResult {
+        std::string filename;
+        int passed, total;
+        std::string error;
+        std::string time;
+    };
+};
+
+int runTestDirectory(const std::string &directory) {
+    getFileResolver()->prepend(filesystem::path(directory));
+
+    std::vector<TestFileResult> results;
+    for (const std::string &filename : listXMLFiles(directory)) {
+        if (!isTestFile(filename))
+            continue;
+
+        cout << "======================================================" << endl;
+        cout << "Running \"" << filename << "\"" << endl;
+        TestFileResult result;
+        result.filename = filename;
+        result.passed = result.total = 0;
+        Timer timer;
+        try {
+            std::unique_ptr<NoriObject> root(loadFromXML(filename));
+            const StatisticalTest *test = dynamic_cast<const StatisticalTest *>(root.get());
+            if (test) {
+                result.passed = test->getPassedCount();
+                result.total = test->getTestCount();
+            }
+        } catch (const std::exception &e) {
+            cerr << "Error: " << e.what() << endl;
+            result.error = e.what();
+        }
+        result.time = timer.elapsedString();
+        results.push_back(result);
+    }
+
+    int failed = 0;
+    cout << "======================================================" << endl;
+    cout << "Summary:" << endl;
+    for (const TestFileResult &result : results) {
+        bool ok = result.error.empty() && result.passed == result.total;
+        if (!ok)
+            ++failed;
+        if (result.error.empty())
+            cout << tfm::format("  %s  %s: passed %i/%i (took %s)", ok ? "PASS" : "FAIL",
+                                result.filename, result.passed, result.total, result.time) << endl;
+        else
+            cout << tfm::format("  FAIL  %s: %s", result.filename, result.error) << endl;
+    }
+    cout << (results.size() - failed) << "/" << results.size() << " test files passed." << endl;
+    return failed;
+}
+
+NORI_NAMESPACE_END
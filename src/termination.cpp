@@ -0,0 +1,79 @@
+#include <nori/termination.h>
+#include <nori/proplist.h>
+#include <nori/sampler.h>
+#include <nori/stats.h>
+
+NORI_NAMESPACE_BEGIN
+
+NORI_STAT_COUNTER(statRouletteTerminations, "Integrator", "Russian roulette terminations");
+NORI_STAT_COUNTER(statMaxDepthTerminations, "Integrator", "Maximum depth terminations");
+
+namespace {
+    /// Lowest survival probability of the efficiency mode
+    const float MinEfficiencyProb = .05f;
+};
+
+PathTermination::PathTermination(const PropertyList &props, float defaultMaxProb) {
+    m_minDepth = props.getInteger("minDepth", 0);
+    m_maxDepth = props.getInteger("maxDepth", -1);
+    m_maxProb = props.getFloat("maxRRProb", defaultMaxProb);
+    m_threshold = props.getFloat("rrThreshold", 1.f);
+
+    std::string mode = toLower(props.getString("rrMode", "throughput"));
+    if (mode == "none")
+        m_mode = ENone;
+    else if (mode == "throughput")
+        m_mode = EThroughput;
+    else if (mode == "efficiency")
+        m_mode = EEfficiency;
+    else
+        throw NoriException("PathTermination: unknown rrMode \"%s\" (expected none, throughput or efficiency)", mode);
+
+    if (m_minDepth < 0)
+        throw NoriException("PathTermination: minDepth must be non-negative");
+    if (m_maxProb <= 0 || m_maxProb > 1)
+        throw NoriException("PathTermination: maxRRProb must be in (0, 1]");
+    if (m_threshold <= 0)
+        throw NoriException("PathTermination: rrThreshold must be positive");
+}
+
+float PathTermination::survivalProbability(uint32_t depth, const Color3f &throughput) const {
+    if (m_maxDepth >= 0 && depth > (uint32_t) m_maxDepth)
+        return 0.f;
+    if (depth <= (uint32_t) m_minDepth)
+        return 1.f;
+
+    switch (m_mode) {
+        case EThroughput:
+            return std::min(throughput.maxCoeff(), m_maxProb);
+        case EEfficiency:
+            return clamp(throughput.getLuminance() / m_threshold, MinEfficiencyProb, m_maxProb);
+        default:
+            return 1.f;
+    }
+}
+
+bool PathTermination::survive(uint32_t depth, Color3f &throughput, Sampler *sampler) const {
+    if (m_maxDepth >= 0 && depth > (uint32_t) m_maxDepth) {
+        NORI_STAT_ADD(statMaxDepthTerminations, 1);
+        return false;
+    }
+
+    float p = survivalProbability(depth, throughput);
+    if (p >= 1.f)
+        return true;
+    if (sampler->next1D() >= p) {
+        NORI_STAT_ADD(statRouletteTerminations, 1);
+        return false;
+    }
+    throughput /= p;
+    return true;
+}
+
+std::string PathTermination::toString() const {
+    const char *modes[] = { "none", "throughput", "efficiency" };
+    return tfm::format("PathTermination[mode = %s, minDepth = %i, maxDepth = %i, maxRRProb = %f, rrThreshold = %f]",
+                       modes[m_mode], m_minDepth, m_maxDepth, m_maxProb, m_threshold);
+}
+
+NORI_NAMESPACE_END
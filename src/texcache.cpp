@@ -0,0 +1,335 @@
+#include <nori/texcache.h>
+#include <nori/bitmap.h>
+#include <half.h>
+#include <cstring>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/spin_rw_mutex.h>
+#include <unordered_map>
+
+NORI_NAMESPACE_BEGIN
+
+namespace {
+    /// Header of a tiled image file
+    struct TiledImageHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t precision;
+        uint32_t levelCount;
+        uint32_t tileRes;
+        uint64_t sourceStamp;
+    };
+
+    const char TILEDIMAGE_MAGIC[8] = "NORITEX";
+    const uint32_t TILEDIMAGE_VERSION = 1;
+
+    inline float fromSRGB(float value) {
+        if (value <= 0.04045f) return value * (1.f / 12.92f);
+        return std::pow((value + 0.055f) * (1.f / 1.055f), 2.4f);
+    }
+
+    /// Lookup table for decoding 8-bit sRGB values
+    struct SRGBTable {
+        float values[256];
+        SRGBTable() {
+            for (int i = 0; i < 256; ++i)
+                values[i] = fromSRGB(i / 255.f);
+        }
+    };
+
+    const SRGBTable &srgbTable() {
+        static SRGBTable table;
+        return table;
+    }
+
+    /// Downsample a level by averaging blocks of 2x2 texels
+    Bitmap downsample(const Bitmap &bitmap) {
+        int width = std::max(1, (int) bitmap.cols() / 2),
+            height = std::max(1, (int) bitmap.rows() / 2);
+        Bitmap result(Vector2i(width, height));
+        for (int y = 0; y < height; ++y) {
+            int y0 = std::min(2 * y, (int) bitmap.rows() - 1), y1 = std::min(2 * y + 1, (int) bitmap.rows() - 1);
+            for (int x = 0; x < width; ++x) {
+                int x0 = std::min(2 * x, (int) bitmap.cols() - 1), x1 = std::min(2 * x + 1, (int) bitmap.cols() - 1);
+                result(y, x) = 0.25f * (bitmap(y0, x0) + bitmap(y0, x1) + bitmap(y1, x0) + bitmap(y1, x1));
+            }
+        }
+        return result;
+    }
+};
+
+TiledImage::TiledImage(const std::string &sourceFile, const std::string &tiledFile, EPrecision precision)
+    : m_filename(tiledFile), m_precision(precision) {
+    size_t valueBytes = precision == EFloat32 ? sizeof(float) : (precision == EFloat16 ? sizeof(half) : sizeof(uint8_t));
+    m_tileBytes = 3 * valueBytes * TILE_RES * TILE_RES;
+
+    uint64_t sourceStamp = fileStamp(sourceFile);
+    if (!open(sourceStamp)) {
+        convert(sourceFile, sourceStamp);
+        if (!open(sourceStamp))
+            throw NoriException("TiledImage: unable to read back \"%s\"", tiledFile);
+    }
+    m_id = TextureCache::instance().registerImage();
+}
+
+void TiledImage::convert(const std::string &sourceFile, uint64_t sourceStamp) {
+    std::vector<Bitmap> levels;
+    levels.emplace_back(sourceFile);
+    while (levels.back().cols() > 1 || levels.back().rows() > 1)
+        levels.push_back(downsample(levels.back()));
+
+    cout << "Writing " << levels.size() << " MIP levels of \"" << sourceFile
+         << "\" as tiles to \"" << m_filename << "\"" << endl;
+
+    std::ofstream os(m_filename, std::ios::binary);
+    if (os.fail())
+        throw NoriException("TiledImage: unable to open \"%s\" for writing", m_filename);
+
+    TiledImageHeader header;
+    memset(&header, 0, sizeof(TiledImageHeader));
+    memcpy(header.magic, TILEDIMAGE_MAGIC, sizeof(header.magic));
+    header.version = TILEDIMAGE_VERSION;
+    header.precision = (uint32_t) m_precision;
+    header.levelCount = (uint32_t) levels.size();
+    header.tileRes = TILE_RES;
+    header.sourceStamp = sourceStamp;
+    os.write(reinterpret_cast<const char *>(&header), sizeof(TiledImageHeader));
+
+    for (const Bitmap &bitmap : levels) {
+        int32_t size[2] = { (int32_t) bitmap.cols(), (int32_t) bitmap.rows() };
+        os.write(reinterpret_cast<const char *>(size), sizeof(size));
+    }
+
+    std::vector<uint8_t> tile(m_tileBytes);
+    for (const Bitmap &bitmap : levels) {
+        int width = (int) bitmap.cols(), height = (int) bitmap.rows();
+        for (int ty = 0; ty < (height + TILE_RES - 1) / TILE_RES; ++ty) {
+            for (int tx = 0; tx < (width + TILE_RES - 1) / TILE_RES; ++tx) {
+                for (int i = 0; i < TILE_RES * TILE_RES; ++i) {
+                    /* Texels past the border repeat the last row/column */
+                    int x = std::min(tx * TILE_RES + i % TILE_RES, width - 1),
+                        y = std::min(ty * TILE_RES + i / TILE_RES, height - 1);
+                    const Color3f &c = bitmap(y, x);
+                    for (int ch = 0; ch < 3; ++ch) {
+                        if (m_precision == EFloat32)
+                            reinterpret_cast<float *>(tile.data())[3 * i + ch] = c[ch];
+                        else if (m_precision == EFloat16)
+                            reinterpret_cast<half *>(tile.data())[3 * i + ch] = half(c[ch]);
+                        else
+                            tile[3 * i + ch] = linearToSRGB8(c[ch]);
+                    }
+                }
+                os.write(reinterpret_cast<const char *>(tile.data()), m_tileBytes);
+            }
+        }
+    }
+
+    if (os.fail())
+        throw NoriException("TiledImage: error while writing \"%s\"", m_filename);
+}
+
+bool TiledImage::open(uint64_t sourceStamp) {
+    if (m_file.is_open())
+        m_file.close();
+    m_file.clear();
+    m_file.open(m_filename, std::ios::binary);
+    if (m_file.fail())
+        return false;
+
+    TiledImageHeader header;
+    m_file.read(reinterpret_cast<char *>(&header), sizeof(TiledImageHeader));
+    if (m_file.fail() || memcmp(header.magic, TILEDIMAGE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != TILEDIMAGE_VERSION || header.precision != (uint32_t) m_precision ||
+        header.tileRes != (uint32_t) TILE_RES || header.sourceStamp != sourceStamp ||
+        header.levelCount == 0 || header.levelCount > 32) {
+        m_file.close();
+        return false;
+    }
+
+    m_levels.resize(header.levelCount);
+    uint64_t offset = sizeof(TiledImageHeader) + header.levelCount * 2 * sizeof(int32_t);
+    for (Level &level : m_levels) {
+        int32_t size[2];
+        m_file.read(reinterpret_cast<char *>(size), sizeof(size));
+        level.size = Vector2i(size[0], size[1]);
+        level.tiles = Vector2i((size[0] + TILE_RES - 1) / TILE_RES, (size[1] + TILE_RES - 1) / TILE_RES);
+        level.offset = offset;
+        offset += (uint64_t) level.tiles.x() * level.tiles.y() * m_tileBytes;
+    }
+
+    /* Check that the file is complete */
+    m_file.seekg(0, std::ios::end);
+    if (m_file.fail() || (uint64_t) m_file.tellg() != offset) {
+        m_file.close();
+        return false;
+    }
+    return true;
+}
+
+void TiledImage::readTile(int level, int tileX, int tileY, uint8_t *target) const {
+    const Level &l = m_levels[level];
+    uint64_t offset = l.offset + ((uint64_t) tileY * l.tiles.x() + tileX) * m_tileBytes;
+
+    tbb::mutex::scoped_lock lock(m_fileMutex);
+    m_file.seekg((std::streamoff) offset);
+    m_file.read(reinterpret_cast<char *>(target), m_tileBytes);
+    if (m_file.fail())
+        throw NoriException("TiledImage: error while reading \"%s\"", m_filename);
+}
+
+Color3f TiledImage::decode(const uint8_t *tile, int index) const {
+    switch (m_precision) {
+        case EFloat32: {
+            const float *v = reinterpret_cast<const float *>(tile) + 3 * index;
+            return Color3f(v[0], v[1], v[2]);
+        }
+        case EFloat16: {
+            const half *v = reinterpret_cast<const half *>(tile) + 3 * index;
+            return Color3f((float) v[0], (float) v[1], (float) v[2]);
+        }
+        default: {
+            const float *table = srgbTable().values;
+            const uint8_t *v = tile + 3 * index;
+            return Color3f(table[v[0]], table[v[1]], table[v[2]]);
+        }
+    }
+}
+
+struct TextureCache::Shard {
+    struct Entry {
+        uint64_t key;
+        Tile tile;
+        std::atomic<bool> referenced; ///< Set by hits, cleared by the clock hand
+
+        Entry(uint64_t key, const Tile &tile) : key(key), tile(tile), referenced(true) { }
+    };
+
+    tbb::spin_rw_mutex mutex;
+    std::unordered_map<uint64_t, std::unique_ptr<Entry>> index;
+    std::vector<Entry *> clock; ///< Resident tiles in the order visited by the clock hand
+    size_t hand = 0;
+    size_t bytes = 0;
+};
+
+struct TextureCache::ThreadCounters {
+    /* Every thread only writes its own counters, so plain loads and stores suffice */
+    struct Counters {
+        std::atomic<uint64_t> hits, misses;
+        Counters() : hits(0), misses(0) { }
+    };
+
+    tbb::enumerable_thread_specific<Counters, tbb::cache_aligned_allocator<Counters>,
+                                    tbb::ets_key_per_instance> counters;
+};
+
+namespace {
+    inline void increment(std::atomic<uint64_t> &counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+};
+
+TextureCache::TextureCache()
+    : m_shards(new Shard[SHARD_COUNT]), m_capacity(256 * 1024 * 1024), m_nextId(0),
+      m_counters(new ThreadCounters()), m_residentBytes(0), m_peakBytes(0) { }
+
+TextureCache::~TextureCache() { }
+
+TextureCache &TextureCache::instance() {
+    static TextureCache cache;
+    return cache;
+}
+
+void TextureCache::setCapacity(size_t bytes) {
+    m_capacity = bytes;
+}
+
+TextureCache::Tile TextureCache::lookup(const TiledImage &image, int level, int tileX, int tileY) {
+    uint64_t key = ((uint64_t) image.getId() << 43) | ((uint64_t) level << 38) |
+                   ((uint64_t) tileX << 19) | (uint64_t) tileY;
+    Shard &shard = m_shards[(key * 0x9E3779B97F4A7C15ull) >> 60];
+    ThreadCounters::Counters &counters = m_counters->counters.local();
+
+    {
+        tbb::spin_rw_mutex::scoped_lock lock(shard.mutex, false);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) {
+            Shard::Entry &entry = *it->second;
+            /* Avoid writing to the entry's cache line if it is already marked */
+            if (!entry.referenced.load(std::memory_order_relaxed))
+                entry.referenced.store(true, std::memory_order_relaxed);
+            increment(counters.hits);
+            return entry.tile;
+        }
+    }
+
+    /* Read the tile without holding the lock */
+    increment(counters.misses);
+    std::shared_ptr<std::vector<uint8_t>> data(new std::vector<uint8_t>(image.getTileBytes()));
+    image.readTile(level, tileX, tileY, data->data());
+    Tile tile = data;
+
+    tbb::spin_rw_mutex::scoped_lock lock(shard.mutex, true);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) /* Another thread was faster */
+        return it->second->tile;
+
+    Shard::Entry *added = new Shard::Entry(key, tile);
+    shard.index[key].reset(added);
+    shard.clock.push_back(added);
+    shard.bytes += tile->size();
+    size_t resident = (m_residentBytes += tile->size());
+
+    size_t peak = m_peakBytes;
+    while (resident > peak && !m_peakBytes.compare_exchange_weak(peak, resident))
+        ;
+
+    /* Advance the clock hand: tiles that were referenced since its last visit get
+       a second chance, the others are evicted. Always keep the new tile. */
+    size_t shardCapacity = m_capacity / SHARD_COUNT;
+    while (shard.bytes > shardCapacity && shard.clock.size() > 1) {
+        if (shard.hand >= shard.clock.size())
+            shard.hand = 0;
+        Shard::Entry *victim = shard.clock[shard.hand];
+        if (victim == added || victim->referenced.load(std::memory_order_relaxed)) {
+            victim->referenced.store(false, std::memory_order_relaxed);
+            ++shard.hand;
+            continue;
+        }
+        shard.bytes -= victim->tile->size();
+        m_residentBytes -= victim->tile->size();
+        shard.clock[shard.hand] = shard.clock.back();
+        shard.clock.pop_back();
+        shard.index.erase(victim->key);
+    }
+    return tile;
+}
+
+uint64_t TextureCache::getHitCount() const {
+    uint64_t hits = 0;
+    for (const auto &counters : m_counters->counters)
+        hits += counters.hits.load(std::memory_order_relaxed);
+    return hits;
+}
+
+uint64_t TextureCache::getMissCount() const {
+    uint64_t misses = 0;
+    for (const auto &counters : m_counters->counters)
+        misses += counters.misses.load(std::memory_order_relaxed);
+    return misses;
+}
+
+void TextureCache::resetStatistics() {
+    for (auto &counters : m_counters->counters) {
+        counters.hits.store(0, std::memory_order_relaxed);
+        counters.misses.store(0, std::memory_order_relaxed);
+    }
+}
+
+std::string TextureCache::getStatistics() const {
+    uint64_t hits = getHitCount(), misses = getMissCount();
+    return tfm::format(
+        "Texture cache: %i lookups, %.2f%% hit rate, %s resident (peak %s, budget %s)",
+        hits + misses, hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0,
+        memString(m_residentBytes), memString(m_peakBytes), memString(m_capacity));
+}
+
+NORI_NAMESPACE_END
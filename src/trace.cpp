@@ -0,0 +1,84 @@
+#include <nori/trace.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <chrono>
+#include <fstream>
+
+NORI_NAMESPACE_BEGIN
+
+namespace {
+    struct Event {
+        std::string name, args;
+        const char *category;
+        double start, end;
+        int thread;
+    };
+
+    struct ThreadEvents {
+        int thread;
+        std::vector<Event> events;
+    };
+
+    std::atomic<int> nextThreadId(1);
+
+    /// Events of every thread, the threads are numbered in order of their first event
+    tbb::enumerable_thread_specific<ThreadEvents> threadEvents([] {
+        ThreadEvents events;
+        events.thread = nextThreadId++;
+        return events;
+    });
+
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+};
+
+std::atomic<bool> Trace::m_enabled(false);
+
+void Trace::reset() {
+    threadEvents.clear();
+    nextThreadId = 1;
+    epoch = std::chrono::steady_clock::now();
+}
+
+double Trace::now() {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Trace::addEvent(const std::string &name, const char *category,
+                     double start, double end, const std::string &args) {
+    ThreadEvents &local = threadEvents.local();
+    Event event;
+    event.name = name;
+    event.args = args;
+    event.category = category;
+    event.start = start;
+    event.end = end;
+    event.thread = local.thread;
+    local.events.push_back(std::move(event));
+}
+
+void Trace::write(const std::string &filename) {
+    std::vector<Event> events;
+    for (const ThreadEvents &local : threadEvents)
+        events.insert(events.end(), local.events.begin(), local.events.end());
+    std::sort(events.begin(), events.end(), [](const Event &a, const Event &b) {
+        return a.start < b.start;
+    });
+
+    std::ofstream os(filename);
+    os << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    for (size_t i = 0; i < events.size(); ++i) {
+        const Event &event = events[i];
+        os << (i > 0 ? ",\n" : "\n")
+           << tfm::format("{\"name\": %s, \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+                          "\"pid\": 1, \"tid\": %i, \"args\": {%s}}",
+                          jsonString(event.name), event.category, event.start,
+                          event.end - event.start, event.thread, event.args);
+    }
+    os << "\n]}" << endl;
+
+    if (os.fail())
+        cerr << "Warning: unable to write the trace \"" << filename << "\"" << endl;
+    else
+        cout << "Wrote the trace \"" << filename << "\" (" << events.size() << " events)" << endl;
+}
+
+NORI_NAMESPACE_END
@@ -21,8 +21,10 @@
 #include <nori/camera.h>
 #include <nori/integrator.h>
 #include <nori/sampler.h>
+#include <nori/stattest.h>
 #include <hypothesis.h>
-#include <pcg32.h>
+#include <tbb/parallel_for.h>
+#include <atomic>
 
 /*
  * =======================================================================
@@ -54,10 +56,23 @@ NORI_NAMESPACE_BEGIN
  *
  * 2. that the average radiance received by a camera within some scene
  *    matches a given value (modulo noise).
+ *
+ * Scenes are rendered like an image: the integrator is preprocessed once,
+ * and the paths are traced in \c passCount passes, after each of which
+ * \ref Integrator::endPass() is called (so that learning integrators train
+ * on their own samples). Every chunk keeps its sampler across the passes, so
+ * the number of passes does not change the samples of other integrators.
+ *
+ * Integrators that return \c true from \ref Integrator::isBatched() receive
+ * the camera rays of a chunk in batches through \ref Integrator::LiBatch().
+ *
+ * Scenes that request AOVs are rendered through \ref Integrator::LiAOV(), and
+ * the test additionally fails if the emission, diffuse and specular AOVs of
+ * a path do not add up to its radiance estimate.
  */
-class StudentsTTest : public NoriObject {
+class StudentsTTest : public StatisticalTest {
 public:
-    StudentsTTest(const PropertyList &propList) {
+    StudentsTTest(const PropertyList &propList) : StatisticalTest(propList) {
         /* The null hypothesis will be rejected when the associated
            p-value is below the significance level specified here. */
         m_significanceLevel = propList.getFloat("significanceLevel", 0.01f);
@@ -74,6 +89,11 @@ public:
 
         /* Number of BSDF samples that should be generated (default: 100K) */
         m_sampleCount = propList.getInteger("sampleCount", 100000);
+
+        /* Number of passes over the samples of a scene, see Integrator::endPass() */
+        m_passCount = propList.getInteger("passCount", 32);
+        if (m_passCount < 1)
+            throw NoriException("StudentsTTest: passCount must be positive");
     }
 
     virtual ~StudentsTTest() {
@@ -101,9 +121,6 @@ public:
 
     /// Invoke a series of t-tests on the provided input
     virtual void activate() override {
-        int total = 0, passed = 0;
-        pcg32 random;
-
         if (!m_bsdfs.empty()) {
             if (m_references.size() * m_bsdfs.size() != m_angles.size())
                 throw NoriException("Specified a different number of angles and reference values!");
@@ -115,32 +132,28 @@ public:
             for (auto bsdf : m_bsdfs) {
                 for (size_t i=0; i<m_references.size(); ++i) {
                     float angle = m_angles[i], reference = m_references[ctr++];
+                    int test = getTestCount();
 
                     cout << "------------------------------------------------------" << endl;
                     cout << "Testing (angle=" << angle << "): " << bsdf->toString() << endl;
-                    ++total;
 
                     BSDFQueryRecord bRec(sphericalDirection(degToRad(angle), 0));
 
                     cout << "Drawing " << m_sampleCount << " samples .. " << endl;
-                    double mean=0, variance = 0;
-                    for (int k=0; k<m_sampleCount; ++k) {
-                        Point2f sample(random.nextFloat(), random.nextFloat());
-                        double result = (double) bsdf->sample(bRec, sample).getLuminance();
-
-                        /* Numerically robust online variance estimation using an
-                           algorithm proposed by Donald Knuth (TAOCP vol.2, 3rd ed., p.232) */
-                        double delta = result - mean;
-                        mean += delta / (double) (k+1);
-                        variance += delta * (result - mean);
-                    }
-                    variance /= m_sampleCount - 1;
+                    MeanVariance stats = estimate([&](int chunk, int count, MeanVariance &chunkStats) {
+                        pcg32 random = chunkRandom(test, chunk);
+                        BSDFQueryRecord query(bRec);
+                        for (int k=0; k<count; ++k) {
+                            Point2f sample(random.nextFloat(), random.nextFloat());
+                            chunkStats.add((double) bsdf->sample(query, sample).getLuminance());
+                        }
+                    });
+
                     std::pair<bool, std::string>
-                        result = hypothesis::students_t_test(mean, variance, reference,
+                        result = hypothesis::students_t_test(stats.mean, stats.variance(), reference,
                             m_sampleCount, m_significanceLevel, (int) m_references.size());
 
-                    if (result.first)
-                        ++passed;
+                    record(result.first);
                     cout << result.second << endl;
                 }
             }
@@ -148,72 +161,146 @@ public:
             if (m_references.size() != m_scenes.size())
                 throw NoriException("Specified a different number of scenes and reference values!");
 
-            Sampler *sampler = static_cast<Sampler *>(
-                NoriObjectFactory::createInstance("independent", PropertyList()));
+            std::unique_ptr<Sampler> sampler(static_cast<Sampler *>(
+                NoriObjectFactory::createInstance("independent", PropertyList())));
 
             int ctr = 0;
             for (auto scene : m_scenes) {
-                const Integrator *integrator = scene->getIntegrator();
+                Integrator *integrator = scene->getIntegrator();
                 const Camera *camera = scene->getCamera();
+                bool aovs = !scene->getAOVLayout().empty();
+                std::atomic<int> aovMismatches(0);
                 float reference = m_references[ctr++];
+                int test = getTestCount();
 
                 cout << "------------------------------------------------------" << endl;
                 cout << "Testing scene: " << scene->toString() << endl;
-                ++total;
+
+                integrator->preprocess(scene);
 
                 cout << "Generating " << m_sampleCount << " paths.. " << endl;
 
-                double mean = 0, variance = 0;
-                for (int k=0; k<m_sampleCount; ++k) {
-                    /* Sample a ray from the camera */
-                    Ray3f ray;
-                    Point2f pixelSample = (sampler->next2D().array()
-                        * camera->getOutputSize().cast<float>().array()).matrix();
-                    Color3f value = camera->sampleRay(ray, pixelSample, sampler->next2D());
-
-                    /* Compute the incident radiance */
-                    value *= integrator->Li(scene, sampler, ray);
-
-                    /* Numerically robust online variance estimation using an
-                       algorithm proposed by Donald Knuth (TAOCP vol.2, 3rd ed., p.232) */
-                    double result = (double) value.getLuminance();
-                    double delta = result - mean;
-                    mean += delta / (double) (k+1);
-                    variance += delta * (result - mean);
+                std::vector<std::unique_ptr<Sampler>> samplers(chunkCount(m_sampleCount));
+                for (size_t chunk = 0; chunk < samplers.size(); ++chunk) {
+                    samplers[chunk] = sampler->clone();
+                    samplers[chunk]->seed(m_seed, chunkStream(test, (int) chunk));
                 }
-                variance /= m_sampleCount - 1;
+
+                /* Batched integrators receive the camera rays in batches, like the blocks of a render */
+                int batchSize = integrator->isBatched() ? BatchSize : 1;
+
+                MeanVariance stats = estimate([&](int chunk, int count, MeanVariance &chunkStats) {
+                    Sampler *chunkSampler = samplers[chunk].get();
+                    std::vector<Ray3f> rays(batchSize);
+                    std::vector<Color3f> weights(batchSize), values(batchSize);
+
+                    for (int k=0; k<count; k += batchSize) {
+                        int n = std::min(batchSize, count - k);
+
+                        /* Sample rays from the camera */
+                        for (int i=0; i<n; ++i) {
+                            Point2f pixelSample = (chunkSampler->next2D().array()
+                                * camera->getOutputSize().cast<float>().array()).matrix();
+                            weights[i] = camera->sampleRay(rays[i], pixelSample, chunkSampler->next2D());
+                        }
+
+                        /* Compute the incident radiance (as in the renderer, the AOVs of batched integrators are estimated afterwards) */
+                        AOVRecord record;
+                        if (aovs && !integrator->isBatched())
+                            values[0] = integrator->LiAOV(scene, chunkSampler, rays[0], record);
+                        else
+                            integrator->LiBatch(scene, chunkSampler, rays.data(), values.data(), (size_t) n);
+
+                        for (int i=0; i<n; ++i) {
+                            if (aovs) {
+                                if (integrator->isBatched()) {
+                                    record = AOVRecord();
+                                    Integrator::estimateAOVs(scene, rays[i], values[i], record);
+                                }
+                                Color3f sum = record.emission + record.diffuse + record.specular;
+                                if (!((sum - values[i]).abs() <= 1e-4f * (1.f + values[i].abs())).all())
+                                    ++aovMismatches;
+                            }
+                            chunkStats.add((double) Color3f(weights[i] * values[i]).getLuminance());
+                        }
+                    }
+                }, m_passCount, [&](int pass) { integrator->endPass(scene, (uint32_t) pass); });
 
                 std::pair<bool, std::string>
-                    result = hypothesis::students_t_test(mean, variance, reference,
+                    result = hypothesis::students_t_test(stats.mean, stats.variance(), reference,
                         m_sampleCount, m_significanceLevel, (int) m_references.size());
 
-                if (result.first)
-                    ++passed;
+                if (aovMismatches > 0)
+                    cout << "Rejected: the emission, diffuse and specular AOVs of " << aovMismatches
+                         << " paths do not add up to the radiance estimate" << endl;
+
+                record(result.first && aovMismatches == 0);
                 cout << result.second << endl;
             }
         }
-        cout << "Passed " << passed << "/" << total << " tests." << endl;
+        cout << "Passed " << getPassedCount() << "/" << getTestCount() << " tests." << endl;
     }
 
     virtual std::string toString() const override {
         return tfm::format(
             "StudentsTTest[\n"
             "  significanceLevel = %f,\n"
-            "  sampleCount= %i\n"
+            "  sampleCount= %i,\n"
+            "  passCount = %i,\n"
+            "  seed = %i\n"
             "]",
             m_significanceLevel,
-            m_sampleCount
+            m_sampleCount,
+            m_passCount,
+            m_seed
         );
     }
 
-    virtual EClassType getClassType() const override { return ETest; }
 private:
+    /**
+     * \brief Estimate the mean and variance of \c m_sampleCount samples in
+     * parallel chunks
+     *
+     * \c sampleChunk(chunk, count, stats) adds the \c count samples of a
+     * chunk to \c stats. The chunk statistics are merged in chunk order,
+     * which makes the result independent of the scheduling.
+     */
+    template <typename Functor> MeanVariance estimate(const Functor &sampleChunk) const {
+        return estimate(sampleChunk, 1, [](int) { });
+    }
+
+    /**
+     * \brief Like \ref estimate(), but visit every chunk \c passCount times,
+     * each time drawing the next slice of its samples, and call
+     * \c endPass(pass) after each pass (while no chunk is sampled)
+     */
+    template <typename Functor, typename PassFunctor>
+    MeanVariance estimate(const Functor &sampleChunk, int passCount, const PassFunctor &endPass) const {
+        std::vector<MeanVariance> chunks(chunkCount(m_sampleCount));
+        for (int pass = 0; pass < passCount; ++pass) {
+            tbb::parallel_for(0, (int) chunks.size(), [&](int chunk) {
+                int64_t samples = chunkSamples(m_sampleCount, chunk);
+                int begin = (int) (samples * pass / passCount), end = (int) (samples * (pass + 1) / passCount);
+                sampleChunk(chunk, end - begin, chunks[chunk]);
+            });
+            endPass(pass);
+        }
+        MeanVariance stats;
+        for (const MeanVariance &chunk : chunks)
+            stats.merge(chunk);
+        return stats;
+    }
+
+    /// Number of camera rays handed to a batched integrator at once
+    static const int BatchSize = 256;
+
     std::vector<BSDF *> m_bsdfs;
     std::vector<Scene *> m_scenes;
     std::vector<float> m_angles;
     std::vector<float> m_references;
     float m_significanceLevel;
     int m_sampleCount;
+    int m_passCount;
 };
 
 NORI_REGISTER_CLASS(StudentsTTest, "ttest");